@@ -0,0 +1,207 @@
+#
+/*
+ *    Copyright (C) 2018
+ *    Jan van Katwijk (J.vanKatwijk@gmail.com)
+ *    Lazy Chair Computing
+ *
+ *    This file is part of the sdrplayBridge.
+ *
+ *    rtlsdrBridge is available under GPL-V2
+ */
+#include	"channel-bank.h"
+#include	<stdlib.h>
+#include	<math.h>
+
+channelBank	*bankCreate	(int inputRate,
+	                         const int32_t *offsets, int channels,
+	                         int bandwidth,
+	                         rtlsdr_bank_cb_t cb, void *ctx) {
+channelBank	*b;
+int	M	= 2;
+int	L;
+int	i;
+double	fc;
+double	sum	= 0;
+double	rate;
+
+	if ((offsets == NULL) || (cb == NULL) || (bandwidth <= 0) ||
+	    (channels <= 0) || (channels > RTLSDR_MAX_BANK_CHANNELS))
+	   return NULL;
+	for (i = 0; i < channels; i ++)
+	   if (2 * abs (offsets [i]) >= inputRate)
+	      return NULL;
+	while ((2 * M <= BANK_MAX_BINS) &&
+	       ((double)inputRate / (2 * M) >= 2.0 * bandwidth))
+	   M *= 2;
+
+	b	= (channelBank *)calloc (1, sizeof (channelBank));
+	if (b == NULL)
+	   return NULL;
+	b	-> bins		= M;
+	b	-> decimation	= M / 2;
+	b	-> inputRate	= inputRate;
+	b	-> outputRate	= (int)lrint (2.0 * inputRate / M);
+	b	-> channels	= channels;
+	b	-> callback	= cb;
+	b	-> ctx		= ctx;
+	L	= M * BANK_TAPS;
+	b	-> proto	= (float *)malloc (L * sizeof (float));
+	b	-> re		= (float *)malloc (M * sizeof (float));
+	b	-> im		= (float *)malloc (M * sizeof (float));
+	b	-> bin		= (int *)malloc (channels * sizeof (int));
+	b	-> rotCos	= (float *)malloc (channels * sizeof (float));
+	b	-> rotSin	= (float *)malloc (channels * sizeof (float));
+	b	-> rotRe	= (float *)malloc (channels * sizeof (float));
+	b	-> rotIm	= (float *)malloc (channels * sizeof (float));
+	b	-> out		= (float *)malloc (channels * BANK_BATCH *
+	                                              2 * sizeof (float));
+	b	-> bufI		= (float *)calloc (2 * L, sizeof (float));
+	b	-> bufQ		= (float *)calloc (2 * L, sizeof (float));
+	if ((fftInit (&b -> fft, M) < 0) ||
+	    (b -> proto == NULL) || (b -> re == NULL) || (b -> im == NULL) ||
+	    (b -> bin == NULL) || (b -> rotCos == NULL) ||
+	    (b -> rotSin == NULL) || (b -> rotRe == NULL) ||
+	    (b -> rotIm == NULL) || (b -> out == NULL) ||
+	    (b -> bufI == NULL) || (b -> bufQ == NULL)) {
+	   bankFree (b);
+	   return NULL;
+	}
+//
+//	the prototype: Blackman windowed sinc, -6 dB at the edge
+//	of the bin
+	fc	= 1.0 / M;
+	for (i = 0; i < L; i ++) {
+	   double x	= i - (L - 1) / 2.0;
+	   double w	= 0.42 - 0.5  * cos (2 * M_PI * i / (L - 1)) +
+	                         0.08 * cos (4 * M_PI * i / (L - 1));
+	   double s	= x == 0 ? 2 * fc : sin (2 * M_PI * fc * x) / (M_PI * x);
+	   b -> proto [i] = s * w;
+	   sum += s * w;
+	}
+	for (i = 0; i < L; i ++)
+	   b -> proto [i] /= sum;
+//
+//	each channel takes the nearest bin, the phasor removes the rest
+	rate	= 2.0 * inputRate / M;
+	for (i = 0; i < channels; i ++) {
+	   long	m	= lround ((double)offsets [i] * M / inputRate);
+	   double residual	= offsets [i] - (double)m * inputRate / M;
+	   double phi	= -2 * M_PI * residual / rate;
+	   b -> bin [i]		= ((m % M) + M) % M;
+	   b -> rotCos [i]	= cos (phi);
+	   b -> rotSin [i]	= sin (phi);
+	   b -> rotRe [i]	= 1;
+	   b -> rotIm [i]	= 0;
+	}
+	b	-> next		= 0;
+	return b;
+}
+
+void	bankFree	(channelBank *b) {
+	if (b == NULL)
+	   return;
+	fftFree (&b -> fft);
+	free (b -> proto);
+	free (b -> re);
+	free (b -> im);
+	free (b -> bin);
+	free (b -> rotCos);
+	free (b -> rotSin);
+	free (b -> rotRe);
+	free (b -> rotIm);
+	free (b -> out);
+	free (b -> bufI);
+	free (b -> bufQ);
+	free (b);
+}
+//
+//	For bin m and an output at (input) time t:
+//	y_m (t) = exp (-j 2 pi m t / M) *
+//	              sum_k exp (j 2 pi m k / M) u_k (t), with
+//	u_k (t) = sum_p h [k + p M] x [t - k - p M],
+//	i.e. the branches of the polyphase filter, followed by an
+//	inverse FFT and a correction for the time of the output
+static
+void	bankOutput	(channelBank *b, uint64_t t) {
+int	M	= b -> bins;
+int	L	= M * BANK_TAPS;
+const float	*h	= b -> proto;
+//	x [t - l] is at bI [-l]
+const float	*bI	= b -> bufI + ((t - (L - 1)) & (L - 1)) + L - 1;
+const float	*bQ	= b -> bufQ + ((t - (L - 1)) & (L - 1)) + L - 1;
+int	tm	= t % M;
+int	k, p, c;
+
+	for (k = 0; k < M; k ++) {
+	   float sI	= 0;
+	   float sQ	= 0;
+	   for (p = 0; p < BANK_TAPS; p ++) {
+	      int l	= k + p * M;
+	      sI	+= h [l] * bI [-l];
+	      sQ	+= h [l] * bQ [-l];
+	   }
+	   b -> re [k]	= sI;
+	   b -> im [k]	= sQ;
+	}
+	fftInverse (&b -> fft, b -> re, b -> im);
+	for (c = 0; c < b -> channels; c ++) {
+	   int	m	= b -> bin [c];
+	   int	idx	= (int)(((int64_t)m * tm) % M);
+	   float	sgn	= idx >= M / 2 ? -1 : 1;
+	   float	fr	= sgn * b -> fft. cosTable [idx % (M / 2)];
+	   float	fi	= sgn * b -> fft. sinTable [idx % (M / 2)];
+	   float	vr	= b -> re [m] * fr - b -> im [m] * fi;
+	   float	vi	= b -> re [m] * fi + b -> im [m] * fr;
+	   float	rr	= b -> rotRe [c];
+	   float	ri	= b -> rotIm [c];
+	   float	*o	= b -> out + 2 * (c * BANK_BATCH + b -> fill);
+	   o [0]	= vr * rr - vi * ri;
+	   o [1]	= vr * ri + vi * rr;
+	   b -> rotRe [c]	= rr * b -> rotCos [c] - ri * b -> rotSin [c];
+	   b -> rotIm [c]	= rr * b -> rotSin [c] + ri * b -> rotCos [c];
+	}
+	if (++ b -> fill >= BANK_BATCH) {
+	   b -> callback (b -> out, BANK_BATCH, b -> channels, b -> ctx);
+	   b -> fill = 0;
+	}
+}
+//
+//	the input samples from up to to go into the ring, each one in
+//	both halves
+static
+void	bankInput	(channelBank *b,
+	                 const int16_t *xi, const int16_t *xq,
+	                 int from, int to) {
+int	L	= b -> bins * BANK_TAPS;
+int	i;
+
+	for (i = from; i < to; i ++) {
+	   int w	= (b -> time + i) & (L - 1);
+	   b -> bufI [w]	= b -> bufI [w + L]	= xi [i];
+	   b -> bufQ [w]	= b -> bufQ [w + L]	= xq [i];
+	}
+}
+//
+//	an output is computed as soon as its last sample is in the
+//	ring, so a call may bring more than a ring full
+void	bankProcess	(channelBank *b,
+	                 const int16_t *xi, const int16_t *xq, int n) {
+int	pos;
+int	i	= 0;
+
+	for (pos = b -> next; pos < n; pos += b -> decimation) {
+	   bankInput (b, xi, xq, i, pos + 1);
+	   i	= pos + 1;
+	   bankOutput (b, b -> time + pos);
+	}
+	bankInput (b, xi, xq, i, n);
+	b	-> next	= pos - n;
+	b	-> time	+= n;
+//	keep the phasors on the unit circle
+	for (i = 0; i < b -> channels; i ++) {
+	   float m	= sqrtf (b -> rotRe [i] * b -> rotRe [i] +
+	                         b -> rotIm [i] * b -> rotIm [i]);
+	   b -> rotRe [i]	/= m;
+	   b -> rotIm [i]	/= m;
+	}
+}
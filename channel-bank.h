@@ -0,0 +1,69 @@
+#
+/*
+ *    Copyright (C) 2018
+ *    Jan van Katwijk (J.vanKatwijk@gmail.com)
+ *    Lazy Chair Computing
+ *
+ *    This file is part of the sdrplayBridge.
+ *
+ *    rtlsdrBridge is available under GPL-V2
+ */
+#ifndef	__CHANNEL_BANK__
+#define	__CHANNEL_BANK__
+
+#include	<stdint.h>
+#include	<rtl-sdr_extensions.h>
+#include	"fft.h"
+
+//	A polyphase FFT filter bank, twice oversampled: the band is
+//	split into M bins, fs / M apart, each bin is output at a rate
+//	of 2 fs / M. M is the largest power of two for which a bin is
+//	at least twice the requested bandwidth, so a channel fits in
+//	its bin wherever it is. The prototype filter is flat over
+//	0.75 bin and has BANK_TAPS taps per branch.
+//	Only the bins that hold a channel are taken from the FFT,
+//	and the remaining offset of the channel is removed by a phasor.
+//	The output of all channels is collected and passed on with
+//	a single call per BANK_BATCH output samples.
+#define	BANK_TAPS	16
+#define	BANK_BATCH	256
+#define	BANK_MAX_BINS	4096
+
+typedef struct {
+	int	bins;			// M
+	int	decimation;		// M / 2
+	int	inputRate;
+	int	outputRate;
+	float	*proto;			// M * BANK_TAPS
+	fftPlan	fft;
+	float	*re;
+	float	*im;
+//	the last M * BANK_TAPS input samples, a ring stored twice,
+//	back to back, so the samples under the filter are contiguous
+//	wherever they start. M * BANK_TAPS is a power of two
+	int	next;			// in the input of the next call
+	float	*bufI;			// 2 * M * BANK_TAPS
+	float	*bufQ;
+	uint64_t	time;		// input samples before the call
+//	the channels
+	int	channels;
+	int	*bin;
+	float	*rotCos;
+	float	*rotSin;
+	float	*rotRe;
+	float	*rotIm;
+	float	*out;			// channels * BANK_BATCH * 2
+	int	fill;
+	rtlsdr_bank_cb_t	callback;
+	void	*ctx;
+} channelBank;
+
+channelBank	*bankCreate	(int inputRate,
+	                         const int32_t *offsets, int channels,
+	                         int bandwidth,
+	                         rtlsdr_bank_cb_t cb, void *ctx);
+void	bankFree	(channelBank *bank);
+void	bankProcess	(channelBank *bank,
+	                 const int16_t *xi, const int16_t *xq, int n);
+#endif
+
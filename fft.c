@@ -0,0 +1,103 @@
+#
+/*
+ *    Copyright (C) 2018
+ *    Jan van Katwijk (J.vanKatwijk@gmail.com)
+ *    Lazy Chair Computing
+ *
+ *    This file is part of the sdrplayBridge.
+ *
+ *    rtlsdrBridge is available under GPL-V2
+ */
+#include	"fft.h"
+#include	<stdlib.h>
+#include	<math.h>
+
+//	returns -1 if the size is not a power of two (or too large)
+int	fftInit	(fftPlan *plan, int size) {
+int	bits	= 0;
+int	i;
+
+	plan	-> cosTable	= NULL;
+	plan	-> sinTable	= NULL;
+	plan	-> reverse	= NULL;
+	if ((size < 2) || (size > FFT_MAX_SIZE) || ((size & (size - 1)) != 0))
+	   return -1;
+	while ((1 << bits) < size)
+	   bits ++;
+	plan	-> size		= size;
+	plan	-> cosTable	= (float *)malloc (size / 2 * sizeof (float));
+	plan	-> sinTable	= (float *)malloc (size / 2 * sizeof (float));
+	plan	-> reverse	= (int *)malloc (size * sizeof (int));
+	if ((plan -> cosTable == NULL) || (plan -> sinTable == NULL) ||
+	                                  (plan -> reverse == NULL)) {
+	   fftFree (plan);
+	   return -1;
+	}
+	for (i = 0; i < size / 2; i ++) {
+	   plan -> cosTable [i] = cos (2 * M_PI * i / size);
+	   plan -> sinTable [i] = -sin (2 * M_PI * i / size);
+	}
+	for (i = 0; i < size; i ++) {
+	   int r = 0;
+	   int b;
+	   for (b = 0; b < bits; b ++)
+	      if (i & (1 << b))
+	         r |= 1 << (bits - 1 - b);
+	   plan -> reverse [i] = r;
+	}
+	return 0;
+}
+
+void	fftFree	(fftPlan *plan) {
+	free (plan -> cosTable);
+	free (plan -> sinTable);
+	free (plan -> reverse);
+	plan	-> cosTable	= NULL;
+	plan	-> sinTable	= NULL;
+	plan	-> reverse	= NULL;
+}
+
+static
+void	transform	(fftPlan *plan, float *re, float *im, float sign) {
+int	n	= plan -> size;
+int	i, len;
+
+	for (i = 0; i < n; i ++) {
+	   int j = plan -> reverse [i];
+	   if (j > i) {
+	      float t;
+	      t = re [i]; re [i] = re [j]; re [j] = t;
+	      t = im [i]; im [i] = im [j]; im [j] = t;
+	   }
+	}
+	for (len = 2; len <= n; len <<= 1) {
+	   int	half	= len / 2;
+	   int	step	= n / len;
+	   int	start, k;
+	   for (start = 0; start < n; start += len) {
+	      for (k = 0; k < half; k ++) {
+	         float wr	= plan -> cosTable [k * step];
+	         float wi	= sign * plan -> sinTable [k * step];
+	         int	a	= start + k;
+	         int	b	= a + half;
+	         float tr	= re [b] * wr - im [b] * wi;
+	         float ti	= re [b] * wi + im [b] * wr;
+	         re [b]	= re [a] - tr;
+	         im [b]	= im [a] - ti;
+	         re [a]	+= tr;
+	         im [a]	+= ti;
+	      }
+	   }
+	}
+}
+//
+//	forward: exp (-j 2 pi k n / N), inverse: exp (+j ...), the
+//	inverse is not scaled
+void	fftForward	(fftPlan *plan, float *re, float *im) {
+	transform (plan, re, im, 1.0);
+}
+
+void	fftInverse	(fftPlan *plan, float *re, float *im) {
+	transform (plan, re, im, -1.0);
+}
+
@@ -0,0 +1,31 @@
+#
+/*
+ *    Copyright (C) 2018
+ *    Jan van Katwijk (J.vanKatwijk@gmail.com)
+ *    Lazy Chair Computing
+ *
+ *    This file is part of the sdrplayBridge.
+ *
+ *    rtlsdrBridge is available under GPL-V2
+ */
+#ifndef	__FFT__
+#define	__FFT__
+
+//	A plain radix-2 complex FFT, in place, on separate vectors
+//	for the real and imaginary parts. The twiddles and the bit
+//	reversal are computed once, in fftInit
+#define	FFT_MAX_SIZE	65536
+
+typedef struct {
+	int	size;
+	float	*cosTable;	// size / 2 entries
+	float	*sinTable;
+	int	*reverse;
+} fftPlan;
+
+int	fftInit		(fftPlan *plan, int size);
+void	fftFree		(fftPlan *plan);
+void	fftForward	(fftPlan *plan, float *re, float *im);
+void	fftInverse	(fftPlan *plan, float *re, float *im);
+#endif
+
@@ -1,6 +1,7 @@
 
 #include	"gains.h"
 #include	<stdio.h>
+#include	<stdbool.h>
 
 #define	KHz(x)	(x * 1000)
 #define	MHz(x)	(x * 1000000)
@@ -143,17 +144,122 @@ int	i;
 
 #endif
 
+int	gainBand	(int hw, int freq) {
+	if (hw == 3) {
+	   if (freq < MHz (60))
+	      return 0;
+	   if (freq < MHz (420))
+	      return 1;
+	   if (freq < MHz (1000))
+	      return 2;
+	   return 3;
+	}
+	if (freq < MHz (420))
+	   return 0;
+	if (freq < MHz (1000))
+	   return 1;
+	return 2;
+}
+
+static
+int	*lnaTable	(int hw, int freq) {
+	if (hw == 1)
+	   return RSP1_Table [gainBand (hw, freq)];
+	if (hw == 2)
+	   return RSP2_Table [gainBand (hw, freq)];
+	return RSP1A_Table [gainBand (hw, freq)];
+}
+//
+//	for the AGC: the number of lna states in the band and
+//	the gain reduction for a given state
+int	lnaStates	(int hw, int freq) {
+	return lnaTable (hw, freq) [0];
+}
+
+int	lnaReduction	(int hw, int freq, int state) {
+int	*table	= lnaTable (hw, freq);
+	if (state < 0)
+	   state = 0;
+	if (state >= table [0])
+	   state = table [0] - 1;
+	return table [state + 1];
+}
+
 #ifndef	__MINGW32__
-void    gainMapper (int hw, int f, int g, int *lna, int *grdb) {
+//
+//	The mapping is precomputed for each hardware version,
+//	each band and each gain step of 0.1 dB, a gain setting is
+//	then a matter of indexing. The frequency used for
+//	computing a row is just a frequency within the band
+static
+gainEntry	gainTables [3] [GAIN_BANDS] [GAIN_STEPS];
+static
+int	bandFrequencies [3] [GAIN_BANDS] = {
+	{MHz (100), MHz (500), MHz (1200), MHz (1200)},
+	{MHz (100), MHz (500), MHz (1200), MHz (1200)},
+	{MHz (30),  MHz (100), MHz (500),  MHz (1200)}
+};
+static
+bool	tablesReady	= false;
+
+static
+void	mapGain (int hw, int f, int g, int *lna, int *grdb) {
 int	gainReduction = 102 - g / 10;
+int	*lnaTable;
 
-	fprintf (stderr, "hw version is %d\n", hw);
-	if (hw == 1)
+	if (hw == 1) {
 	   gainMapper_RSP1 (f, gainReduction, lna, grdb);
-	else
+	   return;
+	}
+//
+//	with a gain reduction beyond the table, the mappers leave
+//	the values alone, we take the last lna state
+	lnaTable	= hw == 2 ? RSP2_Table [gainBand (hw, f)] :
+	                            RSP1A_Table [gainBand (hw, f)];
+	*lna	= lnaTable [0] - 1;
+	*grdb	= gainReduction - lnaTable [lnaTable [0]];
+	if (*grdb < 20)
+	   *grdb = 20;
+	if (*grdb > 59)
+	   *grdb = 59;
 	if (hw == 2)
 	   gainMapper_RSP2 (f, gainReduction, lna, grdb);
 	else
 	   gainMapper_RSP1a (f, gainReduction, lna, grdb);
 }
+
+void	gainTablesInit	(void) {
+int	hw, band, g;
+
+	if (tablesReady)
+	   return;
+	for (hw = 1; hw <= 3; hw ++)
+	   for (band = 0; band < GAIN_BANDS; band ++)
+	      for (g = 0; g < GAIN_STEPS; g ++) {
+	         int lna, grdb;
+	         mapGain (hw, bandFrequencies [hw - 1][band], g, &lna, &grdb);
+	         gainTables [hw - 1][band][g]. lnaState	= lna;
+	         gainTables [hw - 1][band][g]. GRdB	= grdb;
+	      }
+	tablesReady	= true;
+}
+
+const gainEntry	*gainRow	(int hw, int freq) {
+	if ((hw < 1) || (hw > 3))
+	   hw = 3;
+	gainTablesInit ();
+	return gainTables [hw - 1][gainBand (hw, freq)];
+}
+
+void    gainMapper (int hw, int f, int g, int *lna, int *grdb) {
+const gainEntry	*e;
+
+	if (g < 0)
+	   g = 0;
+	if (g >= GAIN_STEPS)
+	   g = GAIN_STEPS - 1;
+	e	= &gainRow (hw, f) [g];
+	*lna	= e -> lnaState;
+	*grdb	= e -> GRdB;
+}
 #endif
@@ -1,7 +1,25 @@
-
 #
+#ifndef	__GAINS__
+#define	__GAINS__
+
+#include	<stdint.h>
+
+//	gain steps of 0.1 dB, 0 .. 102 dB
+#define	GAIN_STEPS	1021
+#define	GAIN_BANDS	4
+
+typedef struct {
+	int8_t	lnaState;
+	int8_t	GRdB;
+} gainEntry;
+
 extern	void    gainMapper (int hw, int f, int g, int *lna, int *grdb);
+extern	void	gainTablesInit	(void);
+extern	int	gainBand	(int hw, int freq);
+extern	const gainEntry	*gainRow	(int hw, int freq);
+extern	int	lnaStates	(int hw, int freq);
+extern	int	lnaReduction	(int hw, int freq, int state);
 extern	int	*getTable_RSP1	(int freq);
 extern	int	*getTable_RSP2	(int freq);
 extern	int	*getTable_RSP1a (int freq);
-
+#endif
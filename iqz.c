@@ -0,0 +1,563 @@
+#
+/*
+ *    Copyright (C) 2018
+ *    Jan van Katwijk (J.vanKatwijk@gmail.com)
+ *    Lazy Chair Computing
+ *
+ *    This file is part of the sdrplayBridge.
+ *
+ *    rtlsdrBridge is available under GPL-V2
+ */
+#include	"iqz.h"
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<errno.h>
+#include	<fcntl.h>
+#include	<unistd.h>
+#include	<time.h>
+
+//	the largest coded block, a block that does not fit is
+//	stored as is
+#define	IQZ_OUT_SIZE	(4 * IQZ_BLOCK)
+
+typedef struct {
+	uint8_t	*p;
+	uint8_t	*end;
+	uint64_t acc;
+	int	bits;
+	bool	overflow;
+} bitWriter;
+
+static inline
+void	putBits		(bitWriter *w, uint32_t v, int n) {
+	w	-> acc	= (w -> acc << n) | v;
+	w	-> bits	+= n;
+	while (w -> bits >= 8) {
+	   if (w -> p >= w -> end) {
+	      w -> overflow	= true;
+	      w -> bits		= 0;
+	      return;
+	   }
+	   w -> bits	-= 8;
+	   *w -> p ++	= (uint8_t)(w -> acc >> w -> bits);
+	}
+}
+
+static
+void	flushBits	(bitWriter *w) {
+	if (w -> bits > 0)
+	   putBits (w, 0, 8 - w -> bits);
+}
+
+typedef struct {
+	const uint8_t	*p;
+	const uint8_t	*end;
+	uint64_t acc;
+	int	bits;
+} bitReader;
+
+static inline
+uint32_t	getBits		(bitReader *r, int n) {
+	while (r -> bits < n) {
+	   r -> acc	= (r -> acc << 8) | (r -> p < r -> end ? *r -> p ++ : 0);
+	   r -> bits	+= 8;
+	}
+	r	-> bits	-= n;
+	return (uint32_t)(r -> acc >> r -> bits) & ((1u << n) - 1);
+}
+//
+//	q ones and a zero, with IQZ_ESCAPE ones (and no zero) the
+//	value follows in 18 bits
+static
+void	encodeChannel	(bitWriter *w, const int16_t *x, int n) {
+uint32_t z [IQZ_SUB];
+int	prev	= x [0];
+int	i, j;
+
+	putBits (w, (uint16_t)x [0], 16);
+	for (i = 1; i < n; i += IQZ_SUB) {
+	   int	m	= n - i < IQZ_SUB ? n - i : IQZ_SUB;
+	   uint64_t sum	= 0;
+	   int	k	= 0;
+	   for (j = 0; j < m; j ++) {
+	      int32_t d	= x [i + j] - prev;
+	      prev	= x [i + j];
+	      z [j]	= ((uint32_t)d << 1) ^ (uint32_t)(d >> 31);
+	      sum	+= z [j];
+	   }
+	   while ((k < 16) && (((uint64_t)m << (k + 1)) <= sum))
+	      k ++;
+	   putBits (w, k, 5);
+	   for (j = 0; j < m; j ++) {
+	      uint32_t q = z [j] >> k;
+	      if (q < IQZ_ESCAPE) {
+	         putBits (w, (1u << (q + 1)) - 2, q + 1);
+	         if (k > 0)
+	            putBits (w, z [j] & ((1u << k) - 1), k);
+	      }
+	      else {
+	         putBits (w, (1u << IQZ_ESCAPE) - 1, IQZ_ESCAPE);
+	         putBits (w, z [j], 18);
+	      }
+	      if (w -> overflow)
+	         return;
+	   }
+	}
+}
+
+static
+void	decodeChannel	(bitReader *r, int16_t *x, int n) {
+int	prev;
+int	i, j;
+
+	x [0]	= (int16_t)getBits (r, 16);
+	prev	= x [0];
+	for (i = 1; i < n; i += IQZ_SUB) {
+	   int	m	= n - i < IQZ_SUB ? n - i : IQZ_SUB;
+	   int	k	= getBits (r, 5);
+	   for (j = 0; j < m; j ++) {
+	      uint32_t z;
+	      int	q	= 0;
+	      while ((q < IQZ_ESCAPE) && getBits (r, 1))
+	         q ++;
+	      if (q == IQZ_ESCAPE)
+	         z	= getBits (r, 18);
+	      else
+	         z	= ((uint32_t)q << k) | (k > 0 ? getBits (r, k) : 0);
+	      prev	+= (int32_t)(z >> 1) ^ -(int32_t)(z & 1);
+	      x [i + j]	= (int16_t)prev;
+	   }
+	}
+}
+
+static
+void	encodeSlot	(iqzSlot *s) {
+int	n	= s -> header. samples;
+bitWriter w	= {s -> out, s -> out + IQZ_OUT_SIZE, 0, 0, false};
+
+	encodeChannel (&w, s -> xi, n);
+	if (!w. overflow)
+	   encodeChannel (&w, s -> xq, n);
+	if (!w. overflow)
+	   flushBits (&w);
+	if (w. overflow || (w. p - s -> out >= 4 * n)) {
+	   memcpy (s -> out, s -> xi, n * sizeof (int16_t));
+	   memcpy (s -> out + 2 * n, s -> xq, n * sizeof (int16_t));
+	   s -> header. bytes	= 4 * n;
+	   s -> header. flags	= IQZ_RAW;
+	}
+	else {
+	   s -> header. bytes	= w. p - s -> out;
+	   s -> header. flags	= 0;
+	}
+}
+//
+//	a worker takes the next block that was handed over, a wakeup
+//	without a block is the signal to stop
+static
+void	*iqzWorker	(void *arg) {
+iqzWriter *w	= (iqzWriter *)arg;
+
+	while (true) {
+	   uint32_t b;
+	   sem_wait (&w -> work);
+	   b	= __atomic_fetch_add (&w -> taken, 1, __ATOMIC_ACQ_REL);
+	   if ((int32_t)(b - __atomic_load_n (&w -> filled,
+	                                         __ATOMIC_ACQUIRE)) >= 0)
+	      break;
+	   encodeSlot (&w -> slots [b % IQZ_SLOTS]);
+	   __atomic_store_n (&w -> slots [b % IQZ_SLOTS]. encoded, 1,
+	                                              __ATOMIC_RELEASE);
+	   sem_post (&w -> done);
+	}
+	return NULL;
+}
+
+static
+void	addIndex	(iqzWriter *w, iqzBlockHeader *h) {
+iqzIndexEntry *e;
+	if (w -> nIndex >= w -> indexSize) {
+	   int	size	= w -> indexSize > 0 ? 2 * w -> indexSize : 1024;
+	   iqzIndexEntry *n = realloc (w -> index, size * sizeof (*n));
+	   if (n == NULL)
+	      return;
+	   w -> index		= n;
+	   w -> indexSize	= size;
+	}
+	e	= &w -> index [w -> nIndex ++];
+	e	-> offset	= w -> offset;
+	e	-> firstSample	= h -> firstSample;
+	e	-> samples	= h -> samples;
+	e	-> frequency	= h -> frequency;
+	e	-> rate		= h -> rate;
+	e	-> gain		= h -> gain;
+}
+
+static
+bool	writeAll	(int fd, const void *data, size_t len) {
+const uint8_t *p	= (const uint8_t *)data;
+	while (len > 0) {
+	   ssize_t n = write (fd, p, len);
+	   if (n < 0) {
+	      if (errno == EINTR)
+	         continue;
+	      return false;
+	   }
+	   p	+= n;
+	   len	-= n;
+	}
+	return true;
+}
+//
+//	the blocks are written in the order they were handed over
+static
+void	*iqzWrite	(void *arg) {
+iqzWriter *w	= (iqzWriter *)arg;
+
+	while (true) {
+	   sem_wait (&w -> done);
+	   while (true) {
+	      uint32_t b	= w -> written;
+	      iqzSlot	*s	= &w -> slots [b % IQZ_SLOTS];
+	      if ((b == __atomic_load_n (&w -> filled, __ATOMIC_ACQUIRE)) ||
+	          !__atomic_load_n (&s -> encoded, __ATOMIC_ACQUIRE))
+	         break;
+	      if (!w -> failed) {
+	         if (!writeAll (w -> fd, &s -> header, sizeof (s -> header)) ||
+	             !writeAll (w -> fd, s -> out, s -> header. bytes)) {
+	            fprintf (stderr, "recording %s: %s\n",
+	                                  w -> name, strerror (errno));
+	            w -> failed	= true;
+	         }
+	         else {
+	            addIndex (w, &s -> header);
+	            w -> offset		+= sizeof (s -> header) +
+	                                              s -> header. bytes;
+	            w -> rawBytes	+= 4 * s -> header. samples;
+	         }
+	      }
+	      s -> encoded	= 0;
+	      __atomic_store_n (&w -> written, b + 1, __ATOMIC_RELEASE);
+	   }
+	   if (w -> stopping &&
+	       (w -> written == __atomic_load_n (&w -> filled, __ATOMIC_ACQUIRE)))
+	      break;
+	}
+	return NULL;
+}
+
+iqzWriter	*iqzCreate	(const char *name, const char *hw) {
+iqzWriter	*w	= (iqzWriter *)calloc (1, sizeof (iqzWriter));
+iqzFileHeader	header;
+time_t	now	= time (NULL);
+long	cores	= sysconf (_SC_NPROCESSORS_ONLN);
+int	i;
+
+	if (w == NULL)
+	   return NULL;
+	snprintf (w -> name, sizeof (w -> name), "%s", name);
+	for (i = 0; i < IQZ_SLOTS; i ++) {
+	   w -> slots [i]. xi	= (int16_t *)malloc (IQZ_BLOCK * sizeof (int16_t));
+	   w -> slots [i]. xq	= (int16_t *)malloc (IQZ_BLOCK * sizeof (int16_t));
+	   w -> slots [i]. out	= (uint8_t *)malloc (IQZ_OUT_SIZE);
+	   if ((w -> slots [i]. xi == NULL) || (w -> slots [i]. xq == NULL) ||
+	                                     (w -> slots [i]. out == NULL)) {
+	      w -> fd	= -1;
+	      iqzFinish (w);
+	      return NULL;
+	   }
+	}
+	w	-> fd	= open (name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (w -> fd < 0) {
+	   fprintf (stderr, "cannot create %s: %s\n", name, strerror (errno));
+	   iqzFinish (w);
+	   return NULL;
+	}
+	memset (&header, 0, sizeof (header));
+	memcpy (header. magic, "RIQZ", 4);
+	header. version		= IQZ_VERSION;
+	header. blockSize	= IQZ_BLOCK;
+	snprintf (header. hw, sizeof (header. hw), "%s", hw);
+	strftime (header. datetime, sizeof (header. datetime),
+	                       "%Y-%m-%dT%H:%M:%SZ", gmtime (&now));
+	if (!writeAll (w -> fd, &header, sizeof (header))) {
+	   close (w -> fd);
+	   w -> fd	= -1;
+	   iqzFinish (w);
+	   return NULL;
+	}
+	w	-> offset	= sizeof (header);
+	sem_init (&w -> work, 0, 0);
+	sem_init (&w -> done, 0, 0);
+//	one core is left for the stream itself
+	w	-> nWorkers	= cores > 2 ? cores - 1 : 1;
+	if (w -> nWorkers > IQZ_MAX_WORKERS)
+	   w -> nWorkers = IQZ_MAX_WORKERS;
+	for (i = 0; i < w -> nWorkers; i ++)
+	   if (pthread_create (&w -> workers [i], NULL, iqzWorker, w) != 0)
+	      break;
+	w	-> nWorkers	= i;
+	if ((w -> nWorkers == 0) ||
+	    (pthread_create (&w -> writer, NULL, iqzWrite, w) != 0)) {
+	   iqzFinish (w);
+	   return NULL;
+	}
+	w	-> writerUp	= true;
+	return w;
+}
+
+static
+void	handOver	(iqzWriter *w) {
+iqzSlot	*s	= &w -> slots [w -> filled % IQZ_SLOTS];
+	s	-> header. samples	= w -> fill;
+	w	-> fill		= 0;
+	__atomic_store_n (&w -> filled, w -> filled + 1, __ATOMIC_RELEASE);
+	sem_post (&w -> work);
+}
+//
+//	called in the callback thread, it never waits: without a
+//	free slot the samples are dropped
+void	iqzSamples	(iqzWriter *w,
+	                 const int16_t *xi, const int16_t *xq, int n,
+	                 int frequency, int rate, int gain) {
+	if (w -> started && (w -> fill > 0) &&
+	    ((frequency != w -> frequency) || (rate != w -> rate) ||
+	                                      (gain != w -> gain)))
+	   handOver (w);
+	w	-> started	= true;
+	w	-> frequency	= frequency;
+	w	-> rate		= rate;
+	w	-> gain		= gain;
+	while (n > 0) {
+	   iqzSlot *s	= &w -> slots [w -> filled % IQZ_SLOTS];
+	   int	k;
+	   if (w -> fill == 0) {
+	      if (w -> filled - __atomic_load_n (&w -> written,
+	                              __ATOMIC_ACQUIRE) >= IQZ_SLOTS) {
+	         w -> sampleIndex	+= n;
+	         w -> dropped		+= n;
+	         return;
+	      }
+	      memcpy (s -> header. magic, "IQZB", 4);
+	      s -> header. firstSample	= w -> sampleIndex;
+	      s -> header. frequency	= frequency;
+	      s -> header. rate		= rate;
+	      s -> header. gain		= gain;
+	      s -> header. reserved	= 0;
+	   }
+	   k	= IQZ_BLOCK - w -> fill;
+	   if (k > n)
+	      k = n;
+	   memcpy (s -> xi + w -> fill, xi, k * sizeof (int16_t));
+	   memcpy (s -> xq + w -> fill, xq, k * sizeof (int16_t));
+	   w -> fill		+= k;
+	   w -> sampleIndex	+= k;
+	   xi	+= k;
+	   xq	+= k;
+	   n	-= k;
+	   if (w -> fill >= IQZ_BLOCK)
+	      handOver (w);
+	}
+}
+//
+//	the callback should not use the writer anymore
+void	iqzFinish	(iqzWriter *w) {
+int	i;
+	if (w == NULL)
+	   return;
+	if (w -> writerUp) {
+	   if (w -> fill > 0)
+	      handOver (w);
+	   w -> stopping	= true;
+	   for (i = 0; i < w -> nWorkers; i ++)
+	      sem_post (&w -> work);
+	   for (i = 0; i < w -> nWorkers; i ++)
+	      pthread_join (w -> workers [i], NULL);
+	   sem_post (&w -> done);
+	   pthread_join (w -> writer, NULL);
+	}
+	else {
+	   w -> stopping	= true;
+	   for (i = 0; i < w -> nWorkers; i ++)
+	      sem_post (&w -> work);
+	   for (i = 0; i < w -> nWorkers; i ++)
+	      pthread_join (w -> workers [i], NULL);
+	}
+	if (w -> nWorkers > 0 || w -> writerUp) {
+	   sem_destroy (&w -> work);
+	   sem_destroy (&w -> done);
+	}
+	if (w -> fd >= 0) {
+	   iqzTrailer t;
+	   t. indexOffset	= w -> offset;
+	   t. blocks		= w -> nIndex;
+	   memcpy (t. magic, "IQZX", 4);
+	   if (w -> failed ||
+	       !writeAll (w -> fd, w -> index,
+	                           w -> nIndex * sizeof (iqzIndexEntry)) ||
+	       !writeAll (w -> fd, &t, sizeof (t)))
+	      fprintf (stderr, "recording %s: no index written\n", w -> name);
+	   close (w -> fd);
+	   fprintf (stderr, "recorded %llu samples in %s, %llu bytes (%.1f%%)",
+	                    (unsigned long long)(w -> sampleIndex - w -> dropped),
+	                    w -> name, (unsigned long long)w -> offset,
+	                    w -> rawBytes > 0 ?
+	                        100.0 * w -> offset / w -> rawBytes : 0.0);
+	   if (w -> dropped > 0)
+	      fprintf (stderr, ", %llu dropped",
+	                        (unsigned long long)w -> dropped);
+	   fprintf (stderr, "\n");
+	}
+	for (i = 0; i < IQZ_SLOTS; i ++) {
+	   free (w -> slots [i]. xi);
+	   free (w -> slots [i]. xq);
+	   free (w -> slots [i]. out);
+	}
+	free (w -> index);
+	free (w);
+}
+//
+//	reading: the index from the end of the file or, if that is
+//	not there, from the block headers
+static
+bool	readAt		(int fd, void *p, size_t len, uint64_t offset) {
+	return pread (fd, p, len, (off_t)offset) == (ssize_t)len;
+}
+
+static
+bool	scanBlocks	(iqzReader *r) {
+uint64_t offset	= sizeof (iqzFileHeader);
+int	size	= 0;
+iqzBlockHeader h;
+
+	r	-> blocks	= 0;
+	while (readAt (r -> fd, &h, sizeof (h), offset) &&
+	       (memcmp (h. magic, "IQZB", 4) == 0) &&
+	       (h. samples <= r -> header. blockSize)) {
+	   iqzIndexEntry *e;
+	   if (r -> blocks >= size) {
+	      iqzIndexEntry *n;
+	      size	= size > 0 ? 2 * size : 1024;
+	      n		= realloc (r -> index, size * sizeof (*n));
+	      if (n == NULL)
+	         return false;
+	      r -> index	= n;
+	   }
+	   e	= &r -> index [r -> blocks ++];
+	   e	-> offset	= offset;
+	   e	-> firstSample	= h. firstSample;
+	   e	-> samples	= h. samples;
+	   e	-> frequency	= h. frequency;
+	   e	-> rate		= h. rate;
+	   e	-> gain		= h. gain;
+	   offset	+= sizeof (h) + h. bytes;
+	}
+	return true;
+}
+
+iqzReader	*iqzOpen	(const char *name) {
+iqzReader *r	= (iqzReader *)calloc (1, sizeof (iqzReader));
+iqzTrailer t;
+off_t	end;
+
+	if (r == NULL)
+	   return NULL;
+	r	-> fd	= open (name, O_RDONLY);
+	if ((r -> fd < 0) ||
+	    !readAt (r -> fd, &r -> header, sizeof (r -> header), 0) ||
+	    (memcmp (r -> header. magic, "RIQZ", 4) != 0) ||
+	    (r -> header. version != IQZ_VERSION) ||
+	    (r -> header. blockSize == 0) ||
+	    (r -> header. blockSize > IQZ_BLOCK)) {
+	   iqzClose (r);
+	   return NULL;
+	}
+	end	= lseek (r -> fd, 0, SEEK_END);
+	if ((end >= (off_t)sizeof (t)) &&
+	    readAt (r -> fd, &t, sizeof (t), end - sizeof (t)) &&
+	    (memcmp (t. magic, "IQZX", 4) == 0) &&
+	    (t. indexOffset + (uint64_t)t. blocks * sizeof (iqzIndexEntry) +
+	                               sizeof (t) == (uint64_t)end)) {
+	   r -> index	= malloc ((t. blocks + 1) * sizeof (iqzIndexEntry));
+	   r -> blocks	= t. blocks;
+	   if ((r -> index == NULL) ||
+	       !readAt (r -> fd, r -> index,
+	                t. blocks * sizeof (iqzIndexEntry), t. indexOffset)) {
+	      iqzClose (r);
+	      return NULL;
+	   }
+	}
+	else
+	if (!scanBlocks (r)) {
+	   iqzClose (r);
+	   return NULL;
+	}
+	r	-> buffer	= malloc (sizeof (iqzBlockHeader) + IQZ_OUT_SIZE);
+	if (r -> buffer == NULL) {
+	   iqzClose (r);
+	   return NULL;
+	}
+	return r;
+}
+
+void	iqzClose	(iqzReader *r) {
+	if (r == NULL)
+	   return;
+	if (r -> fd >= 0)
+	   close (r -> fd);
+	free (r -> index);
+	free (r -> buffer);
+	free (r);
+}
+//
+//	the block containing the sample (or the first one after it,
+//	in a gap), -1 if beyond the end
+int	iqzFind		(iqzReader *r, uint64_t sample) {
+int	lo	= 0;
+int	hi	= r -> blocks;
+	while (lo < hi) {
+	   int mid	= (lo + hi) / 2;
+	   if (r -> index [mid]. firstSample + r -> index [mid]. samples <=
+	                                                          sample)
+	      lo = mid + 1;
+	   else
+	      hi = mid;
+	}
+	return lo < r -> blocks ? lo : -1;
+}
+//
+//	returns the number of samples, xi and xq should hold the
+//	blockSize of the file
+int	iqzRead		(iqzReader *r, int block, int16_t *xi, int16_t *xq) {
+iqzBlockHeader	*h	= (iqzBlockHeader *)r -> buffer;
+uint8_t	*data	= r -> buffer + sizeof (iqzBlockHeader);
+bitReader	b;
+int	n;
+
+	if ((block < 0) || (block >= r -> blocks))
+	   return -1;
+	if (!readAt (r -> fd, h, sizeof (*h), r -> index [block]. offset) ||
+	    (memcmp (h -> magic, "IQZB", 4) != 0) ||
+	    (h -> samples > r -> header. blockSize) ||
+	    (h -> bytes > IQZ_OUT_SIZE) ||
+	    !readAt (r -> fd, data, h -> bytes,
+	             r -> index [block]. offset + sizeof (*h)))
+	   return -1;
+	n	= h -> samples;
+	if (h -> flags & IQZ_RAW) {
+	   memcpy (xi, data, n * sizeof (int16_t));
+	   memcpy (xq, data + 2 * n, n * sizeof (int16_t));
+	   return n;
+	}
+	b. p	= data;
+	b. end	= data + h -> bytes;
+	b. acc	= 0;
+	b. bits	= 0;
+	if (n > 0) {
+	   decodeChannel (&b, xi, n);
+	   decodeChannel (&b, xq, n);
+	}
+	return n;
+}
+
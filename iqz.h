@@ -0,0 +1,135 @@
+#
+/*
+ *    Copyright (C) 2018
+ *    Jan van Katwijk (J.vanKatwijk@gmail.com)
+ *    Lazy Chair Computing
+ *
+ *    This file is part of the sdrplayBridge.
+ *
+ *    rtlsdrBridge is available under GPL-V2
+ */
+#ifndef	__IQZ__
+#define	__IQZ__
+
+#include	<stdint.h>
+#include	<stdbool.h>
+#include	<pthread.h>
+#include	<semaphore.h>
+
+//	Lossless compressed 16 bit I/Q recordings.
+//	The stream is cut in independent blocks of at most IQZ_BLOCK
+//	samples, a new block starts as well when frequency, rate or gain
+//	change. Per block I and Q are coded separately: the first value
+//	as is, then the differences, zigzag mapped and Rice coded with
+//	a parameter chosen per IQZ_SUB values. With 12 - 14 significant
+//	bits the differences are small, a block that does not get smaller
+//	is stored as is.
+//	The blocks are encoded by a pool of workers and written in order
+//	by a writer thread, each block has a header, an index of the
+//	blocks is appended when the recording is closed. Without an index
+//	- e.g. after a crash - the reader scans the block headers.
+//	All numbers are little endian.
+#define	IQZ_BLOCK		65536
+#define	IQZ_SUB			256
+#define	IQZ_ESCAPE		24
+#define	IQZ_SLOTS		64
+#define	IQZ_MAX_WORKERS		8
+#define	IQZ_VERSION		1
+//	block flags
+#define	IQZ_RAW			1
+
+typedef struct {
+	char		magic [4];	// "RIQZ"
+	uint32_t	version;
+	uint32_t	blockSize;
+	uint32_t	reserved;
+	char		hw [64];
+	char		datetime [32];
+} iqzFileHeader;
+
+typedef struct {
+	char		magic [4];	// "IQZB"
+	uint32_t	bytes;		// of the coded data
+	uint32_t	samples;
+	uint32_t	flags;
+	uint64_t	firstSample;	// dropped samples are counted
+	int32_t		frequency;
+	int32_t		rate;
+	int32_t		gain;		// tenth dB
+	int32_t		reserved;
+} iqzBlockHeader;
+
+typedef struct {
+	uint64_t	offset;		// of the block header
+	uint64_t	firstSample;
+	uint32_t	samples;
+	int32_t		frequency;
+	int32_t		rate;
+	int32_t		gain;
+} iqzIndexEntry;
+
+typedef struct {
+	uint64_t	indexOffset;
+	uint32_t	blocks;
+	char		magic [4];	// "IQZX"
+} iqzTrailer;
+
+typedef struct {
+	int16_t		*xi;
+	int16_t		*xq;
+	iqzBlockHeader	header;
+	uint8_t		*out;
+	volatile int	encoded;
+} iqzSlot;
+
+typedef struct {
+	int	fd;
+	char	name [256];
+	iqzSlot	slots [IQZ_SLOTS];
+//	blocks handed over, taken by a worker, written
+	volatile uint32_t	filled;
+	volatile uint32_t	taken;
+	volatile uint32_t	written;
+	sem_t	work;
+	sem_t	done;
+	pthread_t	workers [IQZ_MAX_WORKERS];
+	int	nWorkers;
+	pthread_t	writer;
+	bool	writerUp;
+	volatile bool	stopping;
+	bool	failed;
+	uint64_t	offset;
+	uint64_t	rawBytes;
+	iqzIndexEntry	*index;
+	int	nIndex;
+	int	indexSize;
+//	written by the callback thread
+	int	fill;
+	uint64_t	sampleIndex;
+	uint64_t	dropped;
+	bool	started;
+	int32_t	frequency;
+	int32_t	rate;
+	int32_t	gain;
+} iqzWriter;
+
+typedef struct {
+	int	fd;
+	iqzFileHeader	header;
+	iqzIndexEntry	*index;
+	int	blocks;
+	uint8_t	*buffer;
+} iqzReader;
+
+iqzWriter	*iqzCreate	(const char *name, const char *hw);
+void	iqzFinish	(iqzWriter *w);
+void	iqzSamples	(iqzWriter *w,
+	                 const int16_t *xi, const int16_t *xq, int n,
+	                 int frequency, int rate, int gain);
+
+iqzReader	*iqzOpen	(const char *name);
+void	iqzClose	(iqzReader *r);
+int	iqzFind		(iqzReader *r, uint64_t sample);
+int	iqzRead		(iqzReader *r, int block, int16_t *xi, int16_t *xq);
+#endif
+
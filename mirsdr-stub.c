@@ -0,0 +1,605 @@
+#
+/*
+ *    Copyright (C) 2018
+ *    Jan van Katwijk (J.vanKatwijk@gmail.com)
+ *    Lazy Chair Computing
+ *
+ *    This file is part of the sdrplayBridge.
+ *
+ *    A stand in for libmirsdrapi-rsp, for testing the bridge
+ *    without an SDRplay: the functions the bridge uses, a stream
+ *    of synthetic samples and injected faults.
+ *
+ *    rtlsdrBridge is available under GPL-V2
+ */
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<stdint.h>
+#include	<stdbool.h>
+#include	<string.h>
+#include	<math.h>
+#include	<unistd.h>
+#include	<pthread.h>
+#include	<time.h>
+#include	"mirsdrapi-rsp.h"
+
+//	Everything is set in the environment:
+//	MIRSDR_STUB_DEVICES	hardware versions, e.g. "255,3" for an
+//				RSP1A and an RSPduo (default 255)
+//	MIRSDR_STUB_SIGNAL	"tone:frequency:dBFS" and "noise:dBFS",
+//				comma separated, the frequency in Hz,
+//				the levels at the reference gain
+//				reduction (default noise:-40)
+//	MIRSDR_STUB_SPEED	"max" for no pacing
+//	MIRSDR_STUB_PACKET	samples per packet (default 252)
+//	MIRSDR_STUB_QUEUE	packets that can wait for the callback,
+//				a callback falling further behind loses
+//				packets, as with the USB transfers
+//	MIRSDR_STUB_SETTLE	packets before a change is in effect
+//	MIRSDR_STUB_JITTER	maximum random delay of a packet, usec
+//	MIRSDR_STUB_GAP		every N packets a packet goes missing
+//	MIRSDR_STUB_RESET	every N packets a packet with reset set
+//	MIRSDR_STUB_REMOVE	after N packets, hwRemoved and no more
+//	MIRSDR_STUB_REINIT_MS	duration of a Reinit
+//	MIRSDR_STUB_FAIL	"Function:N[:error]", comma separated:
+//				the N-th call of the function fails
+//				(default error mir_sdr_Fail)
+#define	STUB_MAX_DEVICES	4
+#define	STUB_MAX_TONES		8
+#define	STUB_MAX_FAULTS		16
+#define	STUB_PACKET		252
+#define	STUB_QUEUE		64
+#define	STUB_SETTLE		2
+//	the levels of the signals are given at this gain reduction,
+//	each step of the lna state counts as 6 dB
+#define	STUB_REF_GR		40
+#define	STUB_LNA_STEP		6
+
+typedef struct {
+	double	frequency;
+	double	amplitude;
+	double	phase;
+} stubTone;
+
+typedef struct {
+	char	name [32];
+	int	call;
+	int	error;
+	int	calls;
+} stubFault;
+
+typedef struct {
+	bool	initialised;
+	mir_sdr_DeviceT	devices [STUB_MAX_DEVICES];
+	char	serials [STUB_MAX_DEVICES][16];
+	char	names [STUB_MAX_DEVICES][16];
+	int	nDevices;
+	int	selected;
+	stubTone	tones [STUB_MAX_TONES];
+	int	nTones;
+	double	noise;
+	bool	maxSpeed;
+	int	packet;
+	int	queue;
+	int	settle;
+	int	jitter;
+	int	gapEvery;
+	int	resetEvery;
+	int	removeAfter;
+	int	reinitMs;
+	stubFault	faults [STUB_MAX_FAULTS];
+	int	nFaults;
+//	the stream
+	pthread_mutex_t	lock;
+	pthread_t	thread;
+	volatile bool	running;
+	mir_sdr_StreamCallback_t	streamCb;
+	mir_sdr_GainChangeCallback_t	gainCb;
+	void	*ctx;
+	double	rate;
+	double	frequency;
+	int	gRdB;
+	int	lnaState;
+//	changes wait settle packets before they are in effect
+	double	nextRate;
+	double	nextFrequency;
+	int	nextGRdB;
+	int	nextLna;
+	int	pending;		// mir_sdr_CHANGE_ bits
+	bool	pendingReset;
+	uint64_t	applyAt;
+	uint32_t	randomState;
+	uint64_t	packets;
+	uint64_t	dropped;
+	double	cbMax;
+	double	cbTotal;
+} stubState;
+
+static
+stubState	stub	= {.initialised = false,
+	                   .lock = PTHREAD_MUTEX_INITIALIZER};
+
+static
+int	envInt		(const char *name, int deflt) {
+const char *s	= getenv (name);
+	return s != NULL ? atoi (s) : deflt;
+}
+
+static
+void	parseSignal	(const char *s) {
+char	buffer [512];
+char	*item, *save;
+
+	snprintf (buffer, sizeof (buffer), "%s", s);
+	for (item = strtok_r (buffer, ",", &save); item != NULL;
+	                         item = strtok_r (NULL, ",", &save)) {
+	   double f, level;
+	   if ((sscanf (item, "tone:%lf:%lf", &f, &level) == 2) &&
+	                             (stub. nTones < STUB_MAX_TONES)) {
+	      stub. tones [stub. nTones]. frequency	= f;
+	      stub. tones [stub. nTones]. amplitude	= pow (10, level / 20);
+	      stub. tones [stub. nTones]. phase		= 0;
+	      stub. nTones ++;
+	   }
+	   else
+	   if (sscanf (item, "noise:%lf", &level) == 1)
+	      stub. noise	= pow (10, level / 20);
+	   else
+	      fprintf (stderr, "stub: %s not understood\n", item);
+	}
+}
+
+static
+void	parseFaults	(const char *s) {
+char	buffer [512];
+char	*item, *save;
+
+	snprintf (buffer, sizeof (buffer), "%s", s);
+	for (item = strtok_r (buffer, ",", &save); item != NULL;
+	                         item = strtok_r (NULL, ",", &save)) {
+	   stubFault *f	= &stub. faults [stub. nFaults];
+	   f -> error	= mir_sdr_Fail;
+	   f -> calls	= 0;
+	   if ((stub. nFaults < STUB_MAX_FAULTS) &&
+	       (sscanf (item, "%31[^:]:%d:%d",
+	                       f -> name, &f -> call, &f -> error) >= 2))
+	      stub. nFaults ++;
+	   else
+	      fprintf (stderr, "stub: %s not understood\n", item);
+	}
+}
+
+static
+void	stubInit	(void) {
+const char *s;
+char	buffer [128];
+char	*item, *save;
+
+	if (stub. initialised)
+	   return;
+	stub. initialised	= true;
+	stub. selected		= -1;
+	s	= getenv ("MIRSDR_STUB_DEVICES");
+	snprintf (buffer, sizeof (buffer), "%s", s != NULL ? s : "255");
+	for (item = strtok_r (buffer, ",", &save);
+	     (item != NULL) && (stub. nDevices < STUB_MAX_DEVICES);
+	     item = strtok_r (NULL, ",", &save)) {
+	   int i	= stub. nDevices ++;
+	   int hw	= atoi (item);
+	   snprintf (stub. serials [i], sizeof (stub. serials [i]),
+	                                              "STUB%04d", i);
+	   snprintf (stub. names [i], sizeof (stub. names [i]), "%s",
+	                 hw == 1 ? "RSP1" : hw == 2 ? "RSP2" :
+	                 hw == 3 ? "RSPduo" : "RSP1A");
+	   stub. devices [i]. SerNo	= stub. serials [i];
+	   stub. devices [i]. DevNm	= stub. names [i];
+	   stub. devices [i]. hwVer	= hw;
+	   stub. devices [i]. devAvail	= 1;
+	}
+	stub. noise	= pow (10, -40.0 / 20);
+	if ((s = getenv ("MIRSDR_STUB_SIGNAL")) != NULL) {
+	   stub. noise	= 0;
+	   parseSignal (s);
+	}
+	if ((s = getenv ("MIRSDR_STUB_FAIL")) != NULL)
+	   parseFaults (s);
+	s	= getenv ("MIRSDR_STUB_SPEED");
+	stub. maxSpeed	= (s != NULL) && (strcmp (s, "max") == 0);
+	stub. packet	= envInt ("MIRSDR_STUB_PACKET", STUB_PACKET);
+	if ((stub. packet < 1) || (stub. packet > 8192))
+	   stub. packet = STUB_PACKET;
+	stub. queue	= envInt ("MIRSDR_STUB_QUEUE", STUB_QUEUE);
+	stub. settle	= envInt ("MIRSDR_STUB_SETTLE", STUB_SETTLE);
+	stub. jitter	= envInt ("MIRSDR_STUB_JITTER", 0);
+	stub. gapEvery	= envInt ("MIRSDR_STUB_GAP", 0);
+	stub. resetEvery	= envInt ("MIRSDR_STUB_RESET", 0);
+	stub. removeAfter	= envInt ("MIRSDR_STUB_REMOVE", 0);
+	stub. reinitMs	= envInt ("MIRSDR_STUB_REINIT_MS", 0);
+	stub. randomState	= 0x12345678;
+}
+//
+//	the injected error for this call, or mir_sdr_Success
+static
+mir_sdr_ErrT	fault		(const char *name) {
+int	i;
+	stubInit ();
+	for (i = 0; i < stub. nFaults; i ++)
+	   if (strcmp (stub. faults [i]. name, name) == 0 &&
+	       ++ stub. faults [i]. calls == stub. faults [i]. call) {
+	      fprintf (stderr, "stub: call %d of %s fails\n",
+	                                    stub. faults [i]. call, name);
+	      return (mir_sdr_ErrT)stub. faults [i]. error;
+	   }
+	return mir_sdr_Success;
+}
+
+static
+uint32_t	nextRandom	(void) {
+uint32_t x	= stub. randomState;
+	x	^= x << 13;
+	x	^= x >> 17;
+	x	^= x << 5;
+	stub. randomState = x;
+	return x;
+}
+//
+//	roughly gaussian, the sum of four uniform values
+static
+double	gaussian	(void) {
+	return ((double)(nextRandom () & 0xFFFF) +
+	        (double)(nextRandom () & 0xFFFF) +
+	        (double)(nextRandom () & 0xFFFF) +
+	        (double)(nextRandom () & 0xFFFF) - 2 * 65535.0) /
+	                                       (65535.0 * 0.577);
+}
+
+static
+int	fullScale	(void) {
+int	hw	= stub. devices [stub. selected < 0 ? 0 :
+	                                         stub. selected]. hwVer;
+	return (hw == 1) || (hw == 2) ? 2048 : 8192;
+}
+
+static
+void	generate	(int16_t *xi, int16_t *xq, int n) {
+double	scale	= fullScale () *
+	          pow (10, -(stub. gRdB - STUB_REF_GR +
+	                     STUB_LNA_STEP * stub. lnaState) / 20.0);
+int	limit	= fullScale () - 1;
+int	i, t;
+
+	for (i = 0; i < n; i ++) {
+	   double vi	= stub. noise * gaussian () * M_SQRT1_2;
+	   double vq	= stub. noise * gaussian () * M_SQRT1_2;
+	   for (t = 0; t < stub. nTones; t ++) {
+	      vi	+= stub. tones [t]. amplitude * cos (stub. tones [t]. phase);
+	      vq	+= stub. tones [t]. amplitude * sin (stub. tones [t]. phase);
+	   }
+	   vi	*= scale;
+	   vq	*= scale;
+	   xi [i]	= vi > limit ? limit : vi < -limit ? -limit : (int16_t)vi;
+	   xq [i]	= vq > limit ? limit : vq < -limit ? -limit : (int16_t)vq;
+	   for (t = 0; t < stub. nTones; t ++) {
+	      stub. tones [t]. phase +=
+	                  2 * M_PI * (stub. tones [t]. frequency -
+	                                 stub. frequency) / stub. rate;
+	      if (stub. tones [t]. phase > M_PI)
+	         stub. tones [t]. phase -= 2 * M_PI;
+	      else
+	      if (stub. tones [t]. phase < -M_PI)
+	         stub. tones [t]. phase += 2 * M_PI;
+	   }
+	}
+}
+
+static
+double	secondsSince	(const struct timespec *t) {
+struct timespec now;
+	clock_gettime (CLOCK_MONOTONIC, &now);
+	return (now. tv_sec - t -> tv_sec) +
+	       (now. tv_nsec - t -> tv_nsec) / 1e9;
+}
+
+static
+void	*stubThread	(void *arg) {
+int16_t	*xi	= malloc (stub. packet * sizeof (int16_t));
+int16_t	*xq	= malloc (stub. packet * sizeof (int16_t));
+uint32_t sampleNum	= 0;
+uint64_t due		= 0;
+struct timespec start;
+bool	removed	= false;
+	(void)arg;
+	clock_gettime (CLOCK_MONOTONIC, &start);
+	while (stub. running && !removed) {
+	   int grChanged	= 0;
+	   int rfChanged	= 0;
+	   int fsChanged	= 0;
+	   unsigned int reset	= 0;
+	   struct timespec t0;
+	   double	usec;
+//
+//	pacing, the packets that are due and do not fit in the queue
+//	are lost
+	   if (!stub. maxSpeed) {
+	      double at	= (double)due * stub. packet / stub. rate;
+	      double now	= secondsSince (&start);
+//	the jitter delays a packet, not the stream
+	      if (stub. jitter > 0)
+	         at	+= (nextRandom () % stub. jitter) / 1e6;
+	      if (at > now)
+	         usleep ((at - now) * 1e6);
+	      else {
+	         int64_t behind = (int64_t)(now * stub. rate / stub. packet) -
+	                                                        (int64_t)due;
+	         if (behind > stub. queue) {
+	            stub. dropped	+= behind - stub. queue;
+	            sampleNum	+= (behind - stub. queue) * stub. packet;
+	            due		+= behind - stub. queue;
+	         }
+	      }
+	   }
+	   pthread_mutex_lock (&stub. lock);
+	   if (stub. pending && (stub. packets >= stub. applyAt)) {
+	      if (stub. pending & mir_sdr_CHANGE_RF_FREQ) {
+	         stub. frequency	= stub. nextFrequency;
+	         rfChanged	= 1;
+	      }
+	      if (stub. pending & mir_sdr_CHANGE_FS_FREQ) {
+	         stub. rate	= stub. nextRate;
+	         fsChanged	= 1;
+//	the pacing starts over at the new rate
+	         clock_gettime (CLOCK_MONOTONIC, &start);
+	         due	= 0;
+	      }
+	      if (stub. pending & mir_sdr_CHANGE_GR) {
+	         stub. gRdB	= stub. nextGRdB;
+	         stub. lnaState	= stub. nextLna;
+	         grChanged	= 1;
+	      }
+	      reset		= stub. pendingReset;
+	      stub. pending	= 0;
+	      stub. pendingReset	= false;
+	   }
+	   generate (xi, xq, stub. packet);
+	   pthread_mutex_unlock (&stub. lock);
+
+	   stub. packets ++;
+	   due ++;
+	   if ((stub. gapEvery > 0) && (stub. packets % stub. gapEvery == 0))
+	      sampleNum	+= stub. packet;
+	   if ((stub. resetEvery > 0) && (stub. packets % stub. resetEvery == 0))
+	      reset	= 1;
+	   if ((stub. removeAfter > 0) &&
+	                        (stub. packets >= (uint64_t)stub. removeAfter))
+	      removed	= true;
+	   if (grChanged && (stub. gainCb != NULL))
+	      stub. gainCb (stub. gRdB, STUB_LNA_STEP * stub. lnaState,
+	                                                 stub. ctx);
+	   clock_gettime (CLOCK_MONOTONIC, &t0);
+	   stub. streamCb (xi, xq, sampleNum, grChanged, rfChanged,
+	                   fsChanged, stub. packet, reset,
+	                   removed ? 1 : 0, stub. ctx);
+	   usec	= secondsSince (&t0) * 1e6;
+	   stub. cbTotal	+= usec;
+	   if (usec > stub. cbMax)
+	      stub. cbMax	= usec;
+	   sampleNum	+= stub. packet;
+	}
+	free (xi);
+	free (xq);
+	return NULL;
+}
+
+mir_sdr_ErrT	mir_sdr_ApiVersion	(float *version) {
+	stubInit ();
+	*version	= 2.13;
+	return mir_sdr_Success;
+}
+
+mir_sdr_ErrT	mir_sdr_GetDevices	(mir_sdr_DeviceT *devices,
+	                                 unsigned int *numDevs,
+	                                 unsigned int maxDevs) {
+mir_sdr_ErrT err	= fault ("GetDevices");
+unsigned int i;
+	if (err != mir_sdr_Success)
+	   return err;
+	for (i = 0; (i < (unsigned int)stub. nDevices) && (i < maxDevs); i ++)
+	   devices [i]	= stub. devices [i];
+	*numDevs	= i;
+	return mir_sdr_Success;
+}
+
+mir_sdr_ErrT	mir_sdr_SetDeviceIdx	(unsigned int idx) {
+mir_sdr_ErrT err	= fault ("SetDeviceIdx");
+	if (err != mir_sdr_Success)
+	   return err;
+	if (idx >= (unsigned int)stub. nDevices)
+	   return mir_sdr_InvalidParam;
+	if (stub. selected >= 0)
+	   return mir_sdr_AlreadyInitialised;
+	stub. selected	= idx;
+	return mir_sdr_Success;
+}
+
+mir_sdr_ErrT	mir_sdr_ReleaseDeviceIdx	(void) {
+mir_sdr_ErrT err	= fault ("ReleaseDeviceIdx");
+	if (err != mir_sdr_Success)
+	   return err;
+	stub. selected	= -1;
+	return mir_sdr_Success;
+}
+
+mir_sdr_ErrT	mir_sdr_rspDuo_TunerSel	(mir_sdr_rspDuo_TunerSelT sel) {
+mir_sdr_ErrT err	= fault ("rspDuo_TunerSel");
+	(void)sel;
+	if (err != mir_sdr_Success)
+	   return err;
+	if ((stub. selected < 0) ||
+	    (stub. devices [stub. selected]. hwVer != 3))
+	   return mir_sdr_InvalidParam;
+	return mir_sdr_Success;
+}
+
+mir_sdr_ErrT	mir_sdr_StreamInit	(int *gRdB, double fsMHz,
+	                                 double rfMHz,
+	                                 mir_sdr_Bw_MHzT bwType,
+	                                 mir_sdr_If_kHzT ifType,
+	                                 int LNAstate, int *gRdBsystem,
+	                                 mir_sdr_SetGrModeT setGrMode,
+	                                 int *samplesPerPacket,
+	                                 mir_sdr_StreamCallback_t StreamCbFn,
+	                                 mir_sdr_GainChangeCallback_t GainChangeCbFn,
+	                                 void *cbContext) {
+mir_sdr_ErrT err	= fault ("StreamInit");
+	(void)bwType;
+	(void)ifType;
+	(void)setGrMode;
+	if (err != mir_sdr_Success)
+	   return err;
+	if (stub. running)
+	   return mir_sdr_AlreadyInitialised;
+	if ((fsMHz < 2) || (fsMHz > 10.66))
+	   return mir_sdr_OutOfRange;
+	stub. rate	= fsMHz * 1e6;
+	stub. frequency	= rfMHz * 1e6;
+	stub. gRdB	= *gRdB;
+	stub. lnaState	= LNAstate;
+	stub. pending	= 0;
+	stub. streamCb	= StreamCbFn;
+	stub. gainCb	= GainChangeCbFn;
+	stub. ctx	= cbContext;
+	stub. packets	= 0;
+	stub. dropped	= 0;
+	stub. cbMax	= 0;
+	stub. cbTotal	= 0;
+	*gRdBsystem	= *gRdB + STUB_LNA_STEP * LNAstate;
+	*samplesPerPacket	= stub. packet;
+	stub. running	= true;
+	if (pthread_create (&stub. thread, NULL, stubThread, NULL) != 0) {
+	   stub. running	= false;
+	   return mir_sdr_Fail;
+	}
+	return mir_sdr_Success;
+}
+
+mir_sdr_ErrT	mir_sdr_StreamUninit	(void) {
+mir_sdr_ErrT err	= fault ("StreamUninit");
+	if (err != mir_sdr_Success)
+	   return err;
+	if (!stub. running)
+	   return mir_sdr_NotInitialised;
+	stub. running	= false;
+	pthread_join (stub. thread, NULL);
+	fprintf (stderr, "stub: %llu packets, %llu dropped, "
+	                 "callback %.1f usec average, %.1f max\n",
+	                 (unsigned long long)stub. packets,
+	                 (unsigned long long)stub. dropped,
+	                 stub. packets > 0 ? stub. cbTotal / stub. packets : 0,
+	                 stub. cbMax);
+	return mir_sdr_Success;
+}
+
+static
+void	schedule	(int reason) {
+	stub. pending	|= reason;
+	stub. applyAt	= stub. packets + stub. settle;
+}
+
+mir_sdr_ErrT	mir_sdr_Reinit	(int *gRdB, double fsMHz, double rfMHz,
+	                         mir_sdr_Bw_MHzT bwType,
+	                         mir_sdr_If_kHzT ifType,
+	                         mir_sdr_LoModeT loMode, int LNAstate,
+	                         int *gRdBsystem,
+	                         mir_sdr_SetGrModeT setGrMode,
+	                         int *samplesPerPacket,
+	                         mir_sdr_ReasonForReinitT reasonForReinit) {
+mir_sdr_ErrT err	= fault ("Reinit");
+	(void)bwType;
+	(void)ifType;
+	(void)loMode;
+	(void)setGrMode;
+	if (stub. reinitMs > 0)
+	   usleep (stub. reinitMs * 1000);
+	if (err != mir_sdr_Success)
+	   return err;
+	if ((reasonForReinit & mir_sdr_CHANGE_FS_FREQ) &&
+	                               ((fsMHz < 2) || (fsMHz > 10.66)))
+	   return mir_sdr_OutOfRange;
+	pthread_mutex_lock (&stub. lock);
+	stub. nextRate		= fsMHz * 1e6;
+	stub. nextFrequency	= rfMHz * 1e6;
+	stub. nextGRdB		= *gRdB;
+	stub. nextLna		= LNAstate;
+	schedule (reasonForReinit & (mir_sdr_CHANGE_RF_FREQ |
+	                             mir_sdr_CHANGE_FS_FREQ |
+	                             mir_sdr_CHANGE_GR));
+	stub. pendingReset	= true;
+	pthread_mutex_unlock (&stub. lock);
+	*gRdBsystem		= *gRdB + STUB_LNA_STEP * LNAstate;
+	*samplesPerPacket	= stub. packet;
+	return mir_sdr_Success;
+}
+
+mir_sdr_ErrT	mir_sdr_SetRf	(double drfHz, int abs, int syncUpdate) {
+mir_sdr_ErrT err	= fault ("SetRf");
+	(void)syncUpdate;
+	if (err != mir_sdr_Success)
+	   return err;
+	pthread_mutex_lock (&stub. lock);
+	stub. nextFrequency	= abs ? drfHz : stub. frequency + drfHz;
+	schedule (mir_sdr_CHANGE_RF_FREQ);
+	pthread_mutex_unlock (&stub. lock);
+	return mir_sdr_Success;
+}
+
+mir_sdr_ErrT	mir_sdr_SetFs	(double dfsHz, int abs, int syncUpdate,
+	                                                     int reCal) {
+mir_sdr_ErrT err	= fault ("SetFs");
+double	rate;
+	(void)syncUpdate;
+	(void)reCal;
+	if (err != mir_sdr_Success)
+	   return err;
+	rate	= abs ? dfsHz : stub. rate + dfsHz;
+	if ((rate < 2e6) || (rate > 10.66e6))
+	   return mir_sdr_OutOfRange;
+	pthread_mutex_lock (&stub. lock);
+	stub. nextRate	= rate;
+	schedule (mir_sdr_CHANGE_FS_FREQ);
+	pthread_mutex_unlock (&stub. lock);
+	return mir_sdr_Success;
+}
+
+mir_sdr_ErrT	mir_sdr_SetPpm	(double ppm) {
+	(void)ppm;
+	return fault ("SetPpm");
+}
+
+mir_sdr_ErrT	mir_sdr_RSP_SetGr	(int gRdB, int LNAstate,
+	                                 int abs, int syncUpdate) {
+mir_sdr_ErrT err	= fault ("RSP_SetGr");
+	(void)syncUpdate;
+	if (err != mir_sdr_Success)
+	   return err;
+	pthread_mutex_lock (&stub. lock);
+	stub. nextGRdB	= abs ? gRdB : stub. gRdB + gRdB;
+	stub. nextLna	= LNAstate;
+	schedule (mir_sdr_CHANGE_GR);
+	pthread_mutex_unlock (&stub. lock);
+	return mir_sdr_Success;
+}
+
+mir_sdr_ErrT	mir_sdr_AgcControl	(mir_sdr_AgcControlT enable,
+	                                 int setPoint_dBfs, int knee_dBfs,
+	                                 unsigned int decay_ms,
+	                                 unsigned int hang_ms,
+	                                 int syncUpdate, int LNAstate) {
+	(void)enable;
+	(void)setPoint_dBfs;
+	(void)knee_dBfs;
+	(void)decay_ms;
+	(void)hang_ms;
+	(void)syncUpdate;
+	(void)LNAstate;
+	return fault ("AgcControl");
+}
@@ -0,0 +1,222 @@
+#
+/*
+ *    Copyright (C) 2018
+ *    Jan van Katwijk (J.vanKatwijk@gmail.com)
+ *    Lazy Chair Computing
+ *
+ *    This file is part of the sdrplayBridge.
+ *
+ *    rtlsdrBridge is available under GPL-V2
+ */
+#include	"nco.h"
+#include	<stdlib.h>
+#include	<string.h>
+#include	<math.h>
+
+static
+int	gcd (int a, int b) {
+	while (b != 0) {
+	   int t = a % b;
+	   a	= b;
+	   b	= t;
+	}
+	return a;
+}
+
+static
+int	tableIndex (int inputRate, int shift) {
+	return (int)floor ((double)shift * NCO_TABLE_SIZE / inputRate + 0.5);
+}
+//
+//	the shift that is actually applied, the caller has
+//	to compensate the difference by the LO setting
+int	ncoGrid	(int inputRate, int shift) {
+	return (int)floor ((double)tableIndex (inputRate, shift) *
+	                              inputRate / NCO_TABLE_SIZE + 0.5);
+}
+//
+//	the NCO shifts the spectrum down over "shift" Hz, after
+//	which a windowed sinc lowpass (Blackman) with cutoff fc
+//	(relative to the input rate) removes everything outside
+//	the band of the output and decimates
+static
+void	setup	(ncoState *nco, int inputRate,
+	         int shift, int decimation, double fc) {
+int	k	= tableIndex (inputRate, shift);
+int	i;
+double	sum	= 0;
+
+	k	= ((k % NCO_TABLE_SIZE) + NCO_TABLE_SIZE) % NCO_TABLE_SIZE;
+	nco	-> inputRate	= inputRate;
+	nco	-> shift	= ncoGrid (inputRate, shift);
+	nco	-> decimation	= decimation;
+	nco	-> period	= k == 0 ? 1 : NCO_TABLE_SIZE / gcd (k, NCO_TABLE_SIZE);
+	nco	-> phase	= 0;
+	for (i = 0; i < nco -> period; i ++) {
+	   double phi = -2 * M_PI * (double)((i * k) % NCO_TABLE_SIZE) /
+	                                                 NCO_TABLE_SIZE;
+	   nco -> cosTable [i] = cos (phi);
+	   nco -> sinTable [i] = sin (phi);
+	}
+
+	nco	-> firSize	= 16 * decimation;
+	if (nco -> firSize > NCO_MAX_TAPS)
+	   nco -> firSize = NCO_MAX_TAPS;
+	nco	-> fine		= false;
+	for (i = 0; i < nco -> firSize; i ++) {
+	   double x	= i - (nco -> firSize - 1) / 2.0;
+	   double w	= 0.42 -
+	                  0.5  * cos (2 * M_PI * i / (nco -> firSize - 1)) +
+	                  0.08 * cos (4 * M_PI * i / (nco -> firSize - 1));
+	   double s	= x == 0 ? 2 * fc : sin (2 * M_PI * fc * x) / (M_PI * x);
+	   nco -> taps [i] = s * w;
+	   sum += s * w;
+	}
+	for (i = 0; i < nco -> firSize; i ++)
+	   nco -> taps [i] /= sum;
+	ncoReset (nco);
+}
+
+void	ncoInit	(ncoState *nco, int inputRate, int shift, int decimation) {
+double	fc;
+//	cutoff halfway the edge of the output band and the
+//	(shifted) DC component of the zero IF
+	fc	= (0.5 / decimation + (double)ncoGrid (inputRate, shift) /
+	                                                  inputRate) / 2;
+	if (fc > 0.5 / decimation * 1.25)
+	   fc = 0.5 / decimation * 1.25;
+	setup (nco, inputRate, shift, decimation, fc);
+}
+//
+//	a channel out of a wider band: the shift may be negative and
+//	need not be on the grid, the cutoff is at 80 percent of the
+//	output band
+void	ncoInitChannel	(ncoState *nco,
+	                 int inputRate, int shift, int decimation) {
+double	residual;
+	setup (nco, inputRate, shift, decimation, 0.4 / decimation);
+	residual	= shift - nco -> shift;
+	if (residual != 0) {
+	   double phi	= -2 * M_PI * residual * decimation / inputRate;
+	   nco -> fine		= true;
+	   nco -> fineCos	= cos (phi);
+	   nco -> fineSin	= sin (phi);
+	}
+}
+
+void	ncoReset (ncoState *nco) {
+	nco	-> phase	= 0;
+	nco	-> next		= nco -> firSize - 1;
+	nco	-> fineRe	= 1;
+	nco	-> fineIm	= 0;
+	if (nco -> bufI != NULL) {
+	   memset (nco -> bufI, 0, nco -> bufSize * sizeof (float));
+	   memset (nco -> bufQ, 0, nco -> bufSize * sizeof (float));
+	}
+}
+
+void	ncoFree	(ncoState *nco) {
+	free (nco -> bufI);
+	free (nco -> bufQ);
+	nco	-> bufI		= NULL;
+	nco	-> bufQ		= NULL;
+	nco	-> bufSize	= 0;
+}
+
+static inline
+int16_t	toShort (float v) {
+	if (v >= 32767)
+	   return 32767;
+	if (v <= -32768)
+	   return -32768;
+	return (int16_t)lrintf (v);
+}
+//
+//	shift and decimate, the result is written back into the
+//	xi and xq vectors, the number of output samples is returned
+int	ncoProcess (ncoState *nco, int16_t *xi, int16_t *xq, int n) {
+int	hist	= nco -> firSize - 1;
+int	total	= hist + n;
+float	*bI, *bQ;
+const float	*taps	= nco -> taps;
+int	i, o	= 0;
+int	pos;
+
+	if (total > nco -> bufSize) {
+	   float *nI = realloc (nco -> bufI, total * sizeof (float));
+	   float *nQ = realloc (nco -> bufQ, total * sizeof (float));
+	   if (nI != NULL)
+	      nco -> bufI = nI;
+	   if (nQ != NULL)
+	      nco -> bufQ = nQ;
+	   if ((nI == NULL) || (nQ == NULL))
+	      return 0;
+	   if (nco -> bufSize == 0) {
+	      memset (nco -> bufI, 0, hist * sizeof (float));
+	      memset (nco -> bufQ, 0, hist * sizeof (float));
+	   }
+	   nco -> bufSize = total;
+	}
+	bI	= nco -> bufI + hist;
+	bQ	= nco -> bufQ + hist;
+//
+//	the mixing is done in runs that do not wrap around the
+//	table, so the inner loop is a plain vector operation
+	i	= 0;
+	while (i < n) {
+	   int	run	= nco -> period - nco -> phase;
+	   const float *c	= nco -> cosTable + nco -> phase;
+	   const float *s	= nco -> sinTable + nco -> phase;
+	   int	j;
+	   if (run > n - i)
+	      run = n - i;
+	   for (j = 0; j < run; j ++) {
+	      float re	= xi [i + j];
+	      float im	= xq [i + j];
+	      bI [i + j]	= re * c [j] - im * s [j];
+	      bQ [i + j]	= re * s [j] + im * c [j];
+	   }
+	   i += run;
+	   nco -> phase += run;
+	   if (nco -> phase >= nco -> period)
+	      nco -> phase = 0;
+	}
+
+	bI	= nco -> bufI;
+	bQ	= nco -> bufQ;
+	for (pos = nco -> next; pos < total; pos += nco -> decimation) {
+	   const float *pI	= bI + pos - hist;
+	   const float *pQ	= bQ + pos - hist;
+	   float	sI	= 0;
+	   float	sQ	= 0;
+	   int		t;
+	   for (t = 0; t < nco -> firSize; t ++) {
+	      sI += taps [t] * pI [t];
+	      sQ += taps [t] * pQ [t];
+	   }
+	   if (nco -> fine) {
+	      float re	= nco -> fineRe;
+	      float im	= nco -> fineIm;
+	      float t	= sI * re - sQ * im;
+	      sQ	= sI * im + sQ * re;
+	      sI	= t;
+	      nco -> fineRe	= re * nco -> fineCos - im * nco -> fineSin;
+	      nco -> fineIm	= re * nco -> fineSin + im * nco -> fineCos;
+	   }
+	   xi [o]	= toShort (sI);
+	   xq [o]	= toShort (sQ);
+	   o ++;
+	}
+//	keep the phasor on the unit circle
+	if (nco -> fine) {
+	   float m	= sqrtf (nco -> fineRe * nco -> fineRe +
+	                         nco -> fineIm * nco -> fineIm);
+	   nco -> fineRe	/= m;
+	   nco -> fineIm	/= m;
+	}
+	nco	-> next	= pos - n;
+	memmove (bI, bI + n, hist * sizeof (float));
+	memmove (bQ, bQ + n, hist * sizeof (float));
+	return o;
+}
+
@@ -0,0 +1,57 @@
+#
+/*
+ *    Copyright (C) 2018
+ *    Jan van Katwijk (J.vanKatwijk@gmail.com)
+ *    Lazy Chair Computing
+ *
+ *    This file is part of the sdrplayBridge.
+ *
+ *    rtlsdrBridge is available under GPL-V2
+ */
+#ifndef	__NCO__
+#define	__NCO__
+
+#include	<stdint.h>
+#include	<stdbool.h>
+
+//	The NCO is table driven, the phase increment is rounded such
+//	that the sequence of phases repeats within NCO_TABLE_SIZE samples.
+//	With an inputRate of 8 MHz the resolution of the shift is
+//	then 8 KHz, the remainder is handled by tuning the LO.
+#define	NCO_TABLE_SIZE	1024
+#define	NCO_MAX_TAPS	512
+
+typedef struct {
+	int	inputRate;
+	int	shift;		// in Hz, the value on the table grid
+	int	decimation;
+	int	period;
+	int	phase;
+	float	cosTable [NCO_TABLE_SIZE];
+	float	sinTable [NCO_TABLE_SIZE];
+	int	firSize;
+	float	taps	[NCO_MAX_TAPS];
+//	the work buffer keeps firSize - 1 samples of history
+	int	next;
+	int	bufSize;
+	float	*bufI;
+	float	*bufQ;
+//	for a channel, the part of the shift that is not on the
+//	grid is removed after decimation by a rotating phasor
+	bool	fine;
+	float	fineCos;
+	float	fineSin;
+	float	fineRe;
+	float	fineIm;
+} ncoState;
+
+int	ncoGrid		(int inputRate, int shift);
+void	ncoInit		(ncoState *nco,
+	                 int inputRate, int shift, int decimation);
+void	ncoInitChannel	(ncoState *nco,
+	                 int inputRate, int shift, int decimation);
+void	ncoReset	(ncoState *nco);
+void	ncoFree		(ncoState *nco);
+int	ncoProcess	(ncoState *nco, int16_t *xi, int16_t *xq, int n);
+#endif
+
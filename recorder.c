@@ -0,0 +1,303 @@
+#
+/*
+ *    Copyright (C) 2018
+ *    Jan van Katwijk (J.vanKatwijk@gmail.com)
+ *    Lazy Chair Computing
+ *
+ *    This file is part of the sdrplayBridge.
+ *
+ *    rtlsdrBridge is available under GPL-V2
+ */
+#ifndef	_GNU_SOURCE
+#define	_GNU_SOURCE		// O_DIRECT
+#endif
+#include	"recorder.h"
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<errno.h>
+#include	<fcntl.h>
+#include	<unistd.h>
+#include	<time.h>
+
+static
+bool	writeAll	(int fd, const uint8_t *p, size_t len) {
+	while (len > 0) {
+	   ssize_t w = write (fd, p, len);
+	   if (w < 0) {
+	      if (errno == EINTR)
+	         continue;
+	      return false;
+	   }
+	   p	+= w;
+	   len	-= w;
+	}
+	return true;
+}
+
+static
+void	*recWriter	(void *arg) {
+recorder *rec	= (recorder *)arg;
+
+	while (true) {
+	   uint32_t c	= rec -> consumed;
+	   sem_wait (&rec -> full);
+	   if (__atomic_load_n (&rec -> produced, __ATOMIC_ACQUIRE) == c) {
+	      if (rec -> stopping)
+	         break;
+	      continue;
+	   }
+	   if (!rec -> failed &&
+	       !writeAll (rec -> fd, rec -> blocks [c % REC_BLOCKS],
+	                                             REC_BLOCK_SIZE)) {
+	      fprintf (stderr, "recording %s: %s\n",
+	                            rec -> dataName, strerror (errno));
+	      rec -> failed = true;
+	   }
+	   __atomic_store_n (&rec -> consumed, c + 1, __ATOMIC_RELEASE);
+	}
+	return NULL;
+}
+
+recorder	*recOpen	(const char *base, const char *hw) {
+recorder *rec	= (recorder *)calloc (1, sizeof (recorder));
+time_t	now	= time (NULL);
+int	i;
+
+	if (rec == NULL)
+	   return NULL;
+	rec	-> fd	= -1;
+	if ((strlen (base) > 4) &&
+	    (strcmp (base + strlen (base) - 4, ".iqz") == 0)) {
+	   rec -> iqz	= iqzCreate (base, hw);
+	   if (rec -> iqz == NULL) {
+	      free (rec);
+	      return NULL;
+	   }
+	   snprintf (rec -> dataName, sizeof (rec -> dataName), "%s", base);
+	   return rec;
+	}
+	snprintf (rec -> dataName, sizeof (rec -> dataName),
+	                               "%s.sigmf-data", base);
+	snprintf (rec -> metaName, sizeof (rec -> metaName),
+	                               "%s.sigmf-meta", base);
+	snprintf (rec -> hw, sizeof (rec -> hw), "%s", hw);
+	strftime (rec -> datetime, sizeof (rec -> datetime),
+	                       "%Y-%m-%dT%H:%M:%SZ", gmtime (&now));
+	for (i = 0; i < REC_BLOCKS; i ++)
+	   if (posix_memalign ((void **)&rec -> blocks [i],
+	                        REC_ALIGN, REC_BLOCK_SIZE) != 0) {
+	      rec -> blocks [i] = NULL;
+	      recClose (rec);
+	      return NULL;
+	   }
+//	e.g. tmpfs does not do O_DIRECT
+	rec	-> fd	= open (rec -> dataName,
+	                        O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+	rec	-> direct	= rec -> fd >= 0;
+	if (rec -> fd < 0)
+	   rec -> fd	= open (rec -> dataName,
+	                        O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (rec -> fd < 0) {
+	   fprintf (stderr, "cannot create %s: %s\n",
+	                            rec -> dataName, strerror (errno));
+	   recClose (rec);
+	   return NULL;
+	}
+	sem_init (&rec -> full, 0, 0);
+	if (pthread_create (&rec -> writer, NULL, recWriter, rec) != 0) {
+	   sem_destroy (&rec -> full);
+	   close (rec -> fd);
+	   rec -> fd	= -1;
+	   recClose (rec);
+	   return NULL;
+	}
+	return rec;
+}
+
+static
+void	addEvent	(recorder *rec, int type, int64_t value) {
+	if (rec -> nEvents >= REC_MAX_EVENTS)
+	   return;
+	rec -> events [rec -> nEvents]. sample	= rec -> samples;
+	rec -> events [rec -> nEvents]. type	= type;
+	rec -> events [rec -> nEvents]. value	= value;
+	rec -> nEvents ++;
+}
+//
+//	called in the callback thread, it never waits
+void	recSamples	(recorder *rec,
+	                 const int16_t *xi, const int16_t *xq, int n,
+	                 int frequency, int rate, int gain) {
+	if (rec -> iqz != NULL) {
+	   iqzSamples (rec -> iqz, xi, xq, n, frequency, rate, gain);
+	   return;
+	}
+	if (!rec -> started || (frequency != rec -> frequency))
+	   addEvent (rec, REC_FREQUENCY, frequency);
+	if (!rec -> started || (rate != rec -> rate))
+	   addEvent (rec, REC_RATE, rate);
+	if (!rec -> started || (gain != rec -> gain))
+	   addEvent (rec, REC_GAIN, gain);
+	rec	-> started	= true;
+	rec	-> frequency	= frequency;
+	rec	-> rate		= rate;
+	rec	-> gain		= gain;
+
+	while (n > 0) {
+	   uint32_t p	= rec -> produced;
+	   int16_t *out;
+	   int	k, i;
+	   if (p - __atomic_load_n (&rec -> consumed, __ATOMIC_ACQUIRE) >=
+	                                                      REC_BLOCKS) {
+	      recEvent *last	= &rec -> events [rec -> nEvents - 1];
+	      if ((last -> type != REC_DROP) ||
+	                     (last -> sample != rec -> samples)) {
+	         addEvent (rec, REC_DROP, 0);
+	         last	= &rec -> events [rec -> nEvents - 1];
+	      }
+	      if (last -> type == REC_DROP)
+	         last -> value	+= n;
+	      rec -> dropped	+= n;
+	      return;
+	   }
+	   out	= (int16_t *)(rec -> blocks [p % REC_BLOCKS] + rec -> fill);
+	   k	= (REC_BLOCK_SIZE - rec -> fill) / 4;
+	   if (k > n)
+	      k = n;
+	   for (i = 0; i < k; i ++) {
+	      out [2 * i]	= xi [i];
+	      out [2 * i + 1]	= xq [i];
+	   }
+	   xi	+= k;
+	   xq	+= k;
+	   n	-= k;
+	   rec -> fill		+= 4 * k;
+	   rec -> samples	+= k;
+	   if (rec -> fill >= REC_BLOCK_SIZE) {
+	      rec -> fill	= 0;
+	      __atomic_store_n (&rec -> produced, p + 1, __ATOMIC_RELEASE);
+	      sem_post (&rec -> full);
+	   }
+	}
+}
+
+static
+void	writeMeta	(recorder *rec) {
+FILE	*f	= fopen (rec -> metaName, "w");
+int	rate	= 0;
+int	frequency	= 0;
+bool	first	= true;
+int	i;
+
+	if (f == NULL) {
+	   fprintf (stderr, "cannot create %s\n", rec -> metaName);
+	   return;
+	}
+	for (i = 0; i < rec -> nEvents; i ++)
+	   if (rec -> events [i]. type == REC_RATE) {
+	      rate	= rec -> events [i]. value;
+	      break;
+	   }
+	fprintf (f, "{\n  \"global\": {\n");
+	fprintf (f, "    \"core:datatype\": \"ci16_le\",\n");
+	fprintf (f, "    \"core:sample_rate\": %d,\n", rate);
+	fprintf (f, "    \"core:version\": \"1.0.0\",\n");
+	fprintf (f, "    \"core:recorder\": \"rtlsdr-bridge\",\n");
+	fprintf (f, "    \"core:hw\": \"%s\",\n", rec -> hw);
+	fprintf (f, "    \"core:extensions\": [{\"name\": \"rtlsdr\", "
+	            "\"version\": \"1.0.0\", \"optional\": true}]\n  },\n");
+//
+//	a capture segment per change of frequency or rate
+	fprintf (f, "  \"captures\": [");
+	for (i = 0; i < rec -> nEvents; i ++) {
+	   recEvent *e	= &rec -> events [i];
+	   if (e -> type == REC_FREQUENCY)
+	      frequency	= e -> value;
+	   else
+	   if (e -> type == REC_RATE)
+	      rate	= e -> value;
+	   else
+	      continue;
+	   if ((i + 1 < rec -> nEvents) &&
+	       (rec -> events [i + 1]. sample == e -> sample) &&
+	       ((rec -> events [i + 1]. type == REC_FREQUENCY) ||
+	        (rec -> events [i + 1]. type == REC_RATE)))
+	      continue;		// more changes at the same sample
+	   fprintf (f, "%s\n    {\"core:sample_start\": %llu, "
+	               "\"core:frequency\": %d, \"rtlsdr:sample_rate\": %d",
+	               first ? "" : ",",
+	               (unsigned long long)e -> sample, frequency, rate);
+	   if (first)
+	      fprintf (f, ", \"core:datetime\": \"%s\"", rec -> datetime);
+	   fprintf (f, "}");
+	   first	= false;
+	}
+	fprintf (f, "\n  ],\n");
+//
+//	gain changes and drops are annotations
+	fprintf (f, "  \"annotations\": [");
+	first	= true;
+	for (i = 0; i < rec -> nEvents; i ++) {
+	   recEvent *e	= &rec -> events [i];
+	   if (e -> type == REC_GAIN)
+	      fprintf (f, "%s\n    {\"core:sample_start\": %llu, "
+	                  "\"core:comment\": \"gain %.1f dB\", "
+	                  "\"rtlsdr:gain\": %lld}",
+	                  first ? "" : ",",
+	                  (unsigned long long)e -> sample,
+	                  e -> value / 10.0, (long long)e -> value);
+	   else
+	   if (e -> type == REC_DROP)
+	      fprintf (f, "%s\n    {\"core:sample_start\": %llu, "
+	                  "\"core:comment\": \"%lld samples dropped\", "
+	                  "\"rtlsdr:dropped\": %lld}",
+	                  first ? "" : ",",
+	                  (unsigned long long)e -> sample,
+	                  (long long)e -> value, (long long)e -> value);
+	   else
+	      continue;
+	   first	= false;
+	}
+	fprintf (f, "\n  ]\n}\n");
+	fclose (f);
+}
+//
+//	the callback should not use the recorder anymore. The blocks
+//	still queued are written by the writer, the last - partial -
+//	block is written here, without O_DIRECT
+void	recClose	(recorder *rec) {
+int	i;
+	if (rec == NULL)
+	   return;
+	iqzFinish (rec -> iqz);
+	if (rec -> fd >= 0) {
+	   rec -> stopping	= true;
+	   sem_post (&rec -> full);
+	   pthread_join (rec -> writer, NULL);
+	   sem_destroy (&rec -> full);
+	   if ((rec -> fill > 0) && !rec -> failed) {
+	      if (rec -> direct)
+	         fcntl (rec -> fd, F_SETFL,
+	                     fcntl (rec -> fd, F_GETFL) & ~O_DIRECT);
+	      if (!writeAll (rec -> fd,
+	                     rec -> blocks [rec -> produced % REC_BLOCKS],
+	                     rec -> fill))
+	         fprintf (stderr, "recording %s: %s\n",
+	                             rec -> dataName, strerror (errno));
+	   }
+	   close (rec -> fd);
+	   writeMeta (rec);
+	   fprintf (stderr, "recorded %llu samples in %s",
+	                    (unsigned long long)rec -> samples,
+	                    rec -> dataName);
+	   if (rec -> dropped > 0)
+	      fprintf (stderr, ", %llu dropped",
+	                       (unsigned long long)rec -> dropped);
+	   fprintf (stderr, "\n");
+	}
+	for (i = 0; i < REC_BLOCKS; i ++)
+	   free (rec -> blocks [i]);
+	free (rec);
+}
+
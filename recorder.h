@@ -0,0 +1,79 @@
+#
+/*
+ *    Copyright (C) 2018
+ *    Jan van Katwijk (J.vanKatwijk@gmail.com)
+ *    Lazy Chair Computing
+ *
+ *    This file is part of the sdrplayBridge.
+ *
+ *    rtlsdrBridge is available under GPL-V2
+ */
+#ifndef	__RECORDER__
+#define	__RECORDER__
+
+#include	<stdint.h>
+#include	<stdbool.h>
+#include	<pthread.h>
+#include	<semaphore.h>
+#include	"iqz.h"
+
+//	Recording the 16 bit samples a client gets, as a SigMF
+//	recording: <base>.sigmf-data with ci16_le samples and
+//	<base>.sigmf-meta, written when the recording is closed, with
+//	the changes of frequency, rate and gain at their sample index.
+//	The callback thread fills preallocated, aligned blocks, a writer
+//	thread writes full blocks with O_DIRECT (if the file system
+//	supports it). The callback never waits: if no block is free,
+//	the samples are dropped, the drop is noted in the metadata.
+//	A name ending in ".iqz" gives a compressed recording (iqz.h).
+#define	REC_BLOCK_SIZE		(4 << 20)
+#define	REC_BLOCKS		8
+#define	REC_ALIGN		4096
+#define	REC_MAX_EVENTS		4096
+
+#define	REC_FREQUENCY		1
+#define	REC_RATE		2
+#define	REC_GAIN		3
+#define	REC_DROP		4
+
+typedef struct {
+	uint64_t	sample;
+	int		type;
+	int64_t		value;
+} recEvent;
+
+typedef struct {
+	iqzWriter	*iqz;
+	char	dataName [256];
+	char	metaName [256];
+	char	hw [64];
+	char	datetime [32];
+	int	fd;
+	bool	direct;
+	uint8_t	*blocks [REC_BLOCKS];
+//	blocks handed over by the callback, written by the writer
+	volatile uint32_t	produced;
+	volatile uint32_t	consumed;
+	int	fill;
+	sem_t	full;
+	pthread_t	writer;
+	volatile bool	stopping;
+	bool	failed;
+//	written by the callback thread
+	uint64_t	samples;
+	uint64_t	dropped;
+	bool	started;
+	int	frequency;
+	int	rate;
+	int	gain;
+	recEvent	events [REC_MAX_EVENTS];
+	int	nEvents;
+} recorder;
+
+recorder	*recOpen	(const char *base, const char *hw);
+void	recClose	(recorder *rec);
+void	recSamples	(recorder *rec,
+	                 const int16_t *xi, const int16_t *xq, int n,
+	                 int frequency, int rate, int gain);
+#endif
+
@@ -0,0 +1,468 @@
+#
+/*
+ *    Copyright (C) 2018
+ *    Jan van Katwijk (J.vanKatwijk@gmail.com)
+ *    Lazy Chair Computing
+ *
+ *    This file is part of the sdrplayBridge.
+ *
+ *    rtlsdrBridge is available under GPL-V2
+ */
+#include	"replay.h"
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<stdint.h>
+#include	<string.h>
+#include	<errno.h>
+#include	<fcntl.h>
+#include	<unistd.h>
+#include	<pthread.h>
+#include	<time.h>
+#include	<sys/mman.h>
+#include	<sys/stat.h>
+
+typedef struct {
+	int	fd;
+	uint8_t	*data;
+	size_t	size;
+	int	format;
+	uint64_t	samples;
+	uint64_t	position;
+	int	fileRate;
+	int	fileFrequency;
+	char	name [256];
+	bool	maxSpeed;
+	FILE	*log;
+	struct timespec	epoch;
+//	the stream
+	pthread_t	thread;
+	volatile bool	running;
+	mir_sdr_StreamCallback_t	streamCb;
+	mir_sdr_GainChangeCallback_t	gainCb;
+	void	*ctx;
+	uint32_t	sampleNum;
+	struct timespec	paceStart;
+	uint64_t	paced;
+//	set by the calls, taken over by the thread at the next packet
+	volatile int	rate;
+	volatile int	frequency;
+	volatile int	gRdB;
+	volatile int	lnaState;
+	volatile int	grChanged;
+	volatile int	rfChanged;
+	volatile int	fsChanged;
+	volatile int	reset;
+} replayState;
+
+static
+replayState	replay;
+
+static
+const int	sampleSize [] = {4, 2, 2};
+
+static
+void	logCall		(const char *fmt, double value) {
+struct timespec now;
+	clock_gettime (CLOCK_MONOTONIC, &now);
+	fprintf (replay. log, "%10.6f %10u ",
+	         (now. tv_sec - replay. epoch. tv_sec) +
+	         (now. tv_nsec - replay. epoch. tv_nsec) / 1e9,
+	         replay. sampleNum);
+	fprintf (replay. log, fmt, value);
+	fprintf (replay. log, "\n");
+	fflush (replay. log);
+}
+//
+//	The SigMF metadata is read for the datatype, the rate and the
+//	frequency of the first capture, there is no need for more
+static
+long	jsonNumber	(const char *json, const char *key) {
+const char *p	= strstr (json, key);
+	if (p == NULL)
+	   return 0;
+	p	= strchr (p + strlen (key), ':');
+	return p == NULL ? 0 : (long)strtod (p + 1, NULL);
+}
+
+static
+bool	readSigmf	(const char *meta) {
+FILE	*f	= fopen (meta, "r");
+char	json [16384];
+size_t	n;
+char	*p;
+
+	if (f == NULL) {
+	   fprintf (stderr, "cannot open %s\n", meta);
+	   return false;
+	}
+	n	= fread (json, 1, sizeof (json) - 1, f);
+	fclose (f);
+	json [n]	= 0;
+	p	= strstr (json, "\"core:datatype\"");
+	if ((p == NULL) || ((p = strchr (p + 15, '"')) == NULL)) {
+	   fprintf (stderr, "%s: no datatype\n", meta);
+	   return false;
+	}
+	if (strncmp (p, "\"ci16_le\"", 9) == 0)
+	   replay. format	= REPLAY_CS16;
+	else
+	if (strncmp (p, "\"cu8\"", 5) == 0)
+	   replay. format	= REPLAY_CU8;
+	else
+	if (strncmp (p, "\"ci8\"", 5) == 0)
+	   replay. format	= REPLAY_CS8;
+	else {
+	   fprintf (stderr, "%s: datatype not supported\n", meta);
+	   return false;
+	}
+	replay. fileRate	= jsonNumber (json, "\"core:sample_rate\"");
+	replay. fileFrequency	= jsonNumber (json, "\"core:frequency\"");
+	return true;
+}
+
+static
+bool	endsWith	(const char *s, const char *tail) {
+size_t	l	= strlen (s);
+size_t	t	= strlen (tail);
+	return (l >= t) && (strcmp (s + l - t, tail) == 0);
+}
+//
+//	a packet from the mapped file, the file wraps around
+static
+void	fillPacket	(int16_t *xi, int16_t *xq, int n) {
+int	i;
+	for (i = 0; i < n; i ++) {
+	   const uint8_t *p = replay. data +
+	                      replay. position * sampleSize [replay. format];
+	   switch (replay. format) {
+	      case REPLAY_CS16:
+	         xi [i]	= (int16_t)(p [0] | (p [1] << 8));
+	         xq [i]	= (int16_t)(p [2] | (p [3] << 8));
+	         break;
+//	8 bits scaled to the 14 bits of the RSP1A
+	      case REPLAY_CU8:
+	         xi [i]	= (p [0] - 128) << 6;
+	         xq [i]	= (p [1] - 128) << 6;
+	         break;
+	      case REPLAY_CS8:
+	         xi [i]	= (int8_t)p [0] << 6;
+	         xq [i]	= (int8_t)p [1] << 6;
+	         break;
+	   }
+	   if (++ replay. position >= replay. samples)
+	      replay. position = 0;
+	}
+}
+
+static
+void	*replayThread	(void *arg) {
+int16_t	xi [REPLAY_PACKET];
+int16_t	xq [REPLAY_PACKET];
+int	rate	= replay. rate;
+	(void)arg;
+	clock_gettime (CLOCK_MONOTONIC, &replay. paceStart);
+	replay. paced	= 0;
+	while (replay. running) {
+	   int grChanged	= __atomic_exchange_n (&replay. grChanged, 0,
+	                                                 __ATOMIC_ACQ_REL);
+	   int rfChanged	= __atomic_exchange_n (&replay. rfChanged, 0,
+	                                                 __ATOMIC_ACQ_REL);
+	   int fsChanged	= __atomic_exchange_n (&replay. fsChanged, 0,
+	                                                 __ATOMIC_ACQ_REL);
+	   int reset		= __atomic_exchange_n (&replay. reset, 0,
+	                                                 __ATOMIC_ACQ_REL);
+//	a new rate, the pacing starts over
+	   if (rate != replay. rate) {
+	      rate	= replay. rate;
+	      clock_gettime (CLOCK_MONOTONIC, &replay. paceStart);
+	      replay. paced	= 0;
+	   }
+	   if (!replay. maxSpeed && (rate > 0)) {
+	      struct timespec t	= replay. paceStart;
+	      uint64_t nsec	= replay. paced * 1000000000ULL / rate;
+	      t. tv_sec	+= nsec / 1000000000ULL;
+	      t. tv_nsec	+= nsec % 1000000000ULL;
+	      if (t. tv_nsec >= 1000000000L) {
+	         t. tv_sec ++;
+	         t. tv_nsec -= 1000000000L;
+	      }
+	      clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &t, NULL);
+	   }
+	   fillPacket (xi, xq, REPLAY_PACKET);
+	   if (grChanged && (replay. gainCb != NULL))
+	      replay. gainCb (replay. gRdB, 0, replay. ctx);
+	   replay. streamCb (xi, xq, replay. sampleNum,
+	                     grChanged, rfChanged, fsChanged,
+	                     REPLAY_PACKET, reset, 0, replay. ctx);
+	   replay. sampleNum	+= REPLAY_PACKET;
+	   replay. paced	+= REPLAY_PACKET;
+	}
+	return NULL;
+}
+
+static
+mir_sdr_ErrT	replayApiVersion (float *version) {
+	*version	= REPLAY_VERSION;
+	return mir_sdr_Success;
+}
+
+static
+mir_sdr_ErrT	replayGetDevices (mir_sdr_DeviceT *devices,
+	                          unsigned int *numDevs,
+	                          unsigned int maxDevs) {
+	if (maxDevs < 1)
+	   return mir_sdr_InvalidParam;
+	devices [0]. SerNo	= "replay";
+	devices [0]. DevNm	= replay. name;
+	devices [0]. hwVer	= REPLAY_HW;
+	devices [0]. devAvail	= 1;
+	*numDevs		= 1;
+	return mir_sdr_Success;
+}
+
+static
+mir_sdr_ErrT	replaySetDeviceIdx (unsigned int idx) {
+	return idx == 0 ? mir_sdr_Success : mir_sdr_InvalidParam;
+}
+
+static
+mir_sdr_ErrT	replayReleaseDeviceIdx (void) {
+	return mir_sdr_Success;
+}
+
+static
+mir_sdr_ErrT	replayTunerSel (mir_sdr_rspDuo_TunerSelT sel) {
+	logCall ("TunerSel %.0f", sel);
+	return mir_sdr_Success;
+}
+
+static
+void	setRate		(double fsMHz) {
+	replay. rate	= (int)(fsMHz * 1000000);
+	if ((replay. fileRate > 0) && (replay. rate != replay. fileRate))
+	   logCall ("rate differs from the recording (%.0f)",
+	                                         replay. fileRate);
+}
+
+static
+mir_sdr_ErrT	replayStreamInit (int *gRdB, double fsMHz, double rfMHz,
+	                          mir_sdr_Bw_MHzT bwType,
+	                          mir_sdr_If_kHzT ifType,
+	                          int LNAstate, int *gRdBsystem,
+	                          mir_sdr_SetGrModeT setGrMode,
+	                          int *samplesPerPacket,
+	                          mir_sdr_StreamCallback_t StreamCbFn,
+	                          mir_sdr_GainChangeCallback_t GainChangeCbFn,
+	                          void *cbContext) {
+	(void)bwType;
+	(void)ifType;
+	(void)setGrMode;
+	if (replay. running)
+	   return mir_sdr_AlreadyInitialised;
+	logCall ("StreamInit %.0f Hz", rfMHz * 1000000);
+	setRate (fsMHz);
+	replay. frequency	= (int)(rfMHz * 1000000);
+	replay. gRdB		= *gRdB;
+	replay. lnaState	= LNAstate;
+	replay. streamCb	= StreamCbFn;
+	replay. gainCb		= GainChangeCbFn;
+	replay. ctx		= cbContext;
+	replay. sampleNum	= 0;
+	replay. reset		= 1;
+	*gRdBsystem		= *gRdB;
+	*samplesPerPacket	= REPLAY_PACKET;
+	replay. running		= true;
+	if (pthread_create (&replay. thread, NULL, replayThread, NULL) != 0) {
+	   replay. running	= false;
+	   return mir_sdr_Fail;
+	}
+	return mir_sdr_Success;
+}
+
+static
+mir_sdr_ErrT	replayStreamUninit (void) {
+	if (!replay. running)
+	   return mir_sdr_NotInitialised;
+	logCall ("StreamUninit", 0);
+	replay. running	= false;
+	pthread_join (replay. thread, NULL);
+	return mir_sdr_Success;
+}
+
+static
+mir_sdr_ErrT	replayReinit (int *gRdB, double fsMHz, double rfMHz,
+	                      mir_sdr_Bw_MHzT bwType, mir_sdr_If_kHzT ifType,
+	                      mir_sdr_LoModeT loMode, int LNAstate,
+	                      int *gRdBsystem, mir_sdr_SetGrModeT setGrMode,
+	                      int *samplesPerPacket,
+	                      mir_sdr_ReasonForReinitT reasonForReinit) {
+	(void)ifType;
+	(void)loMode;
+	(void)setGrMode;
+	logCall ("Reinit, reason %.0f", reasonForReinit);
+	if (reasonForReinit & mir_sdr_CHANGE_FS_FREQ) {
+	   setRate (fsMHz);
+	   replay. fsChanged	= 1;
+	}
+	if (reasonForReinit & mir_sdr_CHANGE_RF_FREQ) {
+	   logCall ("  frequency %.0f Hz", rfMHz * 1000000);
+	   replay. frequency	= (int)(rfMHz * 1000000);
+	   replay. rfChanged	= 1;
+	}
+	if (reasonForReinit & mir_sdr_CHANGE_BW_TYPE)
+	   logCall ("  bandwidth %.0f KHz", bwType);
+	if (reasonForReinit & mir_sdr_CHANGE_GR) {
+	   replay. gRdB		= *gRdB;
+	   replay. lnaState	= LNAstate;
+	   replay. grChanged	= 1;
+	}
+	*gRdBsystem		= *gRdB;
+	*samplesPerPacket	= REPLAY_PACKET;
+	replay. reset		= 1;
+	return mir_sdr_Success;
+}
+
+static
+mir_sdr_ErrT	replaySetRf	(double drfHz, int abs, int syncUpdate) {
+	(void)syncUpdate;
+	replay. frequency	= abs ? (int)drfHz :
+	                                replay. frequency + (int)drfHz;
+	logCall ("SetRf %.0f Hz", replay. frequency);
+	replay. rfChanged	= 1;
+	return mir_sdr_Success;
+}
+
+static
+mir_sdr_ErrT	replaySetFs	(double dfsHz, int abs, int syncUpdate,
+	                                                  int reCal) {
+	(void)syncUpdate;
+	(void)reCal;
+	setRate ((abs ? dfsHz : replay. rate + dfsHz) / 1000000);
+	logCall ("SetFs %.0f Hz", replay. rate);
+	replay. fsChanged	= 1;
+	return mir_sdr_Success;
+}
+
+static
+mir_sdr_ErrT	replaySetPpm	(double ppm) {
+	logCall ("SetPpm %.1f", ppm);
+	return mir_sdr_Success;
+}
+
+static
+mir_sdr_ErrT	replaySetGr	(int gRdB, int LNAstate, int abs,
+	                                              int syncUpdate) {
+	(void)syncUpdate;
+	replay. gRdB		= abs ? gRdB : replay. gRdB + gRdB;
+	replay. lnaState	= LNAstate;
+	logCall ("SetGr %.0f dB", replay. gRdB);
+	logCall ("  lna state %.0f", LNAstate);
+	replay. grChanged	= 1;
+	return mir_sdr_Success;
+}
+
+static
+mir_sdr_ErrT	replayAgcControl (mir_sdr_AgcControlT enable,
+	                          int setPoint_dBfs, int knee_dBfs,
+	                          unsigned int decay_ms, unsigned int hang_ms,
+	                          int syncUpdate, int LNAstate) {
+	(void)setPoint_dBfs;
+	(void)knee_dBfs;
+	(void)decay_ms;
+	(void)hang_ms;
+	(void)syncUpdate;
+	(void)LNAstate;
+	logCall ("AgcControl %.0f", enable);
+	return mir_sdr_Success;
+}
+//
+//	The recording: name.sigmf-meta, name.sigmf-data or name for
+//	a SigMF recording, names ending in .cu8, .u8 or .bin (rtl_sdr)
+//	for unsigned 8 bit, .cs8 or .s8 for signed 8 bit, others are
+//	taken as 16 bit. RTLSDR_REPLAY_SPEED=max replays without pacing,
+//	RTLSDR_REPLAY_LOG names the log, default stderr
+bool	replayInit	(const char *name, sdrBackend *backend) {
+char	dataName [300];
+char	base [256];
+struct stat st;
+const char *s;
+
+	memset (&replay, 0, sizeof (replay));
+	replay. fd	= -1;
+	replay. format	= REPLAY_CS16;
+	snprintf (base, sizeof (base), "%s", name);
+	if (endsWith (base, ".sigmf-meta") || endsWith (base, ".sigmf-data"))
+	   base [strlen (base) - 11] = 0;
+	snprintf (dataName, sizeof (dataName), "%s.sigmf-meta", base);
+	if (access (dataName, R_OK) == 0) {
+	   if (!readSigmf (dataName))
+	      return false;
+	   snprintf (dataName, sizeof (dataName), "%s.sigmf-data", base);
+	}
+	else {
+	   snprintf (dataName, sizeof (dataName), "%s", name);
+	   if (endsWith (name, ".cu8") || endsWith (name, ".u8") ||
+	                                  endsWith (name, ".bin"))
+	      replay. format	= REPLAY_CU8;
+	   else
+	   if (endsWith (name, ".cs8") || endsWith (name, ".s8"))
+	      replay. format	= REPLAY_CS8;
+	}
+
+	replay. fd	= open (dataName, O_RDONLY);
+	if ((replay. fd < 0) || (fstat (replay. fd, &st) < 0)) {
+	   fprintf (stderr, "cannot open %s: %s\n",
+	                              dataName, strerror (errno));
+	   if (replay. fd >= 0)
+	      close (replay. fd);
+	   return false;
+	}
+	replay. size	= st. st_size;
+	replay. samples	= replay. size / sampleSize [replay. format];
+	if (replay. samples < REPLAY_PACKET) {
+	   fprintf (stderr, "%s: too short to replay\n", dataName);
+	   close (replay. fd);
+	   return false;
+	}
+	replay. data	= mmap (NULL, replay. size, PROT_READ, MAP_PRIVATE,
+	                                               replay. fd, 0);
+	if (replay. data == MAP_FAILED) {
+	   fprintf (stderr, "cannot map %s: %s\n",
+	                              dataName, strerror (errno));
+	   close (replay. fd);
+	   return false;
+	}
+	madvise (replay. data, replay. size, MADV_SEQUENTIAL);
+
+	s	= getenv ("RTLSDR_REPLAY_SPEED");
+	replay. maxSpeed	= (s != NULL) && (strcmp (s, "max") == 0);
+	s	= getenv ("RTLSDR_REPLAY_LOG");
+	replay. log	= s != NULL ? fopen (s, "w") : NULL;
+	if (replay. log == NULL)
+	   replay. log = stderr;
+	clock_gettime (CLOCK_MONOTONIC, &replay. epoch);
+	snprintf (replay. name, sizeof (replay. name), "Replay %.200s",
+	                                         strrchr (dataName, '/') != NULL ?
+	                                         strrchr (dataName, '/') + 1 :
+	                                         dataName);
+	fprintf (stderr, "replaying %llu samples from %s%s\n",
+	                 (unsigned long long)replay. samples, dataName,
+	                 replay. maxSpeed ? ", at maximum speed" : "");
+	if (replay. fileFrequency > 0)
+	   logCall ("recorded at %.0f Hz", replay. fileFrequency);
+
+	backend -> ApiVersion		= replayApiVersion;
+	backend -> GetDevices		= replayGetDevices;
+	backend -> SetDeviceIdx		= replaySetDeviceIdx;
+	backend -> ReleaseDeviceIdx	= replayReleaseDeviceIdx;
+	backend -> rspDuo_TunerSel	= replayTunerSel;
+	backend -> StreamInit		= replayStreamInit;
+	backend -> StreamUninit		= replayStreamUninit;
+	backend -> Reinit		= replayReinit;
+	backend -> SetRf		= replaySetRf;
+	backend -> SetFs		= replaySetFs;
+	backend -> SetPpm		= replaySetPpm;
+	backend -> RSP_SetGr		= replaySetGr;
+	backend -> AgcControl		= replayAgcControl;
+	return true;
+}
@@ -0,0 +1,55 @@
+#
+/*
+ *    Copyright (C) 2018
+ *    Jan van Katwijk (J.vanKatwijk@gmail.com)
+ *    Lazy Chair Computing
+ *
+ *    This file is part of the sdrplayBridge.
+ *
+ *    rtlsdrBridge is available under GPL-V2
+ */
+#ifndef	__REPLAY__
+#define	__REPLAY__
+
+#include	<stdbool.h>
+#include	"mirsdrapi-rsp.h"
+
+//	The functions of the SDRplay library the bridge uses. The
+//	bridge calls them through this table, filled with either the
+//	library functions or the replay functions.
+typedef struct {
+	mir_sdr_ApiVersion_t		ApiVersion;
+	mir_sdr_GetDevices_t		GetDevices;
+	mir_sdr_SetDeviceIdx_t		SetDeviceIdx;
+	mir_sdr_ReleaseDeviceIdx_t	ReleaseDeviceIdx;
+	mir_sdr_rspDuo_TunerSel_t	rspDuo_TunerSel;
+	mir_sdr_StreamInit_t		StreamInit;
+	mir_sdr_StreamUninit_t		StreamUninit;
+	mir_sdr_Reinit_t		Reinit;
+	mir_sdr_SetRf_t			SetRf;
+	mir_sdr_SetFs_t			SetFs;
+	mir_sdr_SetPpm_t		SetPpm;
+	mir_sdr_RSP_SetGr_t		RSP_SetGr;
+	mir_sdr_AgcControl_t		AgcControl;
+} sdrBackend;
+
+//	Replaying a recording instead of an SDRplay: raw 16 bit I/Q
+//	(as recorded by the bridge), raw 8 bit I/Q (as rtl_sdr writes
+//	it, unsigned, or signed) or a SigMF recording. The file is
+//	mapped, packets of REPLAY_PACKET samples are passed to the
+//	stream callback by a thread, at the rate the bridge asked for
+//	or as fast as the callback takes them. At the end of the file
+//	the replay starts over. Tuning and gain calls succeed and are
+//	logged, with the sample number they take effect.
+//	Linux only.
+#define	REPLAY_PACKET		252
+#define	REPLAY_HW		255	// an RSP1A
+#define	REPLAY_VERSION		2.13
+
+#define	REPLAY_CS16		0
+#define	REPLAY_CU8		1
+#define	REPLAY_CS8		2
+
+bool	replayInit	(const char *name, sdrBackend *backend);
+#endif
+
@@ -0,0 +1,294 @@
+/*
+ *    Copyright (C) 2018
+ *    Jan van Katwijk (J.vanKatwijk@gmail.com)
+ *    Lazy Chair Computing
+ *
+ *    This file is part of the sdrplayBridge.
+ *
+ *    Extensions to the rtlsdr API, only available with the bridge.
+ *    Clients not using them see a plain rtlsdr library.
+ *
+ *    rtlsdrBridge is available under GPL-V2
+ */
+
+#ifndef __RTL_SDR_EXTENSIONS_H
+#define __RTL_SDR_EXTENSIONS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <rtl-sdr.h>
+
+/*!
+ * Metadata, delivered through a separate callback in the thread
+ * that delivers the samples. An element is always delivered before
+ * the buffer containing the sample it applies to.
+ * sampleIndex counts the samples delivered since read_async started.
+ */
+#define RTLSDR_META_GAIN	1	/* value [0] lna state, value [1] GRdB,
+					   value [2] total gain in tenth dB */
+#define RTLSDR_META_TUNE	2	/* a frequency or samplerate change is
+					   in effect from sampleIndex on:
+					   value [0] how it was done (0 in
+					   software, 1 SetFs, 2 Reinit,
+					   3 SetRf), value [1] frequency,
+					   value [2] samplerate, value [3] usec
+					   since the call. count is the number
+					   of changes in effect from here, more
+					   than 1 when a change was made before
+					   the previous one was; value [0] is
+					   then of the last, value [3] from the
+					   first */
+#define RTLSDR_META_BFP		3	/* with each buffer in the BFP8 format,
+					   value [0] samples per block, value [1]
+					   full scale, data the shift of each
+					   block (count bytes, uint8_t). A value
+					   is (byte - 128) << shift */
+#define RTLSDR_META_SILENCE	4	/* the squelch dropped count samples,
+					   from sampleIndex on */
+
+typedef struct rtlsdr_meta {
+	int		type;
+	uint64_t	sampleIndex;
+	uint64_t	count;
+	int32_t		value [4];
+	const void	*data;
+	uint32_t	length;
+} rtlsdr_meta_t;
+
+typedef void(*rtlsdr_meta_cb_t)(const rtlsdr_meta_t *meta, void *ctx);
+
+/*!
+ * Set (or, with cb == NULL, remove) the metadata callback.
+ *
+ * \param dev the device handle given by rtlsdr_open()
+ * \param cb callback function for metadata
+ * \param ctx user specific context to pass via the callback function
+ * \return 0 on success
+ */
+RTLSDR_API int rtlsdr_ext_set_meta_callback(rtlsdr_dev_t *dev,
+					    rtlsdr_meta_cb_t cb,
+					    void *ctx);
+
+/*!
+ * Output formats for read_async, the buffer length remains in bytes.
+ * A new format is taken over at the start of the next buffer.
+ */
+#define RTLSDR_FORMAT_CU8	0	/* the rtlsdr format: 8 bit I/Q,
+					   offset binary */
+#define RTLSDR_FORMAT_MAG16	1	/* uint16 magnitude per sample, a
+					   full scale component is 32768 */
+#define RTLSDR_FORMAT_CS16	2	/* 16 bit I/Q, interleaved */
+#define RTLSDR_FORMAT_CS16_PLANAR 3	/* 16 bit I and Q, in separate
+					   arrays, to the planar callback */
+#define RTLSDR_FORMAT_CF32	4	/* float I/Q, interleaved, full
+					   scale is 1.0 */
+#define RTLSDR_FORMAT_BFP8	5	/* 8 bit I/Q, offset binary, with a
+					   shift per block of samples, see
+					   RTLSDR_META_BFP */
+#define RTLSDR_FORMATS		6
+
+/*!
+ * The 16 bit formats pass the values as the SDRplay delivers them,
+ * with 12 (RSP1, RSP2) or 14 (RSP1A, RSPduo) significant bits.
+ * In the planar format the callback gets the buffers of the library
+ * itself - no copy is made - each time a packet arrives. The buffers
+ * are only valid during the call. The read_async callback is not
+ * called in this format.
+ */
+typedef void(*rtlsdr_planar_cb_t)(const int16_t *i, const int16_t *q,
+				  uint32_t count, void *ctx);
+
+/*!
+ * Set the callback for the planar format, it has to be set before
+ * the format is selected.
+ *
+ * \param dev the device handle given by rtlsdr_open()
+ * \param cb callback function for the samples
+ * \param ctx user specific context to pass via the callback function
+ * \return 0 on success
+ */
+RTLSDR_API int rtlsdr_ext_set_planar_callback(rtlsdr_dev_t *dev,
+					      rtlsdr_planar_cb_t cb,
+					      void *ctx);
+
+/*!
+ * Options for the float format: the samples are multiplied by scale
+ * (default 1.0), with dcRemoval set a running average of the samples
+ * (time constant 0.1 second) is subtracted.
+ *
+ * \param dev the device handle given by rtlsdr_open()
+ * \param scale calibration factor
+ * \param dcRemoval remove the DC component if non-zero
+ * \return 0 on success
+ */
+RTLSDR_API int rtlsdr_ext_set_float_options(rtlsdr_dev_t *dev,
+					    float scale, int dcRemoval);
+
+/*!
+ * Set the format of the samples passed to the read_async callback.
+ *
+ * \param dev the device handle given by rtlsdr_open()
+ * \param format one of the RTLSDR_FORMAT values
+ * \return 0 on success, -1 if the format is not available
+ */
+RTLSDR_API int rtlsdr_ext_set_output_format(rtlsdr_dev_t *dev, int format);
+
+/*!
+ * Record the samples the client gets, as 16 bit I/Q, to a SigMF
+ * recording: <base>.sigmf-data and <base>.sigmf-meta, the latter
+ * with the changes of frequency, rate and gain. The client keeps
+ * getting its samples in the format it selected. Linux only.
+ *
+ * \param dev the device handle given by rtlsdr_open()
+ * \param base path of the recording, without extension, NULL stops
+ * \return 0 on success, -1 on errors
+ */
+RTLSDR_API int rtlsdr_ext_record(rtlsdr_dev_t *dev, const char *base);
+
+/*!
+ * Keep a history of the last seconds of the samples the client gets
+ * (as 16 bit I/Q) in memory, for snapshots. The length is computed
+ * with the current samplerate, so set the history after setting
+ * the samplerate. Linux only.
+ *
+ * \param dev the device handle given by rtlsdr_open()
+ * \param seconds length of the history, 0 to stop keeping one
+ * \param postSeconds the samples recorded after a trigger
+ * \return 0 on success, -1 on errors
+ */
+RTLSDR_API int rtlsdr_ext_set_history(rtlsdr_dev_t *dev,
+				      float seconds, float postSeconds);
+
+/*!
+ * Write the history, and the samples that come in the postSeconds
+ * after the call, as a SigMF recording, with the trigger point as
+ * annotation. Returns immediately, the writing is done by a thread.
+ * One snapshot at the time.
+ *
+ * \param dev the device handle given by rtlsdr_open()
+ * \param base path of the recording, without extension, NULL for
+ *	a name with the time of the trigger
+ * \return 0 on success, -1 without history or while a snapshot
+ *	is being written
+ */
+RTLSDR_API int rtlsdr_ext_snapshot(rtlsdr_dev_t *dev, const char *base);
+
+/*!
+ * A power squelch on the samples of read_async: it opens when the
+ * power is above level for attack msec and closes when it has been
+ * below for hang msec. Buffers filled while it was closed are not
+ * passed, except the ones in the preroll msec before it opens. The
+ * samples dropped are reported with an RTLSDR_META_SILENCE element,
+ * before the next buffer that is passed and at least once a second
+ * while the squelch is closed. sampleIndex counts all samples, the
+ * dropped ones as well. In test mode all buffers are passed.
+ * Switching the squelch on or off and the pre-roll take effect at
+ * the next read_async, level and times at once.
+ *
+ * \param dev the device handle given by rtlsdr_open()
+ * \param level power per component in dBFS, 0 or more for no squelch
+ * \param attack msec above the level before the squelch opens
+ * \param hang msec below the level before the squelch closes
+ * \param preroll msec of samples before the opening that are passed
+ * \return 0 on success
+ */
+RTLSDR_API int rtlsdr_ext_set_squelch(rtlsdr_dev_t *dev, float level,
+				      int attack, int hang, int preroll);
+
+/*!
+ * A bank of narrowband channels, taken from the samples the device
+ * delivers by a polyphase FFT filter bank. The channels are given as
+ * offsets (in Hz) from the center frequency, all with the same
+ * bandwidth. The baseband samples of all channels are passed on in
+ * a single call of the callback: count complex samples (I, Q as float,
+ * in the units of the 16 bit SDRplay samples) for channel 0, then for
+ * channel 1, etc. With a NULL callback for read_async only the
+ * channels are delivered.
+ */
+#define RTLSDR_MAX_BANK_CHANNELS	64
+
+typedef void(*rtlsdr_bank_cb_t)(const float *iq, uint32_t count,
+				uint32_t channels, void *ctx);
+
+/*!
+ * Set (or, with channels == 0, remove) the channel bank.
+ *
+ * \param dev the device handle given by rtlsdr_open()
+ * \param offsets the offsets of the channels in Hz
+ * \param channels the number of channels
+ * \param bandwidth the bandwidth of the channels in Hz
+ * \param cb callback function for the channel samples
+ * \param ctx user specific context to pass via the callback function
+ * \return the samplerate of the channels, -1 on errors
+ */
+RTLSDR_API int rtlsdr_ext_set_channel_bank(rtlsdr_dev_t *dev,
+					   const int32_t *offsets,
+					   uint32_t channels,
+					   uint32_t bandwidth,
+					   rtlsdr_bank_cb_t cb,
+					   void *ctx);
+
+/*!
+ * A spectrum sweep in the style of rtl_power. The range is covered
+ * in steps using the full bandwidth of the SDRplay, the steps are
+ * planned such that the frontend changes band as little as possible.
+ * The power per bin (in dB relative to full scale) is computed in
+ * the library and passed on as a row per step. Successive sweeps go
+ * up and down alternately, step counts the steps from the lowest one.
+ */
+typedef struct rtlsdr_sweep_row {
+	double		frequency;	/* center of the first bin, Hz */
+	double		binWidth;	/* Hz */
+	uint32_t	bins;
+	uint32_t	step;
+	uint32_t	steps;
+	uint32_t	sweep;
+	const float	*power;
+} rtlsdr_sweep_row_t;
+
+typedef void(*rtlsdr_sweep_cb_t)(const rtlsdr_sweep_row_t *row, void *ctx);
+
+/*!
+ * Sweep, blocks until the sweeps are done or rtlsdr_cancel_async()
+ * is called. Not while the device is streaming.
+ *
+ * \param dev the device handle given by rtlsdr_open()
+ * \param start lowest frequency in Hz
+ * \param stop highest frequency in Hz
+ * \param binWidth the requested width of a bin in Hz, the width used
+ *	is the first power of two fraction of the samplerate below it
+ * \param averages the number of FFTs averaged per step
+ * \param sweeps the number of sweeps, 0 for sweeping until cancelled
+ * \param cb callback function for the rows
+ * \param ctx user specific context to pass via the callback function
+ * \return 0 on success, -1 on errors
+ */
+RTLSDR_API int rtlsdr_ext_sweep(rtlsdr_dev_t *dev,
+				uint32_t start, uint32_t stop,
+				uint32_t binWidth, uint32_t averages,
+				uint32_t sweeps,
+				rtlsdr_sweep_cb_t cb, void *ctx);
+
+/*!
+ * Serve the device to rtl_tcp clients, one client at the time.
+ * Blocks until rtlsdr_cancel_async() is called. Commands from
+ * the client are executed by the thread running read_async.
+ * Linux only.
+ *
+ * \param dev the device handle given by rtlsdr_open()
+ * \param address IPv4 address to listen on, NULL for the loopback,
+ *	or the path of a unix socket when it starts with '/'
+ * \param port tcp port
+ * \return 0 after a cancel, -1 on errors
+ */
+RTLSDR_API int rtlsdr_ext_serve_tcp(rtlsdr_dev_t *dev,
+				    const char *address, int port);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __RTL_SDR_EXTENSIONS_H */
@@ -23,12 +23,30 @@
 #include	"resource.h"
 #else
 #include	<unistd.h>
+#include	<signal.h>
 #endif
 #include	<string.h>
+#include	<time.h>
+#include	<math.h>
+#ifdef	__SSE2__
+#include	<emmintrin.h>
+#endif
 #include	<rtl-sdr.h>
+#include	<rtl-sdr_extensions.h>
 #include	"mirsdrapi-rsp.h"
 #include	"signal-queue.h"
 #include	"gains.h"
+#include	"nco.h"
+#include	"channel-bank.h"
+#include	"sweep.h"
+#include	"squelch.h"
+#include	"recorder.h"
+#include	"snapshot.h"
+#include	"replay.h"
+#include	"shared-ring.h"
+#ifndef	__MINGW32__
+#include	"tcp-server.h"
+#endif
 
 //	uncomment __DEBUG__ for lots of output
 #define	__DEBUG__	1
@@ -41,6 +59,85 @@
 #define	MAX_GRdB	59
 #define	MIN_GRdB	20
 
+//	With offset tuning the LO is placed "offset" Hz below the
+//	requested frequency, samples are read at OFFSET_DECIMATION
+//	times the output rate, shifted back and decimated. The DC
+//	component of the zero IF then falls outside the output band.
+//	The offset can be set by the environment variable RTLSDR_OFFSET
+#define	OFFSET_DECIMATION	4
+
+//	Changes in samplerate are handled in one of three ways:
+//	only the software (decimation) stage changes, the SDRplay
+//	samplerate is adjusted with mir_sdr_SetFs, or - the remaining
+//	cases - a full mir_sdr_Reinit. SetFs is meant for corrections
+//	of the rate, as a ppm correction or a client that tracks the
+//	rate of a transmitter makes; it is used for changes up to
+//	FS_FAST_LIMIT (in ppm) that leave the bandwidth unchanged.
+//	Larger steps change the filters of the ADC path as well, they
+//	are left to Reinit.
+//	A frequency within the band is set with mir_sdr_SetRf, for
+//	another band the SDRplay is reinitialized as well.
+#define	UPDATE_SOFTWARE		0
+#define	UPDATE_FS		1
+#define	UPDATE_REINIT		2
+#define	UPDATE_RF		3
+#define	UPDATE_KINDS		4
+#define	FS_FAST_LIMIT		1000
+
+//	The AGC of the bridge regulates the level of the 8 bit output,
+//	rather than the level in the ADC as the SDRplay AGC does.
+//	Power and clipping are measured over AGC_BLOCK msec, the
+//	gain is changed at most once per AGC_INTERVAL msec, and only
+//	when the level is more than AGC_HYSTERESIS dB off target.
+//	With RTLSDR_AGC=hw the SDRplay AGC is used instead
+#define	AGC_BLOCK		20
+#define	AGC_INTERVAL		100
+#define	AGC_TARGET		-16.0
+#define	AGC_HYSTERESIS		3.0
+#define	AGC_MAX_STEP		6
+#define	AGC_CLIP_LIMIT		0.0005
+#define	AGC_TIMEOUT		500
+
+//	With RTLSDR_CHANNELS=N (2 .. MAX_CHANNELS) the first device is
+//	shown as N devices, channels cut out of a wide band that is
+//	read at RTLSDR_WIDEBAND Hz (default WIDEBAND_RATE). Each channel
+//	has its own NCO and decimator, its rate should divide the
+//	wide rate, with at most MAX_CHANNEL_DECIMATION
+#define	MAX_CHANNELS		8
+#define	WIDEBAND_RATE		MHz (8)
+#define	MAX_CHANNEL_DECIMATION	(NCO_MAX_TAPS / 16)
+//
+//	a sweep uses the widest band of the SDRplay
+#define	SWEEP_RATE		MHz (8)
+//
+//	the time constant (in seconds) of the DC removal for the
+//	float format
+#define	DC_TIME			0.1
+//
+//	the number of samples that share a shift in the block floating
+//	point format, the blocks are aligned on the output buffer
+#define	BFP_BLOCK		64
+//
+//	the defaults of the squelch, see squelch.h. A squelch is set
+//	with RTLSDR_SQUELCH=level in dBFS[:attack:hang:pre-roll in msec]
+#define	SQUELCH_ATTACK		5
+#define	SQUELCH_HANG		500
+#define	SQUELCH_PREROLL		100
+//
+//	a buf_len of 0 asks for the default of librtlsdr. A buffer
+//	takes at least one sample of the largest output format (CF32),
+//	the format may change while streaming
+#define	DEFAULT_BUF_LENGTH	(16 * 32 * 512)
+#define	MAX_SAMPLE_SIZE		8
+
+typedef struct {
+	int	count;
+	int	merged;		// made before the previous one was in effect
+	double	last;
+	double	max;
+	double	total;
+} gapStats;
+
 //	defined later on in this file
 static
 char    *sdrplay_errorCodes (mir_sdr_ErrT err);
@@ -49,9 +146,23 @@ static
 mir_sdr_ErrT	re_initialize (rtlsdr_dev_t *dev, int reason);
 static
 mir_sdr_ErrT	handle_gainSetting (rtlsdr_dev_t *dev);
-//	our version of the device descriptor
+static
+int	startStream	(rtlsdr_dev_t *dev);
+static
+int	stopStream	(rtlsdr_dev_t *dev);
+//
+//	our version of the device descriptor. Each rtlsdr_open creates
+//	one, aligned to a cache line. The fields written by the
+//	callback thread are kept on cache lines of their own, apart
+//	from the fields used by the control thread(s)
+#define	CACHE_LINE	64
+#define	HOT		__attribute__ ((aligned (CACHE_LINE)))
+
 struct rtlsdr_dev {
 	int	deviceIndex;
+	int	physIndex;
+	int	tuner;
+	int	channel;	// -1 if not a channel of the wide band
 	int	hwVersion;
 	uint8_t	ppm;
 #ifdef	__SHORT__
@@ -67,6 +178,46 @@ struct rtlsdr_dev {
 	int	old_GRdB;
 	bool	gainMode;
 	bool	agcOn;
+//	the row of the gain table for the current band and the
+//	values last passed on to the SDRplay
+	const gainEntry	*gainMap;
+	int	gainBand;
+	int	appliedLna;
+	int	appliedGRdB;
+	bool	hwAgc;
+//	used in the control loop
+	int	agcSeen;
+	bool	agcWaiting;
+	struct timespec	agcLastStep;
+	rtlsdr_meta_cb_t	metaCallback;
+	void	*metaCtx;
+	rtlsdr_planar_cb_t	planarCallback;
+	void	*planarCtx;
+//	a new channel bank is picked up by the callback thread
+	channelBank	*bankNext;
+	volatile int	bankChange;
+//	set while rtlsdr_ext_sweep runs, the callback only captures
+	sweepState	*sweep;
+//	the output format, taken over by the callback at the start
+//	of a buffer
+	volatile int	formatNext;
+//	the squelch settings, level as power per component in the 8 bit
+//	domain, times in msec. On/off and the pre-roll are taken over
+//	by the next read_async, the others are read by the callback
+	volatile bool	squelchOn;
+	volatile float	squelchLevel;
+	volatile int	squelchAttack;
+	volatile int	squelchHang;
+	int	squelchPreroll;
+	float	floatScale;
+	bool	dcRemoval;
+//	the recording and the history for snapshots, the callback
+//	flags their use with recBusy, rtlsdr_ext_snapshot counts the
+//	triggers in progress in snapBusy
+	recorder	*rec;
+	snapshot	*history;
+	volatile int	recBusy;
+	volatile int	snapBusy;
 //
 //	In this implementation inputRate and outputRate may differ
 //	if the "client" asks for a frequency lower than 2M, we
@@ -75,26 +226,151 @@ struct rtlsdr_dev {
 	int	outputRate;
 	int	frequency;
 	int	bandWidth;
+	bool	offsetTuning;
+	int	offset;
+//	the NCO of offset tuning is (re)initialized in the callback
+//	thread: ncoPending holds the input rate (high word) and the
+//	shift on the grid (low word) until the callback takes them,
+//	the control side uses its own copy of the shift
+	int	ncoShift;
+	volatile uint64_t	ncoPending;
+//	the gap (in msec) between a change and the first packet after it,
+//	the pending update is one word, see startUpdate
+	volatile uint64_t	pendingUpdate;
+	gapStats	gaps [UPDATE_KINDS];
 	rtlsdr_read_async_cb_t callback;
 	void	*ctx;
 	int	buf_num;
 	int	buf_len;
-	int	fbP;
 	bool	running;
 	bool	finished;
+//	set by the callback when the SDRplay library reports the
+//	device is gone, read_async then returns with an error
+	volatile bool	removed;
+//
+//	with "persistent" set, the SDRplay stream stays up after a
+//	cancel_async, samples are dropped until the next read_async
+//	"attaches". With "prestart" the stream is started at open
+	bool	persistent;
+	bool	prestart;
+	bool	streamUp;
+	bool	attached;
+//	set by the callback while it may use the output buffer and
+//	the squelch of an attached device, see detach
+	volatile int	deliverBusy;
+	struct timespec	attachTime;
 	bool	testMode;
-#ifdef	__MINGW32__
-	bool	open;
-	HWND	widgetHandle;
+	signalQueue	commands;
+//	with RTLSDR_SHARED, the output is shared with other processes
+	sharedRing	shared;
+//	set while rtlsdr_ext_serve_tcp runs
+	volatile bool	serving;
+#ifndef	__MINGW32__
+//	the buffers the tcp server may keep, see tcpHold
+	uint8_t	*tcpBuffers [TCP_BUFFERS];
+	volatile int	tcpHeld [TCP_BUFFERS];
+	int	tcpBufferSize;
 #endif
-} devDescriptor;
+//
+//	from here on: written by the callback thread
+	int	fbP	HOT;
+	int	format;
+	float	dcI;
+	float	dcQ;
+	uint8_t	*finalBuffer;
+	int	finalBufferSize;
+//	block floating point: the shift of each block of the buffer,
+//	and the samples of a block that is not complete yet
+	uint8_t	*bfpShift;
+	int16_t	bfpI [BFP_BLOCK];
+	int16_t	bfpQ [BFP_BLOCK];
+//	the squelch: set up by read_async, with the buffers it keeps
+	squelch	*sq;
+	uint64_t	sampleCount;
+	bool	firstSample;
+	double	firstSampleDelay;
+	int16_t	testmode_Counter;
+//	the number the next packet of the library should start with,
+//	a gap means the library lost packets
+	uint32_t	nextSample;
+	bool	sampleSync;
+	uint64_t	lostSamples;
+	int16_t	old_xi;
+	int16_t	old_xq;
+	int	decimator;
+//	a channel: the NCO is (re)initialized in the callback thread
+//	when chanPending is set, the wide band samples are copied
+	volatile int	chanPending;
+	int16_t	*chanI;
+	int16_t	*chanQ;
+	int	chanSize;
+	channelBank	*bank;
+//	measured for the AGC
+	int64_t	agcPower;
+	int	agcClips;
+	int	agcCount;
+	float	agcLevel;
+	float	agcClipRatio;
+	int	agcSeq;
+	ncoState	nco	HOT;
+} HOT;
 
 static
 mir_sdr_DeviceT devDesc [4];
 static
 int	numofDevs	= -1;
+//
+//	the SDRplay library, or a replay of a recording
+static
+sdrBackend	sdr;
+static
+bool	backendSet	= false;
+//
+//	The devices as the rtlsdr clients see them: an RSPduo is
+//	shown as two devices, one for each tuner
+#define	RSP_DUO		3
+typedef struct {
+	int	physIndex;
+	int	tuner;		// 0 if not an RSPduo, else 1 or 2
+	int	channel;	// -1 if not a channel
+	char	name	[64];
+	char	serial	[64];
+} virtualDevice;
+static
+virtualDevice	devMap [MAX_CHANNELS + 2 * 4];
+static
+int	numofVirtual	= 0;
+//
+//	The 2.x SDRplay library handles one device per process,
+//	the device selected with mir_sdr_SetDeviceIdx. The two
+//	tuners of an RSPduo can be opened at the same time, however,
+//	in single tuner mode - the only mode the 2.x library
+//	supports - one of them at the time can stream
+static
+int	selectedPhys	= -1;
 static
-theSignal	*signalQueue	= NULL;
+int	physUsers	= 0;
+static
+rtlsdr_dev_t	*tunerUsers [3]	= {NULL, NULL, NULL};
+static
+rtlsdr_dev_t	*streamOwner	= NULL;
+//
+//	the wide band the channels are taken from. The callback
+//	counts the packets, so a closing channel can wait until
+//	the callback does not use it anymore
+typedef struct {
+	int	channels;
+	int	rate;
+	int	frequency;
+	bool	streamUp;
+	rtlsdr_dev_t	*members [MAX_CHANNELS];
+	volatile uint32_t	packets;
+//	the numbering of the packets of the wide band, see checkGap
+	uint32_t	nextSample;
+	bool	sampleSync;
+} widebandState;
+static
+widebandState	wideband;
 
 #ifdef	__MINGW32__
 static
@@ -102,31 +378,39 @@ pthread_t	thread_id;
 static
 int started	= 0;
 //
+//	the dialog controls the (most recently) opened device
+static
+rtlsdr_dev_t	*dialogDevice	= NULL;
+static
+HWND	widgetHandle	= NULL;
+static
+bool	dialogOpen	= false;
+//
 //	These functions will be called in the W32
 //	version, directly from handling the widget
 //
 bool	set_lnaState (int state) {
 int *lnaTable;
 
-	switch (devDescriptor. hwVersion) {
+	switch (dialogDevice -> hwVersion) {
 	   case 1:	// "old" RSP1
-	      lnaTable = getTable_RSP1 (devDescriptor. frequency);
+	      lnaTable = getTable_RSP1 (dialogDevice -> frequency);
 	      break;
 
 	   case 2:	// RSP2
-	      lnaTable = getTable_RSP2 (devDescriptor. frequency);
+	      lnaTable = getTable_RSP2 (dialogDevice -> frequency);
 	      break;
 
 	   case 3:	// RSP1A end duo
-	      lnaTable = getTable_RSP1a (devDescriptor. frequency);
+	      lnaTable = getTable_RSP1a (dialogDevice -> frequency);
 	      break;
 
 	}
 
 	if ((0 < state) && (state <= lnaTable [0])) {
-	   devDescriptor. lnaState = state;
-	   mir_sdr_RSP_SetGr (devDescriptor. GRdB,
-	                      devDescriptor. lnaState - 1, 1, 0);
+	   dialogDevice -> lnaState = state;
+	   sdr. RSP_SetGr (dialogDevice -> GRdB,
+	                      dialogDevice -> lnaState - 1, 1, 0);
 	   return true;
 	}
 	return false;
@@ -134,20 +418,20 @@ int *lnaTable;
 //
 //	The caller will check the boundaries
 void	set_GRdB (int GRdB) {
-	devDescriptor. GRdB = GRdB;
-	mir_sdr_RSP_SetGr (devDescriptor. GRdB,
-	                   devDescriptor. lnaState - 1, 1, 0);
+	dialogDevice -> GRdB = GRdB;
+	sdr. RSP_SetGr (dialogDevice -> GRdB,
+	                   dialogDevice -> lnaState - 1, 1, 0);
 }
 
 void	set_agc	(bool on) {
 mir_sdr_ErrT err;
 
-	devDescriptor. agcOn	= on;
-	err = mir_sdr_AgcControl (on ?
+	dialogDevice -> agcOn	= on;
+	err = sdr. AgcControl (on ?
 	                          mir_sdr_AGC_100HZ :
 	                          mir_sdr_AGC_DISABLE,
-	                          -devDescriptor. GRdB,
-	                          0, 0, 0, 0, devDescriptor. lnaState - 1);
+	                          -dialogDevice -> GRdB,
+	                          0, 0, 0, 0, dialogDevice -> lnaState - 1);
 	if (err != mir_sdr_Success) {
 	   fprintf (stderr,
 	            "Error %s on mir_sdr_AgcControl\n", sdrplay_errorCodes (err));
@@ -169,7 +453,7 @@ int		newVal;
 	switch (uMsg) {
 	   case WM_INITDIALOG:
 	      SetDlgItemInt (hwndDlg, IDC_LNA_STATE, 
-	                          devDescriptor. lna_startState, FALSE);
+	                          dialogDevice -> lna_startState, FALSE);
 	      SetDlgItemInt (hwndDlg, IDC_GRdB, MIN_GRdB, FALSE);
 	      return true;
 
@@ -178,20 +462,20 @@ int		newVal;
 	         case IDOK:
 	         case IDCANCEL:
 	            fprintf (stderr, "about to delete through id/cancel\n");
-	            if (devDescriptor. widgetHandle != NULL)
-	               DestroyWindow (devDescriptor. widgetHandle);
-	            devDescriptor. widgetHandle = NULL;
+	            if (widgetHandle != NULL)
+	               DestroyWindow (widgetHandle);
+	            widgetHandle = NULL;
 	            return true;;
 
 	         case IDC_LNA_STATE:
 	            newVal = GetDlgItemInt (hwndDlg, IDC_LNA_STATE,
 	                                         &success, FALSE);
 	            if (set_lnaState (newVal)) 
-	               devDescriptor. old_lnaState = newVal;
+	               dialogDevice -> old_lnaState = newVal;
 	            else
 	               SetDlgItemInt (hwndDlg,
 	                              IDC_LNA_STATE,
-	                              devDescriptor. old_lnaState, FALSE);
+	                              dialogDevice -> old_lnaState, FALSE);
 	             break;
 
 	         case IDC_GRdB:
@@ -199,10 +483,10 @@ int		newVal;
 	                                         &success, FALSE);
 	            if ((newVal < MIN_GRdB) || (newVal > MAX_GRdB))
 	               SetDlgItemInt (hwndDlg, IDC_GRdB,
-	                              devDescriptor. old_GRdB, FALSE);
+	                              dialogDevice -> old_GRdB, FALSE);
 	            else {
 	               set_GRdB (newVal);
-	               devDescriptor. old_GRdB = newVal;
+	               dialogDevice -> old_GRdB = newVal;
 	            }
 	            break;
 
@@ -221,12 +505,11 @@ int		newVal;
 	            break;
 
 	         case IDC_RESET:
-	            devDescriptor. lnaState	= devDescriptor.
-	                                                   lna_startState;
-	            devDescriptor. GRdB		= MIN_GRdB;
-	            devDescriptor. old_GRdB	= MIN_GRdB;
+	            dialogDevice -> lnaState	= dialogDevice -> lna_startState;
+	            dialogDevice -> GRdB		= MIN_GRdB;
+	            dialogDevice -> old_GRdB	= MIN_GRdB;
 	            SetDlgItemInt (hwndDlg, IDC_LNA_STATE,
-	                           devDescriptor. lna_startState, FALSE);
+	                           dialogDevice -> lna_startState, FALSE);
 	            SetDlgItemInt (hwndDlg, IDC_GRdB, MIN_GRdB, FALSE);
 	            set_GRdB (MIN_GRdB);
 	            SendDlgItemMessage (hwndDlg, IDC_AGC,
@@ -249,25 +532,24 @@ int		newVal;
 
 void	*StartDialog (void * varg) {
 int err;
-	devDescriptor. old_lnaState	= devDescriptor. lna_startState;
-	devDescriptor. old_GRdB		= MIN_GRdB;
-	devDescriptor. lnaState		= devDescriptor. lna_startState;
-	devDescriptor. GRdB		= MIN_GRdB;
+	dialogDevice -> old_lnaState	= dialogDevice -> lna_startState;
+	dialogDevice -> old_GRdB	= MIN_GRdB;
+	dialogDevice -> lnaState	= dialogDevice -> lna_startState;
+	dialogDevice -> GRdB		= MIN_GRdB;
 
-	devDescriptor. widgetHandle =
-	                  CreateDialog (hInstance,
+	widgetHandle =    CreateDialog (hInstance,
                                         MAKEINTRESOURCE (IDD_DIALOG1),
 	                                NULL, Dialog1Proc);
 	err	= GetLastError ();
 	fprintf (stderr, "Last Error = %d\n", err);
 	if (err == 0) {
-	   ShowWindow (devDescriptor. widgetHandle, SW_SHOW);
+	   ShowWindow (widgetHandle, SW_SHOW);
 	   MSG msg;
-	   devDescriptor. open	= true;
-	   while (devDescriptor. open && GetMessage (&msg, NULL, 0, 0)) {
-	      if (!IsWindow (devDescriptor. widgetHandle))
+	   dialogOpen	= true;
+	   while (dialogOpen && GetMessage (&msg, NULL, 0, 0)) {
+	      if (!IsWindow (widgetHandle))
 	         break;
-	      if (IsDialogMessage (devDescriptor. widgetHandle, &msg)) 
+	      if (IsDialogMessage (widgetHandle, &msg)) 
 	         continue;
 	      TranslateMessage (&msg);
 	      DispatchMessage  (&msg);
@@ -284,15 +566,15 @@ INT_PTR ptr;
 	      if (!installDevice ())
 	         return FALSE;
 	      started	= 1;
-	      devDescriptor. widgetHandle	= NULL;
+	      widgetHandle	= NULL;
 	      hInstance	= hModule;
 	      numofDevs	= -1;
 	      return TRUE;
 
 	   case DLL_PROCESS_DETACH:
-	      if (devDescriptor. widgetHandle != NULL)
-	         DestroyWindow (devDescriptor. widgetHandle);
-	       devDescriptor. widgetHandle = NULL;
+	      if (widgetHandle != NULL)
+	         DestroyWindow (widgetHandle);
+	       widgetHandle = NULL;
 	      break;
 
 	   case DLL_THREAD_ATTACH:
@@ -308,20 +590,101 @@ INT_PTR ptr;
 
 #endif
 
+static
+void	mapDevices	(void) {
+int	i, t;
+char	*s	= getenv ("RTLSDR_CHANNELS");
+
+	numofVirtual	= 0;
+	wideband. channels	= s != NULL ? atoi (s) : 0;
+	if (wideband. channels > MAX_CHANNELS)
+	   wideband. channels = MAX_CHANNELS;
+	if (wideband. channels < 2)
+	   wideband. channels = 0;
+	s	= getenv ("RTLSDR_WIDEBAND");
+	wideband. rate	= s != NULL ? atoi (s) : WIDEBAND_RATE;
+	if ((wideband. rate < MHz (2)) || (wideband. rate > MHz (10)))
+	   wideband. rate = WIDEBAND_RATE;
+//
+//	the channels replace the first device
+	for (i = 0; i < wideband. channels; i ++) {
+	   virtualDevice *v = &devMap [numofVirtual ++];
+	   v -> physIndex	= 0;
+	   v -> tuner		= 0;
+	   v -> channel		= i;
+	   snprintf (v -> name, sizeof (v -> name), "%s channel %d",
+	                                       devDesc [0]. DevNm, i);
+	   snprintf (v -> serial, sizeof (v -> serial), "%s-ch%d",
+	                                       devDesc [0]. SerNo, i);
+	}
+
+	for (i = wideband. channels > 0 ? 1 : 0; i < numofDevs; i ++) {
+	   int tuners	= devDesc [i]. hwVer == RSP_DUO ? 2 : 1;
+	   for (t = 1; t <= tuners; t ++) {
+	      virtualDevice *v = &devMap [numofVirtual ++];
+	      v -> physIndex	= i;
+	      v -> channel	= -1;
+	      v -> tuner	= tuners == 1 ? 0 : t;
+	      if (v -> tuner == 0) {
+	         snprintf (v -> name, sizeof (v -> name), "%s",
+	                                       devDesc [i]. DevNm);
+	         snprintf (v -> serial, sizeof (v -> serial), "%s",
+	                                       devDesc [i]. SerNo);
+	      }
+	      else {
+	         snprintf (v -> name, sizeof (v -> name), "%s tuner %d",
+	                                       devDesc [i]. DevNm, t);
+	         snprintf (v -> serial, sizeof (v -> serial),
+	                                       t == 1 ? "%s" : "%s-%d",
+	                                       devDesc [i]. SerNo, t);
+	      }
+	   }
+	}
+}
+
+static
+bool	setBackend	(void) {
+#ifndef	__MINGW32__
+const char *replayName	= getenv ("RTLSDR_REPLAY");
+	if (replayName != NULL)
+	   return replayInit (replayName, &sdr);
+#endif
+	sdr. ApiVersion		= mir_sdr_ApiVersion;
+	sdr. GetDevices		= mir_sdr_GetDevices;
+	sdr. SetDeviceIdx	= mir_sdr_SetDeviceIdx;
+	sdr. ReleaseDeviceIdx	= mir_sdr_ReleaseDeviceIdx;
+	sdr. rspDuo_TunerSel	= mir_sdr_rspDuo_TunerSel;
+	sdr. StreamInit		= mir_sdr_StreamInit;
+	sdr. StreamUninit	= mir_sdr_StreamUninit;
+	sdr. Reinit		= mir_sdr_Reinit;
+	sdr. SetRf		= mir_sdr_SetRf;
+	sdr. SetFs		= mir_sdr_SetFs;
+	sdr. SetPpm		= mir_sdr_SetPpm;
+	sdr. RSP_SetGr		= mir_sdr_RSP_SetGr;
+	sdr. AgcControl		= mir_sdr_AgcControl;
+	return true;
+}
+
 bool	installDevice () {
 float	ver;
 mir_sdr_ErrT err;
 
-	err	= mir_sdr_ApiVersion (&ver);
+	if (!backendSet) {
+	   if (!setBackend ())
+	      return false;
+	   backendSet	= true;
+	}
+	err	= sdr. ApiVersion (&ver);
 	if (ver < 2.13) {
 	   fprintf (stderr, "please upgrade to sdrplay library to >= 2.13\n");
 	   return false;
 	}
-	err = mir_sdr_GetDevices (devDesc, &numofDevs, (uint32_t)4);
+	err = sdr. GetDevices (devDesc, &numofDevs, (uint32_t)4);
 	if ((err != mir_sdr_Success) || (numofDevs == 0)) {
 	   fprintf (stderr, "Sorry, no device found\n");
 	   return false;
 	}
+	mapDevices ();
 	return true;
 }
 
@@ -335,7 +698,13 @@ int	getBandwidth (int input) {
 	   return mir_sdr_BW_0_600;
 	if (input <= KHz (1536))
 	   return mir_sdr_BW_1_536;
-	return mir_sdr_BW_5_000;
+	if (input <= KHz (5000))
+	   return mir_sdr_BW_5_000;
+	if (input <= KHz (6000))
+	   return mir_sdr_BW_6_000;
+	if (input <= KHz (7000))
+	   return mir_sdr_BW_7_000;
+	return mir_sdr_BW_8_000;
 }
 //
 //	Here we should think on what to do with rates < 2Mhz,
@@ -346,6 +715,190 @@ int	getRate	(int rate) {
 	       rate >= MHz (1) ? 2 * rate : MHz (2);
 }
 
+//
+//	offset tuning requires the input rate to stay within the
+//	range of the SDRplay
+static
+bool	offsetPossible	(int rate) {
+	return (OFFSET_DECIMATION * rate >= MHz (2)) &&
+	       (OFFSET_DECIMATION * rate <= MHz (10));
+}
+
+static
+int	offsetFor	(rtlsdr_dev_t *dev) {
+int	inputRate	= OFFSET_DECIMATION * dev -> outputRate;
+int	shift		= dev -> offset;
+//
+//	the DC component should be outside the output band, the
+//	band itself should fit in the input band
+	if ((shift <= dev -> outputRate / 2) ||
+	    (shift + dev -> outputRate / 2 >= inputRate / 2))
+	   shift = dev -> outputRate / 8 * 7;
+	return ncoGrid (inputRate, shift);
+}
+
+//
+//	the NCO for the current output rate, the callback sees it
+//	before it sees offsetTuning set
+static
+void	offsetSetup	(rtlsdr_dev_t *dev) {
+int	inputRate	= OFFSET_DECIMATION * dev -> outputRate;
+	dev	-> ncoShift	= offsetFor (dev);
+	__atomic_store_n (&dev -> ncoPending,
+	                  ((uint64_t)inputRate << 32) | (uint32_t)dev -> ncoShift,
+	                  __ATOMIC_RELEASE);
+}
+
+static
+int	loFrequency	(rtlsdr_dev_t *dev, int freq) {
+	if (dev -> channel >= 0)
+	   return wideband. frequency;
+	return dev -> offsetTuning ? freq - dev -> ncoShift : freq;
+}
+
+static
+int	hwBandwidth	(rtlsdr_dev_t *dev) {
+int	bw;
+	if (dev -> channel >= 0)
+	   return getBandwidth (wideband. rate);
+	if (!dev -> offsetTuning)
+	   return dev -> bandWidth;
+	bw	= getBandwidth (2 * (dev -> ncoShift + dev -> outputRate / 2));
+	return bw > dev -> bandWidth ? bw : dev -> bandWidth;
+}
+
+static
+double	msecSince	(struct timespec *t0) {
+struct timespec t1;
+	clock_gettime (CLOCK_MONOTONIC, &t1);
+	return (t1. tv_sec - t0 -> tv_sec) * 1000.0 +
+	       (t1. tv_nsec - t0 -> tv_nsec) / 1000000.0;
+}
+//
+//	the change is "pending" until the callback sees the first
+//	packet with the new setting. The callback takes the pending
+//	update as a whole, so it is kept in one word: the kind (plus
+//	one, 0 is "none") in the low 4 bits, the number of changes in
+//	the next 12 and the time of the (first) change in usec, modulo
+//	2^48, in the remaining bits. A change made while another is
+//	pending is counted with it, the gap is then measured from the
+//	first one and the kind is that of the last one.
+#define	UPDATE_KIND(u)		((int)((u) & 0xF) - 1)
+#define	UPDATE_COUNT(u)		((int)(((u) >> 4) & 0xFFF))
+#define	UPDATE_USEC_MASK	0xFFFFFFFFFFFFULL
+
+static
+uint64_t usecOf		(struct timespec *t) {
+	return ((uint64_t)t -> tv_sec * 1000000 + t -> tv_nsec / 1000) &
+	                                               UPDATE_USEC_MASK;
+}
+//
+//	returns the word that was pending before, for cancelUpdate
+static
+uint64_t startUpdate	(rtlsdr_dev_t *dev, struct timespec *t0, int kind) {
+uint64_t old	= __atomic_load_n (&dev -> pendingUpdate, __ATOMIC_RELAXED);
+uint64_t next;
+	do {
+	   int count	= old == 0 ? 1 : UPDATE_COUNT (old) + 1;
+	   if (count > 0xFFF)
+	      count = 0xFFF;
+	   next	= (old == 0 ? usecOf (t0) << 16 : old & ~0xFFFFULL) |
+	                        ((uint64_t)count << 4) | (kind + 1);
+	} while (!__atomic_compare_exchange_n (&dev -> pendingUpdate,
+	                                       &old, next, false,
+	                                       __ATOMIC_RELEASE,
+	                                       __ATOMIC_RELAXED));
+	return old;
+}
+//
+//	the change failed: back to what was pending before, unless
+//	the callback took the update already or another change came
+static
+void	cancelUpdate	(rtlsdr_dev_t *dev, int kind, uint64_t before) {
+uint64_t cur	= __atomic_load_n (&dev -> pendingUpdate, __ATOMIC_RELAXED);
+int	count	= before == 0 ? 1 : UPDATE_COUNT (before) + 1;
+	do {
+	   if ((cur == 0) || (UPDATE_KIND (cur) != kind) ||
+	                     (UPDATE_COUNT (cur) != count))
+	      return;
+	} while (!__atomic_compare_exchange_n (&dev -> pendingUpdate,
+	                                       &cur, before, false,
+	                                       __ATOMIC_RELEASE,
+	                                       __ATOMIC_RELAXED));
+}
+
+//
+//	the packet that ends the update is the first with the new
+//	setting, a client is told with which sample that is
+static
+void	endUpdate	(rtlsdr_dev_t *dev, uint64_t update) {
+int	kind	= UPDATE_KIND (update);
+gapStats *g	= &dev -> gaps [kind];
+struct timespec	t1;
+double	gap;
+
+	clock_gettime (CLOCK_MONOTONIC, &t1);
+	gap	= ((usecOf (&t1) - (update >> 16)) & UPDATE_USEC_MASK) / 1000.0;
+	if (dev -> attached && (dev -> metaCallback != NULL)) {
+	   rtlsdr_meta_t meta;
+	   memset (&meta, 0, sizeof (meta));
+	   meta. type		= RTLSDR_META_TUNE;
+	   meta. sampleIndex	= dev -> sampleCount;
+	   meta. count		= UPDATE_COUNT (update);
+	   meta. value [0]	= kind;
+	   meta. value [1]	= dev -> frequency;
+	   meta. value [2]	= dev -> outputRate;
+	   meta. value [3]	= (int32_t)(gap * 1000);
+	   dev -> metaCallback (&meta, dev -> metaCtx);
+	}
+	g	-> count	+= UPDATE_COUNT (update);
+	g	-> merged	+= UPDATE_COUNT (update) - 1;
+	g	-> last		= gap;
+	g	-> total	+= gap;
+	if (gap > g -> max)
+	   g -> max = gap;
+}
+//
+//	the kind is read once: a change in between is either taken
+//	along or stays pending. A SetFs or SetRf is in effect with the
+//	packet that has the flag for it
+static
+void	checkUpdate	(rtlsdr_dev_t *dev, bool fsChanged, bool rfChanged) {
+uint64_t update	= __atomic_load_n (&dev -> pendingUpdate, __ATOMIC_ACQUIRE);
+int	kind;
+	if (update == 0)
+	   return;
+	kind	= UPDATE_KIND (update);
+	if (((kind == UPDATE_FS) && !fsChanged) ||
+	    ((kind == UPDATE_RF) && !rfChanged))
+	   return;
+	if (__atomic_compare_exchange_n (&dev -> pendingUpdate, &update, 0,
+	                                 false, __ATOMIC_ACQ_REL,
+	                                 __ATOMIC_ACQUIRE))
+	   endUpdate (dev, update);
+}
+
+static
+void	reportUpdates	(rtlsdr_dev_t *dev) {
+static const char *kinds [] = {"software", "SetFs", "Reinit", "SetRf"};
+int	i;
+	for (i = 0; i < UPDATE_KINDS; i ++) {
+	   gapStats *g = &dev -> gaps [i];
+	   if (g -> count == 0)
+	      continue;
+	   fprintf (stderr, "%s updates: %d (%d overlapping), "
+	                    "gap avg %.2f max %.2f msec\n",
+	                     kinds [i], g -> count, g -> merged,
+	                     g -> total / (g -> count - g -> merged), g -> max);
+	}
+}
+
+static
+bool	smallChange	(int oldRate, int newRate) {
+int64_t	d	= newRate > oldRate ? newRate - oldRate : oldRate - newRate;
+	return d * 1000000 <= (int64_t)oldRate * FS_FAST_LIMIT;
+}
+
 static
 int16_t bankFor_sdr (int32_t freq) {
 	if (freq < 12 * MHz (1))
@@ -367,11 +920,57 @@ int16_t bankFor_sdr (int32_t freq) {
 	return -1;
 }
 
+#ifndef	__MINGW32__
+static
+int	applyGain	(rtlsdr_dev_t *dev) {
+mir_sdr_ErrT	err;
+
+//	the channels share the gain, so the last setting may be
+//	from a sibling
+	if ((dev -> lnaState == dev -> appliedLna) &&
+	    (dev -> GRdB == dev -> appliedGRdB) && (dev -> channel < 0))
+	   return 0;
+	err     =  sdr. RSP_SetGr (dev -> GRdB,  dev -> lnaState, 1, 0);
+	if (err != mir_sdr_Success) {
+	   fprintf (stderr, "Error at set_ifgain %s (%d %d)\n",
+	                                sdrplay_errorCodes (err),
+	                                dev -> GRdB, dev -> lnaState);
+	   return -1;
+	}
+	dev	-> appliedLna	= dev -> lnaState;
+	dev	-> appliedGRdB	= dev -> GRdB;
+	return 0;
+}
+//
+//	lna state and GRdB for the gain set by the client
+static
+void	clientGain	(rtlsdr_dev_t *dev) {
+int	gain	= dev -> tunerGain;
+const gainEntry	*e = &dev -> gainMap [gain < 0 ? 0 :
+	                        gain >= GAIN_STEPS ? GAIN_STEPS - 1 : gain];
+	dev	-> lnaState	= e -> lnaState;
+	dev	-> GRdB		= e -> GRdB;
+}
+#endif
+//
+//	the gain mapping depends on the band, only when the
+//	band changes, another row of the table is selected
+static
+void	selectGainMap	(rtlsdr_dev_t *dev) {
+#ifndef	__MINGW32__
+int	band	= gainBand (dev -> hwVersion, dev -> frequency);
+	if ((dev -> gainMap != NULL) && (band == dev -> gainBand))
+	   return;
+	dev	-> gainBand	= band;
+	dev	-> gainMap	= gainRow (dev -> hwVersion, dev -> frequency);
+#endif
+}
+
 RTLSDR_API uint32_t rtlsdr_get_device_count (void) {
 	if ((numofDevs < 0) && !installDevice ()) {
 	   return -1;
 	}
-	return numofDevs;
+	return numofVirtual;
 }
 
 RTLSDR_API const char* rtlsdr_get_device_name (uint32_t devIndex) {
@@ -379,10 +978,10 @@ RTLSDR_API const char* rtlsdr_get_device_name (uint32_t devIndex) {
 	   return " ";
 	}
 
-	if (devIndex < numofDevs) {
+	if (devIndex < numofVirtual) {
 	   fprintf (stderr, "name for %d-th device = %s\n",
-	                       devIndex, devDesc [devIndex]. DevNm);
-	   return devDesc [devIndex]. DevNm;
+	                       devIndex, devMap [devIndex]. name);
+	   return devMap [devIndex]. name;
 	}
 	return " ";
 }
@@ -392,7 +991,10 @@ RTLSDR_API int rtlsdr_get_usb_strings (rtlsdr_dev_t *dev,
 	                               char *manufacturer,
 	                               char *product,
 	                               char *serial) {
-	rtlsdr_get_device_usb_strings (0, manufacturer, product, serial);
+	if (dev == NULL)
+	   return -1;
+	return rtlsdr_get_device_usb_strings (dev -> deviceIndex,
+	                                      manufacturer, product, serial);
 }
 	                    
 RTLSDR_API int rtlsdr_get_device_usb_strings (uint32_t devIndex,
@@ -403,12 +1005,16 @@ RTLSDR_API int rtlsdr_get_device_usb_strings (uint32_t devIndex,
 	   return -1;
 	}
 
-	if (devIndex >= numofDevs)
+	if (devIndex >= numofVirtual)
 	   return -1;
 
-	(void)strcpy (manufacturer, "sdrplay.com");
-	(void)strcpy (product,       devDesc [devIndex]. DevNm);
-	(void)strcpy (serial,        devDesc [devIndex]. SerNo);
+	if (manufacturer != NULL)
+	   (void)strcpy (manufacturer, "sdrplay.com");
+	if (product != NULL)
+	   (void)strcpy (product,       devMap [devIndex]. name);
+	if (serial != NULL)
+	   (void)strcpy (serial,        devMap [devIndex]. serial);
+	return 0;
 }
 
 RTLSDR_API int rtlsdr_get_index_by_serial (const char *serial) {
@@ -418,88 +1024,464 @@ int	i	= 0;
 	   return -1;
 	}
 
-	for (i = 0; i < numofDevs; i ++)
-	   if (strcmp (serial, devDesc [i]. SerNo) == 0)
+	for (i = 0; i < numofVirtual; i ++)
+	   if (strcmp (serial, devMap [i]. serial) == 0)
 	      return i;
 	return -1;
 }
 
-RTLSDR_API int rtlsdr_open (rtlsdr_dev_t **dev,
+static
+rtlsdr_dev_t	*newDevice	(void) {
+void	*p;
+#ifdef	__MINGW32__
+	p	= __mingw_aligned_malloc (sizeof (rtlsdr_dev_t), CACHE_LINE);
+#else
+	if (posix_memalign (&p, CACHE_LINE, sizeof (rtlsdr_dev_t)) != 0)
+	   p = NULL;
+#endif
+	if (p != NULL)
+	   memset (p, 0, sizeof (rtlsdr_dev_t));
+	return (rtlsdr_dev_t *)p;
+}
+
+static
+void	freeDevice	(rtlsdr_dev_t *dev) {
+#ifdef	__MINGW32__
+	__mingw_aligned_free (dev);
+#else
+	free (dev);
+#endif
+}
+//
+//	a reader gets the samples of the producer process, the
+//	settings are the settings of the producer
+static
+bool	isReader	(rtlsdr_dev_t *dev) {
+	return dev -> shared. role == SHARED_READER;
+}
+//
+//	the channels of the wide band share the SDRplay stream
+static
+bool	streaming	(rtlsdr_dev_t *dev) {
+	return dev -> channel >= 0 ? wideband. streamUp : dev -> streamUp;
+}
+
+static
+int	usableBand	(void) {
+int	bw	= KHz (getBandwidth (wideband. rate));
+	return bw < wideband. rate ? bw : wideband. rate;
+}
+
+static
+bool	inBand		(int freq, int rate) {
+	return 2 * abs (freq - wideband. frequency) + rate <= usableBand ();
+}
+
+static
+bool	othersAttached	(rtlsdr_dev_t *dev) {
+int	i;
+	for (i = 0; i < wideband. channels; i ++) {
+	   rtlsdr_dev_t *m = wideband. members [i];
+	   if ((m != NULL) && (m != dev) && m -> attached)
+	      return true;
+	}
+	return false;
+}
+//
+//	the NCO of the channel is reinitialized by the callback
+//	thread, the other channels are not touched
+static
+void	channelUpdate	(rtlsdr_dev_t *dev) {
+struct timespec	t0;
+	clock_gettime (CLOCK_MONOTONIC, &t0);
+	startUpdate (dev, &t0, UPDATE_SOFTWARE);
+	__atomic_store_n (&dev -> chanPending, 1, __ATOMIC_RELEASE);
+}
+//
+//	when the stream starts, the wide band is centered on the
+//	channels that are open
+static
+void	centerWideband	(void) {
+int	lo	= 0;
+int	hi	= 0;
+bool	first	= true;
+int	i;
+	for (i = 0; i < wideband. channels; i ++) {
+	   rtlsdr_dev_t *m = wideband. members [i];
+	   if (m == NULL)
+	      continue;
+	   if (first || (m -> frequency - m -> outputRate / 2 < lo))
+	      lo = m -> frequency - m -> outputRate / 2;
+	   if (first || (m -> frequency + m -> outputRate / 2 > hi))
+	      hi = m -> frequency + m -> outputRate / 2;
+	   first	= false;
+	}
+	if (!first)
+	   wideband. frequency = lo + (hi - lo) / 2;
+}
+//
+//	a channel that is closed waits until the callback is
+//	done with the packet it may be processing
+static
+void	waitPacket	(void) {
+uint32_t	p	= wideband. packets;
+int	i;
+	for (i = 0; wideband. streamUp && (wideband. packets == p) &&
+	                                              (i < 100); i ++)
+#ifdef  __MINGW32__
+	   Sleep (1);
+#else
+	   usleep (1000);
+#endif
+}
+//
+//	retuning a channel within the wide band only changes its
+//	NCO. Outside the band, the band moves along - but only
+//	when no other channel is streaming
+static
+int	channelFrequency	(rtlsdr_dev_t *dev, int freq) {
+int	old	= wideband. frequency;
+mir_sdr_ErrT	err;
+
+	if (wideband. streamUp && !inBand (freq, dev -> outputRate)) {
+	   if (othersAttached (dev)) {
+	      fprintf (stderr, "%d is outside the band (%d +/- %d) of the other channels\n",
+	                        freq, wideband. frequency, usableBand () / 2);
+	      return -1;
+	   }
+	   wideband. frequency	= freq;
+	   if (bankFor_sdr (old) == bankFor_sdr (freq))
+	      err = sdr. SetRf (freq, 1, 0);
+	   else
+	      err = re_initialize (dev, mir_sdr_CHANGE_RF_FREQ);
+	   if (err != mir_sdr_Success) {
+	      wideband. frequency = old;
+	      fprintf (stderr, "Error at frequency setting %s\n",
+	                                   sdrplay_errorCodes (err));
+	      return -1;
+	   }
+	}
+	dev	-> frequency	= freq;
+	selectGainMap (dev);
+	channelUpdate (dev);
+	return 0;
+}
+
+static
+int	channelRate	(rtlsdr_dev_t *dev, int rate) {
+	if ((rate <= 0) || (wideband. rate % rate != 0) ||
+	    (wideband. rate / rate > MAX_CHANNEL_DECIMATION)) {
+	   fprintf (stderr, "rate %d is not the wide band rate %d divided by 1 .. %d\n",
+	                     rate, wideband. rate, MAX_CHANNEL_DECIMATION);
+	   return -1;
+	}
+	dev	-> outputRate	= rate;
+	channelUpdate (dev);
+	return 0;
+}
+
+#ifndef	__MINGW32__
+//
+//	RTLSDR_SHARED enables sharing, its value - if any - is the
+//	size of the ring in MByte
+static
+uint32_t	sharedSize	(void) {
+char	*s	= getenv ("RTLSDR_SHARED");
+int	mb	= s != NULL ? atoi (s) : 0;
+	return mb > 0 ? (uint32_t)mb << 20 : SHARED_DEFAULT_SIZE;
+}
+
+static
+int	openReader	(rtlsdr_dev_t **device,
+	                 uint32_t deviceIndex, sharedRing *ring) {
+rtlsdr_dev_t	*dev	= newDevice ();
+	if (dev == NULL) {
+	   sharedClose (ring);
+	   return -1;
+	}
+	dev	-> deviceIndex	= deviceIndex;
+	dev	-> physIndex	= devMap [deviceIndex]. physIndex;
+	dev	-> tuner	= devMap [deviceIndex]. tuner;
+	dev	-> channel	= -1;
+	dev	-> shared	= *ring;
+	dev	-> finished	= true;
+	dev	-> frequency	= ring -> header -> frequency;
+	dev	-> outputRate	= ring -> header -> sampleRate;
+	fprintf (stderr, "%s is in use by process %d, reading from %s\n",
+	                     devMap [deviceIndex]. name,
+	                     ring -> header -> producer, ring -> name);
+	*device	= dev;
+	return 0;
+}
+//
+//	a full buffer is passed on to the readers, with the
+//	current settings
+static
+void	publish		(rtlsdr_dev_t *ctx) {
+sharedHeader	*h	= ctx -> shared. header;
+	h	-> frequency	= ctx -> frequency;
+	h	-> sampleRate	= ctx -> outputRate;
+	h	-> gain		= ctx -> tunerGain;
+	sharedPublish (&ctx -> shared, ctx -> finalBuffer, ctx -> fbP);
+}
+#endif
+
+#ifndef	__MINGW32__
+//
+//	the recorder is closed when the callback is not using it
+static
+void	stopRecording	(rtlsdr_dev_t *dev) {
+recorder *rec	= __atomic_exchange_n (&dev -> rec, NULL, __ATOMIC_SEQ_CST);
+	if (rec == NULL)
+	   return;
+	while (__atomic_load_n (&dev -> recBusy, __ATOMIC_SEQ_CST))
+	   usleep (100);
+	recClose (rec);
+}
+
+static
+int	startRecording	(rtlsdr_dev_t *dev, const char *base) {
+recorder *rec;
+	stopRecording (dev);
+	rec	= recOpen (base, devMap [dev -> deviceIndex]. name);
+	if (rec == NULL) {
+	   fprintf (stderr, "cannot record to %s\n", base);
+	   return -1;
+	}
+	fprintf (stderr, "recording to %s%s\n", rec -> dataName,
+	                          rec -> direct ? " (O_DIRECT)" : "");
+	__atomic_store_n (&dev -> rec, rec, __ATOMIC_SEQ_CST);
+	return 0;
+}
+//
+//	the history asked for in the environment can be triggered
+//	with SIGUSR1, the handler flags the trigger with signalBusy
+static
+snapshot	*signalTarget	= NULL;
+static
+volatile int	signalBusy	= 0;
+
+static
+void	snapshotHandler	(int sig) {
+snapshot *s;
+	(void)sig;
+	__atomic_add_fetch (&signalBusy, 1, __ATOMIC_SEQ_CST);
+	s	= __atomic_load_n (&signalTarget, __ATOMIC_SEQ_CST);
+	if (s != NULL)
+	   snapTrigger (s, NULL);
+	__atomic_sub_fetch (&signalBusy, 1, __ATOMIC_RELEASE);
+}
+
+static
+void	stopHistory	(rtlsdr_dev_t *dev) {
+snapshot *s	= __atomic_exchange_n (&dev -> history, NULL,
+	                                        __ATOMIC_SEQ_CST);
+snapshot *t	= s;
+	if (s == NULL)
+	   return;
+	__atomic_compare_exchange_n (&signalTarget, &t, NULL, false,
+	                             __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+	while (__atomic_load_n (&dev -> recBusy, __ATOMIC_SEQ_CST) ||
+	       __atomic_load_n (&dev -> snapBusy, __ATOMIC_SEQ_CST) ||
+	       __atomic_load_n (&signalBusy, __ATOMIC_SEQ_CST))
+	   usleep (100);
+	snapFree (s);
+}
+//
+//	the length of the history is in samples at the current rate
+static
+int	startHistory	(rtlsdr_dev_t *dev, float seconds, float post) {
+const char *prefix	= getenv ("RTLSDR_SNAPSHOT");
+snapshot *s;
+	stopHistory (dev);
+	if (seconds <= 0)
+	   return 0;
+	s	= snapCreate ((uint64_t)(seconds * dev -> outputRate),
+	                      (uint64_t)(post * dev -> outputRate),
+	                      devMap [dev -> deviceIndex]. name,
+	                      prefix != NULL ? prefix : "snapshot");
+	if (s == NULL) {
+	   fprintf (stderr, "cannot keep a history of %.1f s\n", seconds);
+	   return -1;
+	}
+	fprintf (stderr, "history of %.1f s, %.1f s after a trigger\n",
+	                                               seconds, post);
+	__atomic_store_n (&dev -> history, s, __ATOMIC_SEQ_CST);
+	return 0;
+}
+#endif
+
+RTLSDR_API int rtlsdr_open (rtlsdr_dev_t **device,
 	                    uint32_t deviceIndex) {
 mir_sdr_ErrT err;
+rtlsdr_dev_t	*dev;
+virtualDevice	*v;
+sharedRing	ring;
 
-#ifdef	MINGW32__
-	devDescriptor. open = false;
-#endif
+	*device	= NULL;
+	ring. role	= SHARED_NONE;
 	if ((numofDevs < 0) && !installDevice ()) {
 	   return -1;
 	}
-	
-	err = mir_sdr_SetDeviceIdx (deviceIndex);
-	if (err != mir_sdr_Success) {
-	   fprintf (stderr, "error at SetDeviceIdx %s \n",
-	                                 sdrplay_errorCodes (err));
+	if (deviceIndex >= numofVirtual)
 	   return -1;
+	v	= &devMap [deviceIndex];
+#ifndef	__MINGW32__
+//
+//	the first process opening the device becomes the producer,
+//	the others read from the ring of the producer
+	if ((getenv ("RTLSDR_SHARED") != NULL) && (selectedPhys < 0)) {
+	   switch (sharedOpen (&ring, v -> serial, sharedSize ())) {
+	      case SHARED_READER:
+	         return openReader (device, deviceIndex, &ring);
+	      case SHARED_PRODUCER:
+	         break;
+	      default:
+	         return -1;
+	   }
+	}
+#endif
+//
+//	the library handles one device at the time, the
+//	second tuner of an RSPduo is the exception
+	if (selectedPhys >= 0) {
+	   if ((selectedPhys != v -> physIndex) ||
+	       ((v -> tuner == 0) && (v -> channel < 0))) {
+	      fprintf (stderr, "device %s is in use, the SDRplay library supports one device per process\n",
+	                                     devDesc [selectedPhys]. DevNm);
+	      return -1;
+	   }
+	   if (v -> channel >= 0 ? wideband. members [v -> channel] != NULL :
+	                           tunerUsers [v -> tuner] != NULL) {
+	      fprintf (stderr, "%s is already open\n", v -> name);
+	      return -1;
+	   }
+	}
+	else {
+	   err = sdr. SetDeviceIdx (v -> physIndex);
+	   if (err != mir_sdr_Success) {
+	      fprintf (stderr, "error at SetDeviceIdx %s \n",
+	                                 sdrplay_errorCodes (err));
+#ifndef	__MINGW32__
+	      sharedClose (&ring);
+#endif
+	      return -1;
+	   }
 	}
 
-	devDescriptor. hwVersion = devDesc [deviceIndex]. hwVer == 1 ? 1 :
-	                           devDesc [deviceIndex]. hwVer == 2 ? 2 : 3;
-	switch (devDescriptor. hwVersion) {
+	dev	= newDevice ();
+	if (dev == NULL) {
+	   if (physUsers == 0)
+	      sdr. ReleaseDeviceIdx ();
+#ifndef	__MINGW32__
+	   sharedClose (&ring);
+#endif
+	   return -1;
+	}
+	dev	-> shared	= ring;
+	selectedPhys	= v -> physIndex;
+	physUsers ++;
+	dev -> physIndex	= v -> physIndex;
+	dev -> tuner		= v -> tuner;
+	dev -> channel		= v -> channel;
+	if (v -> channel >= 0)
+	   wideband. members [v -> channel] = dev;
+	else
+	   tunerUsers [v -> tuner] = dev;
+	dev -> hwVersion = devDesc [v -> physIndex]. hwVer == 1 ? 1 :
+	                   devDesc [v -> physIndex]. hwVer == 2 ? 2 : 3;
+	switch (dev -> hwVersion) {
 	   case 1:
 #ifdef	__SHORT__
-	      devDescriptor. shiftFactor	= 4;
+	      dev -> shiftFactor	= 4;
 #else
-	      devDescriptor. downScale		= 2048.0;
+	      dev -> downScale		= 2048.0;
 #endif
-	      devDescriptor. lna_startState	= 3;
+	      dev -> lna_startState	= 3;
 	      break;
 
 	   case 2:
 #ifdef	__SHORT__
-	      devDescriptor. shiftFactor	= 4;
+	      dev -> shiftFactor	= 4;
 #else
-	      devDescriptor. downScale		= 2048.0;
+	      dev -> downScale		= 2048.0;
 #endif
-	      devDescriptor. lna_startState	= 4;
+	      dev -> lna_startState	= 4;
 	      break;
 
 	   default:		// RSP1A and RSP_DUO
 #ifdef	__SHORT__
-	      devDescriptor. shiftFactor	= 6;
+	      dev -> shiftFactor	= 6;
 #else
-	      devDescriptor. downScale		= 8192.0;
+	      dev -> downScale		= 8192.0;
 #endif
-	      devDescriptor. lna_startState	= 4;
+	      dev -> lna_startState	= 4;
 	      break;
 	}
-	*dev	= &devDescriptor;
-	(*dev) -> deviceIndex	= deviceIndex;
+	dev	-> deviceIndex	= deviceIndex;
 
 //	default values
-	devDescriptor. running		= false;
-	devDescriptor. finished		= true;
-	devDescriptor. GRdB		= 45;
-	devDescriptor. lnaState		= 3;
-	devDescriptor. tunerGain	= 40;
-	devDescriptor. gainMode		= false;
-	devDescriptor. agcOn		= false;
-	devDescriptor. testMode		= false;
-	devDescriptor. inputRate	= 2048000;
-	devDescriptor. outputRate	= 2048000;
-	devDescriptor. frequency	= MHz (220);
-	devDescriptor. ppm		= 0;
-	devDescriptor. deviceIndex	= 0;
-	devDescriptor. bandWidth	= mir_sdr_BW_1_536;
-	signalInit	(&signalQueue);	// create the queue
-#ifdef	__MINGW32__
+	dev -> running		= false;
+	dev -> finished		= true;
+	dev -> GRdB		= 45;
+	dev -> lnaState		= 3;
+	dev -> tunerGain	= 40;
+	dev -> gainMode		= false;
+	dev -> agcOn		= false;
+	dev -> testMode		= false;
+	dev -> inputRate	= 2048000;
+	dev -> outputRate	= 2048000;
+	dev -> frequency	= MHz (220);
+	dev -> ppm		= 0;
+	dev -> bandWidth	= mir_sdr_BW_1_536;
+	dev -> offsetTuning	= false;
+	dev -> pendingUpdate	= 0;
+	dev -> prestart		= getenv ("RTLSDR_PRESTART") != NULL;
+	dev -> persistent	= dev -> prestart ||
+	                          getenv ("RTLSDR_PERSISTENT") != NULL;
+	dev -> streamUp		= false;
+	dev -> attached		= false;
+	dev -> floatScale	= 1.0;
+	dev -> offset		= getenv ("RTLSDR_OFFSET") != NULL ?
+	                          atoi (getenv ("RTLSDR_OFFSET")) : 0;
+	dev -> hwAgc		= (getenv ("RTLSDR_AGC") != NULL) &&
+	                          (strcmp (getenv ("RTLSDR_AGC"), "hw") == 0);
+	dev -> metaCallback	= NULL;
+	if (getenv ("RTLSDR_SQUELCH") != NULL) {
+	   float level	= 0;
+	   int	attack	= SQUELCH_ATTACK;
+	   int	hang	= SQUELCH_HANG;
+	   int	preroll	= SQUELCH_PREROLL;
+	   sscanf (getenv ("RTLSDR_SQUELCH"), "%f:%d:%d:%d",
+	                           &level, &attack, &hang, &preroll);
+	   rtlsdr_ext_set_squelch (dev, level, attack, hang, preroll);
+	}
+	dev -> gainMap		= NULL;
+	dev -> appliedLna	= -1;
+	dev -> appliedGRdB	= -1;
+	if (dev -> channel >= 0) {
+	   dev -> inputRate	= wideband. rate;
+	   dev -> outputRate	= wideband. rate / 4;
+	   dev -> hwAgc		= true;		// the gain is shared
+	   dev -> chanPending	= 1;
+	}
+#ifndef	__MINGW32__
+	gainTablesInit	();
+#endif
+	selectGainMap	(dev);
+	signalInit	(&dev -> commands);	// create the queue
+	*device		= dev;
+#ifdef	__MINGW32__
+	dialogDevice	= dev;
+	dialogOpen	= false;
 	pthread_create (&thread_id, NULL, StartDialog, NULL);
 #endif
+	if (dev -> prestart)
+	   startStream (dev);
+	return 0;
 }
 
 RTLSDR_API int rtlsdr_close (rtlsdr_dev_t *dev) {
-#ifdef	__MINGW32__
-int	nResult	= -1;
-#endif
 	fprintf (stderr, "going to close the device\n");
 	if (dev == NULL)
 	   return -1;
@@ -508,42 +1490,113 @@ int	nResult	= -1;
 	if (dev -> running)
 	   rtlsdr_cancel_async (dev);
 	dev -> running	= false;
+	while (!dev -> finished)
+#ifdef  __MINGW32__
+	   Sleep (1);
+#else
+	   usleep (1000);
+#endif
+#ifndef	__MINGW32__
+	if (isReader (dev)) {
+	   sharedClose (&dev -> shared);
+	   freeDevice (dev);
+	   return 0;
+	}
+	stopRecording (dev);
+	stopHistory (dev);
+#endif
+	if (dev -> channel >= 0) {
+	   wideband. members [dev -> channel] = NULL;
+	   waitPacket ();
+	   if (wideband. streamUp && !othersAttached (NULL))
+	      stopStream (dev);
+	}
+	else
+	if (dev -> streamUp)
+	   stopStream (dev);
+#ifdef	__DEBUG__
+	reportUpdates (dev);
+#endif
 #ifdef __DEBUG__
 	fprintf (stderr, "going to release the device\n");
 #endif
-	mir_sdr_ReleaseDeviceIdx ();
+	if (tunerUsers [dev -> tuner] == dev)
+	   tunerUsers [dev -> tuner]	= NULL;
+	if (-- physUsers == 0) {
+	   sdr. ReleaseDeviceIdx ();
+	   selectedPhys	= -1;
+	}
 #ifdef	__MINGW32__
-	dev	-> open = false;
+	dialogOpen	= false;
 #ifdef	__DEBUG__
 	fprintf (stderr, "close completed\n");
 #endif
 	fprintf (stderr, "about to delete through close\n");
-	if (devDescriptor. widgetHandle != NULL)
-	   DestroyWindow (devDescriptor. widgetHandle);
-	devDescriptor. widgetHandle = NULL;
+	if (widgetHandle != NULL)
+	   DestroyWindow (widgetHandle);
+	widgetHandle = NULL;
+	if (dialogDevice == dev)
+	   dialogDevice = NULL;
 #endif
+#ifndef	__MINGW32__
+	sharedClose (&dev -> shared);
+#endif
+	free (dev -> finalBuffer);
+	free (dev -> bfpShift);
+	squelchFree (dev -> sq);
+	free (dev -> chanI);
+	free (dev -> chanQ);
+	bankFree (dev -> bank);
+	bankFree (dev -> bankNext);
+	ncoFree (&dev -> nco);
+	signalReset (&dev -> commands);
+	freeDevice (dev);
+	return 0;
 }
 
 RTLSDR_API int rtlsdr_set_center_freq (rtlsdr_dev_t *dev,
 	                               uint32_t freq) {
 mir_sdr_ErrT    err;
+struct timespec	t0;
 	if (dev == NULL)
 	   return -1;
+	if (isReader (dev)) {
+	   if (freq != dev -> shared. header -> frequency)
+	      fprintf (stderr, "frequency is set by process %d\n",
+	                               dev -> shared. header -> producer);
+	   return 0;
+	}
+	if (dev -> channel >= 0)
+	   return channelFrequency (dev, freq);
 
-	if (!dev -> running) { 	// record for later use
+	if (!dev -> streamUp) { 	// record for later use
 	   fprintf (stderr, "request for freq %d, while not running\n");
 	   dev -> frequency = freq; 
+	   selectGainMap (dev);
 	}
 	else
-	if (bankFor_sdr (dev -> frequency) == bankFor_sdr (freq)) {
+	if (bankFor_sdr (loFrequency (dev, dev -> frequency)) ==
+	                           bankFor_sdr (loFrequency (dev, freq))) {
 	   fprintf (stderr, "request for freq %d while running\n", freq);
-	   err = mir_sdr_SetRf (freq, 1, 0);
+	   int	oldFreq	= dev -> frequency;
+	   uint64_t before;
+//	set before, the callback may see the change before SetRf returns
+	   clock_gettime (CLOCK_MONOTONIC, &t0);
+	   dev -> frequency = freq;
+	   before = startUpdate (dev, &t0, UPDATE_RF);
+	   err = sdr. SetRf (loFrequency (dev, freq), 1, 0);
 	   if (err == mir_sdr_Success)
-	      dev -> frequency = freq;
+	      selectGainMap (dev);
+	   else {
+	      cancelUpdate (dev, UPDATE_RF, before);
+	      dev -> frequency		= oldFreq;
+	   }
 	   return err == mir_sdr_Success ? 0 : -1;
 	}
 	else {
+	   clock_gettime (CLOCK_MONOTONIC, &t0);
 	   dev -> frequency = freq;
+	   selectGainMap (dev);
 	   fprintf (stderr, "frequency request for %d\n", dev -> frequency);
 	   err = re_initialize (dev, mir_sdr_CHANGE_RF_FREQ);
 	   if (err != mir_sdr_Success) {
@@ -551,6 +1604,7 @@ mir_sdr_ErrT    err;
 	                             sdrplay_errorCodes (err));
 	      return -1;
 	   }
+	   startUpdate (dev, &t0, UPDATE_REINIT);
 	}
 	return 0;
 }
@@ -559,12 +1613,14 @@ RTLSDR_API int rtlsdr_set_freq_correction (rtlsdr_dev_t *dev,
 	                                   int		ppm) {
 	if (dev == NULL)
 	   return -1;
+	if (isReader (dev))
+	   return 0;
 
 	dev -> ppm	= ppm;
 
-	if (!dev -> running)	// will be handled later on
+	if (!streaming (dev))	// will be handled later on
 	   return 0;
-	mir_sdr_SetPpm    ((float)ppm);
+	sdr. SetPpm    ((float)ppm);
 	return 0;
 }
 
@@ -596,53 +1652,43 @@ int	m	= 0;
 	return m;
 }
 
+//
+//	The mapping of gain to lna state and GRdB is precomputed
+//	(see gains.c), the row for the current band is selected
+//	when the frequency changes, so here it is just indexing.
+//	Since clients running their own AGC call this often, the
+//	SDRplay is only addressed when the mapped values change
 RTLSDR_API int rtlsdr_set_tuner_gain (rtlsdr_dev_t *dev, int gain) {
-mir_sdr_ErrT    err;
-int	i;
 #ifdef	__MINGW32__
 	return 0;
 #else
-#ifdef	__DEBUG__
-	fprintf (stderr, "request for gain setting to %d\n", gain);
-#endif
+	if (dev == NULL)
+	   return -1;
+	if (isReader (dev))
+	   return 0;
 
-	for (i = 0; gainTable [i]. Gain != -1; i ++) {
-	   if ((gain >= 10 * gainTable [i]. Gain) &&
-	       ((gainTable [i + 1]. Gain ==  -1) ||
-	                (gain < 10 * gainTable [i + 1]. Gain))) {
-	      gainMapper (dev -> hwVersion,
-	                  dev -> frequency,
-	                  gain,
-	                  &dev -> lnaState,
-		          &dev -> GRdB);
-
-	      if (dev -> GRdB < 20)
-	         dev -> GRdB = 20;
-	      if (dev -> GRdB > 59)
-	         dev -> GRdB = 59;
-#ifdef	__DEBUG__
-	      fprintf (stderr, "for gain %d, we set state %d GRdB %d\n",
-	                                 gain, dev -> lnaState, dev -> GRdB);
-#endif
-	      break;
-	   }
-	}
+//	with the AGC on, the gain is kept for when it is switched off,
+//	lna state and GRdB are those of the AGC
 	dev	-> tunerGain	= gain;
-	if ((dev -> agcOn) || !dev -> running)
+	if (dev -> agcOn)
+	   return 0;
+	clientGain (dev);
+	if (!streaming (dev))
 	   return 0;
 
-	err     =  mir_sdr_RSP_SetGr (dev -> GRdB,  dev -> lnaState, 1, 0);
-	if (err != mir_sdr_Success)
-	   fprintf (stderr, "Error at set_ifgain %s (%d %d)\n",
-	                                sdrplay_errorCodes (err),
-	                                dev -> GRdB, dev -> lnaState);
-	return 0;
+	return applyGain (dev);
 #endif
 }
 
 RTLSDR_API int rtlsdr_set_tuner_bandwidth (rtlsdr_dev_t *dev, uint32_t bw) {
+int	oldBw;
+mir_sdr_ErrT	err;
+struct timespec	t0;
 	if (dev == NULL)
 	   return -1;
+//	the bandwidth of a channel follows from its rate
+	if (isReader (dev) || (dev -> channel >= 0))
+	   return 0;
 
 	if (dev -> outputRate > bw)
 	   bw = dev -> outputRate;
@@ -650,15 +1696,22 @@ RTLSDR_API int rtlsdr_set_tuner_bandwidth (rtlsdr_dev_t *dev, uint32_t bw) {
 	bw	=  getBandwidth (bw);
 	if (bw == dev -> bandWidth)
 	   return 0;
+	oldBw	= hwBandwidth (dev);
 	dev -> bandWidth = bw;	
-	if (dev -> running) {
-	   mir_sdr_ErrT err = re_initialize (dev, mir_sdr_CHANGE_BW_TYPE);
-	   if (err != mir_sdr_Success) {
-	      fprintf (stderr, "ReInit failed %s\n",
-	                                      sdrplay_errorCodes (err));
-	      return -1;
-	   }
+	if (!dev -> streamUp)
+	   return 0;
+	clock_gettime (CLOCK_MONOTONIC, &t0);
+//	e.g. with offset tuning the hardware is already wider
+	if (hwBandwidth (dev) == oldBw) {
+	   startUpdate (dev, &t0, UPDATE_SOFTWARE);
+	   return 0;
+	}
+	err	= re_initialize (dev, mir_sdr_CHANGE_BW_TYPE);
+	if (err != mir_sdr_Success) {
+	   fprintf (stderr, "ReInit failed %s\n", sdrplay_errorCodes (err));
+	   return -1;
 	}
+	startUpdate (dev, &t0, UPDATE_REINIT);
 	return 0;
 }
 
@@ -677,23 +1730,77 @@ RTLSDR_API int rtlsdr_set_tuner_gain_mode (rtlsdr_dev_t *dev, int manual) {
 
 RTLSDR_API int rtlsdr_set_sample_rate (rtlsdr_dev_t *dev,
 	                               uint32_t rate) {
+int	reason;
+int	oldRate, oldBw;
+bool	oldOffset;
+mir_sdr_ErrT	err;
+struct timespec	t0;
 	if (dev == NULL)
 	   return -1;
-	dev	-> inputRate	= getRate (rate);
+	if (isReader (dev)) {
+	   if (rate != dev -> shared. header -> sampleRate)
+	      fprintf (stderr, "samplerate is set by process %d\n",
+	                               dev -> shared. header -> producer);
+	   return 0;
+	}
+	if (dev -> channel >= 0)
+	   return channelRate (dev, rate);
+	clock_gettime (CLOCK_MONOTONIC, &t0);
+//	with offset tuning, LO and bandwidth depend on the rate
+	reason	= dev -> offsetTuning ?
+	             mir_sdr_CHANGE_FS_FREQ | mir_sdr_CHANGE_RF_FREQ |
+	                                      mir_sdr_CHANGE_BW_TYPE :
+	             mir_sdr_CHANGE_FS_FREQ;
+	oldRate		= dev -> inputRate;
+	oldBw		= hwBandwidth (dev);
+	oldOffset	= dev -> offsetTuning;
 	dev	-> outputRate	= rate;
+	if (dev -> offsetTuning) {
+	   __atomic_store_n (&dev -> offsetTuning, false, __ATOMIC_RELEASE);
+	   if (offsetPossible (rate)) {
+	      offsetSetup (dev);
+	      __atomic_store_n (&dev -> offsetTuning, true, __ATOMIC_RELEASE);
+	   }
+	   else
+	      fprintf (stderr, "offset tuning not possible with rate %d\n",
+	                                                          rate);
+	}
+	dev	-> inputRate	= dev -> offsetTuning ?
+	                             OFFSET_DECIMATION * rate : getRate (rate);
 	if (dev -> inputRate < MHz (2)) {
 	   fprintf (stderr, "oops, %d too low to get support\n", 
 	                                                 dev -> inputRate);
 	   return -1;
 	}
-	if (dev -> running) {
-	   mir_sdr_ErrT err = re_initialize (dev, mir_sdr_CHANGE_FS_FREQ);
-	   if (err != mir_sdr_Success) {
-	      fprintf (stderr, "ReInit failed %s\n",
+	if (!dev -> streamUp)
+	   return 0;
+//
+//	the SDRplay rate is unchanged, e.g. 2048000 -> 1024000,
+//	only the decimation in the callback changes
+	if (!oldOffset && !dev -> offsetTuning &&
+	                          (dev -> inputRate == oldRate)) {
+	   startUpdate (dev, &t0, UPDATE_SOFTWARE);
+	   return 0;
+	}
+//
+//	a (relatively) small change, the LO and bandwidth stay
+	if (!oldOffset && !dev -> offsetTuning &&
+	    (hwBandwidth (dev) == oldBw) &&
+	    smallChange (oldRate, dev -> inputRate)) {
+	   uint64_t before = startUpdate (dev, &t0, UPDATE_FS);
+	   err	= sdr. SetFs ((double)(dev -> inputRate), 1, 1, 0);
+	   if (err == mir_sdr_Success)
+	      return 0;
+	   cancelUpdate (dev, UPDATE_FS, before);
+	   fprintf (stderr, "SetFs failed %s, trying Reinit\n",
 	                                      sdrplay_errorCodes (err));
-	      return -1;
-	   }
 	}
+	err	= re_initialize (dev, reason);
+	if (err != mir_sdr_Success) {
+	   fprintf (stderr, "ReInit failed %s\n", sdrplay_errorCodes (err));
+	   return -1;
+	}
+	startUpdate (dev, &t0, UPDATE_REINIT);
 	return 0;
 }
 
@@ -705,18 +1812,30 @@ mir_sdr_ErrT    err;
 #else
 	fprintf (stderr, "switching agc mode to %s\n",
 	                               on == 1 ? "on" : "off");
-	if (dev == NULL)
-	   return -1;
+	if ((dev == NULL) || isReader (dev))
+	   return dev == NULL ? -1 : 0;
 
-	if (dev -> agcOn == on)
+	if (dev -> agcOn == (on != 0))
 	   return 0;
 
-	if (!dev -> running) {		// save for later
-	   dev -> agcOn = on != 0;
+	if (!dev -> hwAgc) {
+	   dev -> agcOn		= on != 0;
+	   dev -> agcWaiting	= false;
+	   if (!dev -> agcOn)	// back to the gain set by the client
+	      rtlsdr_set_tuner_gain (dev, dev -> tunerGain);
 	   return 0;
 	}
 
-	err = mir_sdr_AgcControl (on != 0 ?
+	if (!streaming (dev)) {		// save for later
+	   dev -> agcOn = on != 0;
+	   if (!dev -> agcOn)
+	      rtlsdr_set_tuner_gain (dev, dev -> tunerGain);
+	   return 0;
+	}
+//	switched off, the gain is the one set by the client
+	if (on == 0)
+	   clientGain (dev);
+	err = sdr. AgcControl (on != 0 ?
 	                          mir_sdr_AGC_100HZ :
 	                          mir_sdr_AGC_DISABLE,
 	                          -dev -> GRdB,
@@ -727,10 +1846,223 @@ mir_sdr_ErrT    err;
 	   return -1;
 	}
 	dev -> agcOn	= on != 0;
+//	the AGC has been in control, so the values are not known
+	dev -> appliedLna	= -1;
 	return 0;
 #endif
 }
 
+#ifndef	__MINGW32__
+//
+//	a step of the bridge AGC: the total gain reduction changes
+//	with "step" dB. The lna state is only changed when the
+//	GRdB would get out of range, and then the lowest state
+//	(i.e. the best noise figure) that can do the job is taken
+static
+void	agcSetGain	(rtlsdr_dev_t *dev, int step) {
+int	hw	= dev -> hwVersion;
+int	freq	= dev -> frequency;
+int	states	= lnaStates (hw, freq);
+int	reduction	= lnaReduction (hw, freq, dev -> lnaState) +
+	                                         dev -> GRdB - step;
+int	lna	= dev -> lnaState;
+int	GRdB	= reduction - lnaReduction (hw, freq, lna);
+
+	if ((lna >= states) || (GRdB < MIN_GRdB) || (GRdB > MAX_GRdB)) {
+	   for (lna = 0; lna < states - 1; lna ++)
+	      if (reduction - lnaReduction (hw, freq, lna) <= MAX_GRdB)
+	         break;
+	   GRdB	= reduction - lnaReduction (hw, freq, lna);
+	}
+	if (GRdB < MIN_GRdB)
+	   GRdB = MIN_GRdB;
+	if (GRdB > MAX_GRdB)
+	   GRdB = MAX_GRdB;
+	if ((lna == dev -> lnaState) && (GRdB == dev -> GRdB))
+	   return;		// at the limits
+	dev	-> lnaState	= lna;
+	dev	-> GRdB		= GRdB;
+	dev	-> agcWaiting	= true;
+	clock_gettime (CLOCK_MONOTONIC, &dev -> agcLastStep);
+	applyGain (dev);
+}
+
+static
+void	agcUpdate	(rtlsdr_dev_t *dev) {
+float	level;
+float	error;
+int	step;
+
+	if (!dev -> agcOn || dev -> hwAgc || (dev -> agcSeq == dev -> agcSeen))
+	   return;
+	dev	-> agcSeen	= dev -> agcSeq;
+//
+//	a step is only taken after the previous one is in effect
+	if (dev -> agcWaiting &&
+	    (msecSince (&dev -> agcLastStep) < AGC_TIMEOUT))
+	   return;
+	if (msecSince (&dev -> agcLastStep) < AGC_INTERVAL)
+	   return;
+	level	= 10 * log10f (dev -> agcLevel / (128.0 * 128.0) + 1e-10);
+	error	= level - AGC_TARGET;
+	if (dev -> agcClipRatio > AGC_CLIP_LIMIT)
+	   step	= -AGC_MAX_STEP;
+	else
+	if (fabsf (error) > AGC_HYSTERESIS) {
+	   step	= -(int)lrintf (error);
+	   if (step > AGC_MAX_STEP)
+	      step = AGC_MAX_STEP;
+	   if (step < -AGC_MAX_STEP)
+	      step = -AGC_MAX_STEP;
+	}
+	else
+	   return;
+	agcSetGain (dev, step);
+}
+#endif
+
+//
+//	metadata, e.g. the gain changes of the AGC, go to a
+//	separate callback
+RTLSDR_API int rtlsdr_ext_set_meta_callback (rtlsdr_dev_t *dev,
+	                                     rtlsdr_meta_cb_t cb,
+	                                     void *ctx) {
+	if (dev == NULL)
+	   return -1;
+	dev	-> metaCallback	= NULL;
+	dev	-> metaCtx	= ctx;
+	dev	-> metaCallback	= cb;
+	return 0;
+}
+
+RTLSDR_API int rtlsdr_ext_set_output_format (rtlsdr_dev_t *dev,
+	                                     int format) {
+	if ((dev == NULL) || (format < 0) || (format >= RTLSDR_FORMATS))
+	   return -1;
+//	the ring of a shared device holds the rtlsdr format
+	if (isReader (dev) || (dev -> shared. role == SHARED_PRODUCER))
+	   return format == RTLSDR_FORMAT_CU8 ? 0 : -1;
+	if ((format == RTLSDR_FORMAT_CS16_PLANAR) &&
+	                          (dev -> planarCallback == NULL))
+	   return -1;
+	dev	-> formatNext	= format;
+	return 0;
+}
+
+//
+//	the options are read by the callback thread, a change is in
+//	effect from the next run of samples on
+RTLSDR_API int rtlsdr_ext_set_float_options (rtlsdr_dev_t *dev,
+	                                     float scale, int dcRemoval) {
+	if ((dev == NULL) || !(scale > 0))
+	   return -1;
+	dev	-> floatScale	= scale;
+	if (dcRemoval && !dev -> dcRemoval) {
+	   dev -> dcI	= 0;
+	   dev -> dcQ	= 0;
+	}
+	dev	-> dcRemoval	= dcRemoval != 0;
+	return 0;
+}
+
+//
+//	a level of 0 dBFS or more switches the squelch off
+RTLSDR_API int rtlsdr_ext_set_squelch (rtlsdr_dev_t *dev, float level,
+	                               int attack, int hang, int preroll) {
+	if ((dev == NULL) || isReader (dev) ||
+	    (attack < 0) || (hang < 0) || (preroll < 0))
+	   return -1;
+	dev	-> squelchLevel		= 128.0 * 128.0 * pow (10, level / 10);
+	dev	-> squelchAttack	= attack;
+	dev	-> squelchHang		= hang;
+	dev	-> squelchPreroll	= preroll;
+	dev	-> squelchOn		= level < 0;
+	return 0;
+}
+
+RTLSDR_API int rtlsdr_ext_record (rtlsdr_dev_t *dev, const char *base) {
+	if ((dev == NULL) || isReader (dev))
+	   return -1;
+#ifdef	__MINGW32__
+	return -1;
+#else
+	if (base == NULL) {
+	   stopRecording (dev);
+	   return 0;
+	}
+	return startRecording (dev, base);
+#endif
+}
+
+RTLSDR_API int rtlsdr_ext_set_history (rtlsdr_dev_t *dev,
+	                               float seconds, float postSeconds) {
+	if ((dev == NULL) || isReader (dev) || (postSeconds < 0))
+	   return -1;
+#ifdef	__MINGW32__
+	return -1;
+#else
+	return startHistory (dev, seconds, postSeconds);
+#endif
+}
+
+RTLSDR_API int rtlsdr_ext_snapshot (rtlsdr_dev_t *dev, const char *base) {
+#ifdef	__MINGW32__
+	return -1;
+#else
+snapshot *s;
+int	res	= -1;
+	if (dev == NULL)
+	   return -1;
+	__atomic_add_fetch (&dev -> snapBusy, 1, __ATOMIC_SEQ_CST);
+	s	= __atomic_load_n (&dev -> history, __ATOMIC_SEQ_CST);
+	if (s != NULL)
+	   res	= snapTrigger (s, base);
+	__atomic_sub_fetch (&dev -> snapBusy, 1, __ATOMIC_RELEASE);
+	return res;
+#endif
+}
+
+RTLSDR_API int rtlsdr_ext_set_planar_callback (rtlsdr_dev_t *dev,
+	                                       rtlsdr_planar_cb_t cb,
+	                                       void *ctx) {
+	if (dev == NULL)
+	   return -1;
+	dev	-> planarCallback	= NULL;
+	dev	-> planarCtx		= ctx;
+	dev	-> planarCallback	= cb;
+	return 0;
+}
+
+//
+//	the bank is created here, and handed over to the callback
+//	thread. A bank that was not picked up yet is deleted
+RTLSDR_API int rtlsdr_ext_set_channel_bank (rtlsdr_dev_t *dev,
+	                                    const int32_t *offsets,
+	                                    uint32_t channels,
+	                                    uint32_t bandwidth,
+	                                    rtlsdr_bank_cb_t cb,
+	                                    void *ctx) {
+channelBank	*b	= NULL;
+	if ((dev == NULL) || isReader (dev))
+	   return -1;
+	if (channels > 0) {
+	   b	= bankCreate (dev -> outputRate, offsets, channels,
+	                                      bandwidth, cb, ctx);
+	   if (b == NULL) {
+	      fprintf (stderr, "no channel bank for %d channels of %d Hz\n",
+	                                          channels, bandwidth);
+	      return -1;
+	   }
+#ifdef	__DEBUG__
+	   fprintf (stderr, "channel bank with %d bins, channels at %d Hz\n",
+	                                   b -> bins, b -> outputRate);
+#endif
+	}
+	bankFree (__atomic_exchange_n (&dev -> bankNext, b, __ATOMIC_ACQ_REL));
+	__atomic_store_n (&dev -> bankChange, 1, __ATOMIC_RELEASE);
+	return b != NULL ? b -> outputRate : 0;
+}
+
 /* streaming functions */
 
 RTLSDR_API int rtlsdr_reset_buffer (rtlsdr_dev_t *dev) {
@@ -761,9 +2093,711 @@ RTLSDR_API int rtlsdr_wait_async (rtlsdr_dev_t *dev,
 //	by reading in samples at a rate twice as high and decimating
 //	by averaging subsequent samples.
 
-static  int8_t  *finalBuffer    = NULL;
+//
+//	2:1 decimation by averaging subsequent samples, in place
+static
+int	decimate_2	(rtlsdr_dev_t *ctx, int16_t *xi, int16_t *xq, int n) {
+int	i;
+int	o	= 0;
+
+	for (i = 0; i < n; i ++) {
+	   if (ctx -> decimator != 0) {
+	      ctx -> decimator = 0;
+	      ctx -> old_xi	= xi [i];
+	      ctx -> old_xq	= xq [i];
+	      continue;
+	   }
+	   ctx -> decimator ++;
+	   xi [o] = (xi [i] + ctx -> old_xi) / 2;
+	   xq [o] = (xq [i] + ctx -> old_xq) / 2;
+	   o ++;
+	}
+	return o;
+}
+//
+//	conversion to the 8 bit offset binary rtlsdr format.
+//	Values beyond the 8 bit range are clipped rather than
+//	wrapped around, clipping and power - in the 8 bit domain -
+//	are measured for the AGC
+static
+void	convert_8	(rtlsdr_dev_t *ctx,
+	                 int16_t *xi, int16_t *xq, int n, uint8_t *out) {
+#ifdef	__SHORT__
+int	shiftFactor	= ctx -> shiftFactor;
+#else
+float	scale		= 128.0 / ctx -> downScale;
+#endif
+int	clips	= 0;
+int64_t	power	= 0;
+int	i;
+
+	for (i = 0; i < n; i ++) {
+#ifdef  __SHORT__
+	   int vi	= xi [i] >> shiftFactor;
+	   int vq	= xq [i] >> shiftFactor;
+#else
+	   int vi	= (int)((float)(xi [i]) * scale);
+	   int vq	= (int)((float)(xq [i]) * scale);
+#endif
+	   clips	+= (vi > 127) | (vi < -128) | (vq > 127) | (vq < -128);
+	   vi		= vi > 127 ? 127 : vi < -128 ? -128 : vi;
+	   vq		= vq > 127 ? 127 : vq < -128 ? -128 : vq;
+	   power	+= vi * vi + vq * vq;
+	   out [2 * i]		= vi + 128;
+	   out [2 * i + 1]	= vq + 128;
+	}
+	ctx	-> agcPower	+= power;
+	ctx	-> agcClips	+= clips;
+	ctx	-> agcCount	+= n;
+}
+
+//
+//	the full scale value of the 16 bit samples
+static
+float	fullScale	(rtlsdr_dev_t *ctx) {
+#ifdef	__SHORT__
+	return (float)(128 << ctx -> shiftFactor);
+#else
+	return ctx -> downScale;
+#endif
+}
+//
+//	the magnitude, as ADS-B decoders use it: a full scale component
+//	is 32768, the corners of the I/Q square (up to 46341) still fit.
+//	With SSE2 eight samples at the time, the sqrt is exact in
+//	both paths. Power and clipping are measured in the 16 bit
+//	domain and scaled to the units of the 8 bit path for the AGC
+static
+void	convert_mag16	(rtlsdr_dev_t *ctx,
+	                 int16_t *xi, int16_t *xq, int n, uint8_t *out) {
+uint16_t *mag	= (uint16_t *)out;
+float	fs	= fullScale (ctx);
+float	scale	= 32768.0 / fs;
+float	clipLevel	= fs * fs;
+float	power	= 0;
+int	clips	= 0;
+int	i	= 0;
+#ifdef	__SSE2__
+__m128	vScale	= _mm_set1_ps (scale);
+__m128	vClip	= _mm_set1_ps (clipLevel);
+__m128	vMax	= _mm_set1_ps (65535.0);
+__m128	vPower	= _mm_setzero_ps ();
+__m128i	bias	= _mm_set1_epi32 (32768);
+__m128i	flip	= _mm_set1_epi16 ((short)0x8000);
+float	acc [4];
+
+	for (; i + 8 <= n; i += 8) {
+	   __m128i vi	= _mm_loadu_si128 ((__m128i *)(xi + i));
+	   __m128i vq	= _mm_loadu_si128 ((__m128i *)(xq + i));
+	   __m128  iLo	= _mm_cvtepi32_ps (_mm_srai_epi32 (
+	                                   _mm_unpacklo_epi16 (vi, vi), 16));
+	   __m128  iHi	= _mm_cvtepi32_ps (_mm_srai_epi32 (
+	                                   _mm_unpackhi_epi16 (vi, vi), 16));
+	   __m128  qLo	= _mm_cvtepi32_ps (_mm_srai_epi32 (
+	                                   _mm_unpacklo_epi16 (vq, vq), 16));
+	   __m128  qHi	= _mm_cvtepi32_ps (_mm_srai_epi32 (
+	                                   _mm_unpackhi_epi16 (vq, vq), 16));
+	   __m128  pLo	= _mm_add_ps (_mm_mul_ps (iLo, iLo),
+	                              _mm_mul_ps (qLo, qLo));
+	   __m128  pHi	= _mm_add_ps (_mm_mul_ps (iHi, iHi),
+	                              _mm_mul_ps (qHi, qHi));
+	   __m128i mLo, mHi;
+	   vPower	= _mm_add_ps (vPower, _mm_add_ps (pLo, pHi));
+	   clips	+= __builtin_popcount (
+	                     _mm_movemask_ps (_mm_cmpge_ps (pLo, vClip)) |
+	                     _mm_movemask_ps (_mm_cmpge_ps (pHi, vClip)) << 4);
+//	no unsigned saturating pack in SSE2: pack signed around 32768
+	   mLo	= _mm_sub_epi32 (_mm_cvtps_epi32 (_mm_min_ps (_mm_mul_ps (
+	                          _mm_sqrt_ps (pLo), vScale), vMax)), bias);
+	   mHi	= _mm_sub_epi32 (_mm_cvtps_epi32 (_mm_min_ps (_mm_mul_ps (
+	                          _mm_sqrt_ps (pHi), vScale), vMax)), bias);
+	   _mm_storeu_si128 ((__m128i *)(mag + i),
+	                     _mm_xor_si128 (_mm_packs_epi32 (mLo, mHi), flip));
+	}
+	_mm_storeu_ps (acc, vPower);
+	power	= acc [0] + acc [1] + acc [2] + acc [3];
+#endif
+	for (; i < n; i ++) {
+	   float p	= (float)xi [i] * xi [i] + (float)xq [i] * xq [i];
+	   float m	= sqrtf (p) * scale;
+	   power	+= p;
+	   clips	+= p >= clipLevel;
+	   mag [i]	= m >= 65535 ? 65535 : (uint16_t)lrintf (m);
+	}
+	ctx	-> agcPower	+= (int64_t)(power * (128.0 / fs) * (128.0 / fs));
+	ctx	-> agcClips	+= clips;
+	ctx	-> agcCount	+= n;
+}
+
+//
+//	16 bit I/Q, interleaved, the values as the SDRplay delivers
+//	them. Power and clipping for the AGC are measured in the same
+//	pass, with out == NULL only that is done. With at most 14
+//	significant bits, I^2 + Q^2 fits in the 32 bits of madd
+static
+void	convert_cs16	(rtlsdr_dev_t *ctx,
+	                 int16_t *xi, int16_t *xq, int n, uint8_t *out) {
+int16_t	*iq	= (int16_t *)out;
+float	fs	= fullScale (ctx);
+int32_t	clipLevel	= (int32_t)(fs * fs);
+float	power	= 0;
+int	clips	= 0;
+int	i	= 0;
+#ifdef	__SSE2__
+__m128	vPower	= _mm_setzero_ps ();
+__m128i	vClip	= _mm_set1_epi32 (clipLevel - 1);
+float	acc [4];
+
+	for (; i + 8 <= n; i += 8) {
+	   __m128i vi	= _mm_loadu_si128 ((__m128i *)(xi + i));
+	   __m128i vq	= _mm_loadu_si128 ((__m128i *)(xq + i));
+	   __m128i lo	= _mm_unpacklo_epi16 (vi, vq);
+	   __m128i hi	= _mm_unpackhi_epi16 (vi, vq);
+	   __m128i pLo	= _mm_madd_epi16 (lo, lo);
+	   __m128i pHi	= _mm_madd_epi16 (hi, hi);
+	   if (iq != NULL) {
+	      _mm_storeu_si128 ((__m128i *)(iq + 2 * i), lo);
+	      _mm_storeu_si128 ((__m128i *)(iq + 2 * i + 8), hi);
+	   }
+	   vPower	= _mm_add_ps (vPower,
+	                              _mm_add_ps (_mm_cvtepi32_ps (pLo),
+	                                          _mm_cvtepi32_ps (pHi)));
+	   clips	+= __builtin_popcount (
+	                     _mm_movemask_ps (_mm_castsi128_ps (
+	                                _mm_cmpgt_epi32 (pLo, vClip))) |
+	                     _mm_movemask_ps (_mm_castsi128_ps (
+	                                _mm_cmpgt_epi32 (pHi, vClip))) << 4);
+	}
+	_mm_storeu_ps (acc, vPower);
+	power	= acc [0] + acc [1] + acc [2] + acc [3];
+#endif
+	for (; i < n; i ++) {
+	   int32_t p	= xi [i] * xi [i] + xq [i] * xq [i];
+	   if (iq != NULL) {
+	      iq [2 * i]	= xi [i];
+	      iq [2 * i + 1]	= xq [i];
+	   }
+	   power	+= p;
+	   clips	+= p >= clipLevel;
+	}
+	ctx	-> agcPower	+= (int64_t)(power * (128.0 / fs) * (128.0 / fs));
+	ctx	-> agcClips	+= clips;
+	ctx	-> agcCount	+= n;
+}
+
+//
+//	normalized float I/Q: full scale is 1.0 times the calibration
+//	scale, the DC - if removed - is subtracted in the same pass.
+//	The DC is estimated per run: the mean of the run is folded
+//	into a running average, which is subtracted from the next run
+static
+void	convert_cf32	(rtlsdr_dev_t *ctx,
+	                 int16_t *xi, int16_t *xq, int n, uint8_t *out) {
+float	*iq	= (float *)out;
+float	fs	= fullScale (ctx);
+float	scale	= ctx -> floatScale / fs;
+float	dcI	= ctx -> dcRemoval ? ctx -> dcI : 0;
+float	dcQ	= ctx -> dcRemoval ? ctx -> dcQ : 0;
+float	clipLevel	= fs * fs;
+float	power	= 0;
+float	sumI	= 0;
+float	sumQ	= 0;
+int	clips	= 0;
+int	i	= 0;
+#ifdef	__SSE2__
+__m128	vScale	= _mm_set1_ps (scale);
+__m128	vDcI	= _mm_set1_ps (dcI);
+__m128	vDcQ	= _mm_set1_ps (dcQ);
+__m128	vClip	= _mm_set1_ps (clipLevel);
+__m128	vPower	= _mm_setzero_ps ();
+__m128	vSumI	= _mm_setzero_ps ();
+__m128	vSumQ	= _mm_setzero_ps ();
+float	acc [4];
+
+	for (; i + 8 <= n; i += 8) {
+	   __m128i vi	= _mm_loadu_si128 ((__m128i *)(xi + i));
+	   __m128i vq	= _mm_loadu_si128 ((__m128i *)(xq + i));
+	   __m128  iLo	= _mm_cvtepi32_ps (_mm_srai_epi32 (
+	                                   _mm_unpacklo_epi16 (vi, vi), 16));
+	   __m128  iHi	= _mm_cvtepi32_ps (_mm_srai_epi32 (
+	                                   _mm_unpackhi_epi16 (vi, vi), 16));
+	   __m128  qLo	= _mm_cvtepi32_ps (_mm_srai_epi32 (
+	                                   _mm_unpacklo_epi16 (vq, vq), 16));
+	   __m128  qHi	= _mm_cvtepi32_ps (_mm_srai_epi32 (
+	                                   _mm_unpackhi_epi16 (vq, vq), 16));
+	   __m128  pLo	= _mm_add_ps (_mm_mul_ps (iLo, iLo),
+	                              _mm_mul_ps (qLo, qLo));
+	   __m128  pHi	= _mm_add_ps (_mm_mul_ps (iHi, iHi),
+	                              _mm_mul_ps (qHi, qHi));
+	   vPower	= _mm_add_ps (vPower, _mm_add_ps (pLo, pHi));
+	   clips	+= __builtin_popcount (
+	                     _mm_movemask_ps (_mm_cmpge_ps (pLo, vClip)) |
+	                     _mm_movemask_ps (_mm_cmpge_ps (pHi, vClip)) << 4);
+	   iLo		= _mm_mul_ps (iLo, vScale);
+	   iHi		= _mm_mul_ps (iHi, vScale);
+	   qLo		= _mm_mul_ps (qLo, vScale);
+	   qHi		= _mm_mul_ps (qHi, vScale);
+	   vSumI	= _mm_add_ps (vSumI, _mm_add_ps (iLo, iHi));
+	   vSumQ	= _mm_add_ps (vSumQ, _mm_add_ps (qLo, qHi));
+	   iLo		= _mm_sub_ps (iLo, vDcI);
+	   iHi		= _mm_sub_ps (iHi, vDcI);
+	   qLo		= _mm_sub_ps (qLo, vDcQ);
+	   qHi		= _mm_sub_ps (qHi, vDcQ);
+	   _mm_storeu_ps (iq + 2 * i,      _mm_unpacklo_ps (iLo, qLo));
+	   _mm_storeu_ps (iq + 2 * i + 4,  _mm_unpackhi_ps (iLo, qLo));
+	   _mm_storeu_ps (iq + 2 * i + 8,  _mm_unpacklo_ps (iHi, qHi));
+	   _mm_storeu_ps (iq + 2 * i + 12, _mm_unpackhi_ps (iHi, qHi));
+	}
+	_mm_storeu_ps (acc, vPower);
+	power	= acc [0] + acc [1] + acc [2] + acc [3];
+	_mm_storeu_ps (acc, vSumI);
+	sumI	= acc [0] + acc [1] + acc [2] + acc [3];
+	_mm_storeu_ps (acc, vSumQ);
+	sumQ	= acc [0] + acc [1] + acc [2] + acc [3];
+#endif
+	for (; i < n; i ++) {
+	   float vi	= xi [i];
+	   float vq	= xq [i];
+	   float p	= vi * vi + vq * vq;
+	   power	+= p;
+	   clips	+= p >= clipLevel;
+	   vi		*= scale;
+	   vq		*= scale;
+	   sumI		+= vi;
+	   sumQ		+= vq;
+	   iq [2 * i]		= vi - dcI;
+	   iq [2 * i + 1]	= vq - dcQ;
+	}
+	if (ctx -> dcRemoval && (n > 0)) {
+	   float alpha	= n / (ctx -> outputRate * DC_TIME);
+	   if (alpha > 1)
+	      alpha = 1;
+	   ctx -> dcI	+= alpha * (sumI / n - ctx -> dcI);
+	   ctx -> dcQ	+= alpha * (sumQ / n - ctx -> dcQ);
+	}
+	ctx	-> agcPower	+= (int64_t)(power * (128.0 / fs) * (128.0 / fs));
+	ctx	-> agcClips	+= clips;
+	ctx	-> agcCount	+= n;
+}
+
+//
+//	block floating point: per block of BFP_BLOCK samples the
+//	smallest shift with which the largest component fits in 8
+//	bits, the mantissas are offset binary, as in the rtlsdr
+//	format, (byte - 128) << shift is the value as delivered by
+//	the SDRplay. The shifts go with the buffer, as metadata.
+//	First a pass for the extremes of the block, then one to
+//	shift, round, saturate and interleave
+static
+int	blockShift	(int16_t *xi, int16_t *xq, int n) {
+int	hi	= 0;
+int	lo	= 0;
+int	shift	= 0;
+int	i	= 0;
+#ifdef	__SSE2__
+__m128i	vHi	= _mm_setzero_si128 ();
+__m128i	vLo	= _mm_setzero_si128 ();
+
+	for (; i + 8 <= n; i += 8) {
+	   __m128i vi	= _mm_loadu_si128 ((__m128i *)(xi + i));
+	   __m128i vq	= _mm_loadu_si128 ((__m128i *)(xq + i));
+	   vHi	= _mm_max_epi16 (vHi, _mm_max_epi16 (vi, vq));
+	   vLo	= _mm_min_epi16 (vLo, _mm_min_epi16 (vi, vq));
+	}
+	vHi	= _mm_max_epi16 (vHi, _mm_srli_si128 (vHi, 8));
+	vLo	= _mm_min_epi16 (vLo, _mm_srli_si128 (vLo, 8));
+	vHi	= _mm_max_epi16 (vHi, _mm_srli_si128 (vHi, 4));
+	vLo	= _mm_min_epi16 (vLo, _mm_srli_si128 (vLo, 4));
+	vHi	= _mm_max_epi16 (vHi, _mm_srli_si128 (vHi, 2));
+	vLo	= _mm_min_epi16 (vLo, _mm_srli_si128 (vLo, 2));
+	hi	= (int16_t)_mm_extract_epi16 (vHi, 0);
+	lo	= (int16_t)_mm_extract_epi16 (vLo, 0);
+#endif
+	for (; i < n; i ++) {
+	   if (xi [i] > hi) hi = xi [i];
+	   if (xq [i] > hi) hi = xq [i];
+	   if (xi [i] < lo) lo = xi [i];
+	   if (xq [i] < lo) lo = xq [i];
+	}
+//	the extremes should fit after rounding
+	while ((((hi + (1 << shift) / 2) >> shift) > 127) ||
+	       (((lo + (1 << shift) / 2) >> shift) < -128))
+	   shift ++;
+	return shift;
+}
+
+static
+void	blockWrite	(int16_t *xi, int16_t *xq, int n,
+	                                  int shift, uint8_t *out) {
+int	half	= shift > 0 ? 1 << (shift - 1) : 0;
+int	i	= 0;
+#ifdef	__SSE2__
+__m128i	vHalf	= _mm_set1_epi16 (half);
+__m128i	vShift	= _mm_cvtsi32_si128 (shift);
+__m128i	vOffset	= _mm_set1_epi8 ((char)0x80);
+
+	for (; i + 16 <= n; i += 16) {
+	   __m128i i0 = _mm_sra_epi16 (_mm_adds_epi16 (
+	            _mm_loadu_si128 ((__m128i *)(xi + i)), vHalf), vShift);
+	   __m128i i1 = _mm_sra_epi16 (_mm_adds_epi16 (
+	            _mm_loadu_si128 ((__m128i *)(xi + i + 8)), vHalf), vShift);
+	   __m128i q0 = _mm_sra_epi16 (_mm_adds_epi16 (
+	            _mm_loadu_si128 ((__m128i *)(xq + i)), vHalf), vShift);
+	   __m128i q1 = _mm_sra_epi16 (_mm_adds_epi16 (
+	            _mm_loadu_si128 ((__m128i *)(xq + i + 8)), vHalf), vShift);
+	   __m128i bi	= _mm_packs_epi16 (i0, i1);
+	   __m128i bq	= _mm_packs_epi16 (q0, q1);
+	   _mm_storeu_si128 ((__m128i *)(out + 2 * i),
+	                     _mm_xor_si128 (_mm_unpacklo_epi8 (bi, bq), vOffset));
+	   _mm_storeu_si128 ((__m128i *)(out + 2 * i + 16),
+	                     _mm_xor_si128 (_mm_unpackhi_epi8 (bi, bq), vOffset));
+	}
+#endif
+	for (; i < n; i ++) {
+	   int vi	= (xi [i] + half) >> shift;
+	   int vq	= (xq [i] + half) >> shift;
+	   vi		= vi > 127 ? 127 : vi < -128 ? -128 : vi;
+	   vq		= vq > 127 ? 127 : vq < -128 ? -128 : vq;
+	   out [2 * i]		= vi + 128;
+	   out [2 * i + 1]	= vq + 128;
+	}
+}
+//
+//	a block split over two runs - packets do not follow the
+//	blocks - is kept, when the rest of it arrives the whole
+//	block is written again, with the shift for all of it.
+//	The AGC measures in the 16 bit domain
+static
+void	convert_bfp8	(rtlsdr_dev_t *ctx,
+	                 int16_t *xi, int16_t *xq, int n, uint8_t *out) {
+int	pos	= ctx -> fbP / 2;
+int	i	= 0;
+
+	convert_cs16 (ctx, xi, xq, n, NULL);
+	while (i < n) {
+	   int	inBlock	= (pos + i) % BFP_BLOCK;
+	   int	k	= BFP_BLOCK - inBlock;
+	   uint8_t *start	= out + 2 * (i - inBlock);
+	   int	shift;
+	   if (k > n - i)
+	      k = n - i;
+	   if (k == BFP_BLOCK) {
+	      shift	= blockShift (xi + i, xq + i, k);
+	      blockWrite (xi + i, xq + i, k, shift, start);
+	   }
+	   else {
+	      memcpy (ctx -> bfpI + inBlock, xi + i, k * sizeof (int16_t));
+	      memcpy (ctx -> bfpQ + inBlock, xq + i, k * sizeof (int16_t));
+	      shift	= blockShift (ctx -> bfpI, ctx -> bfpQ, inBlock + k);
+	      blockWrite (ctx -> bfpI, ctx -> bfpQ, inBlock + k, shift, start);
+	   }
+	   ctx -> bfpShift [(pos + i) / BFP_BLOCK] = shift;
+	   i	+= k;
+	}
+}
+
+static
+void	convert_test	(rtlsdr_dev_t *ctx, int n, uint8_t *out) {
+int	i;
+	for (i = 0; i < n; i ++) {
+	   out [i] = ctx -> testmode_Counter;
+	   ctx -> testmode_Counter = (ctx -> testmode_Counter + 1) & 0xFF;
+	}
+}
+
+static
+void	emitMeta	(rtlsdr_dev_t *ctx, rtlsdr_meta_t *meta) {
+	if (ctx -> metaCallback != NULL)
+	   ctx -> metaCallback (meta, ctx -> metaCtx);
+}
+//
+//	The measurements for the AGC are handed over to the
+//	(control) thread running read_async per AGC_BLOCK msec
+static
+void	agcMeasure	(rtlsdr_dev_t *ctx) {
+	if (ctx -> agcCount < ctx -> outputRate / 1000 * AGC_BLOCK)
+	   return;
+	ctx	-> agcLevel	= (float)ctx -> agcPower / (2 * ctx -> agcCount);
+	ctx	-> agcClipRatio	= (float)ctx -> agcClips / ctx -> agcCount;
+	ctx	-> agcPower	= 0;
+	ctx	-> agcClips	= 0;
+	ctx	-> agcCount	= 0;
+	ctx	-> agcSeq ++;
+}
+
+//
+//	the gain in tenth dB, as the rtlsdr API counts
+static
+int	totalGain	(rtlsdr_dev_t *ctx) {
+	return -10 * (ctx -> GRdB + lnaReduction (ctx -> hwVersion,
+	                                          ctx -> frequency,
+	                                          ctx -> lnaState));
+}
+//
+//	the bookkeeping for a packet that goes to a client
+static
+void	startPacket	(rtlsdr_dev_t *ctx, int32_t grChanged) {
+	if (ctx -> firstSample) {
+	   ctx -> firstSampleDelay	= msecSince (&ctx -> attachTime);
+	   ctx -> firstSample	= false;
+	}
+//
+//	a gain change is in effect from this packet on, measurements
+//	with the old gain are discarded and the change is tagged
+	if (grChanged) {
+	   rtlsdr_meta_t meta;
+	   ctx -> agcPower	= 0;
+	   ctx -> agcClips	= 0;
+	   ctx -> agcCount	= 0;
+	   ctx -> agcWaiting	= false;
+	   memset (&meta, 0, sizeof (meta));
+	   meta. type		= RTLSDR_META_GAIN;
+	   meta. sampleIndex	= ctx -> sampleCount;
+	   meta. value [0]	= ctx -> lnaState;
+	   meta. value [1]	= ctx -> GRdB;
+	   meta. value [2]	= totalGain (ctx);
+	   emitMeta (ctx, &meta);
+	}
+}
+//
+//	the samples are converted in runs that fit in the
+//	output buffer, a full buffer is passed on. The bytes per
+//	sample for the output formats
+static
+const int	formatSize [RTLSDR_FORMATS]	= {2, 2, 4, 0, 8, 2};
+//
+//	the shifts of the blocks of a BFP8 buffer, before the buffer
+static
+void	bfpMeta		(rtlsdr_dev_t *ctx, uint8_t *shifts,
+	                 uint64_t index, int samples) {
+rtlsdr_meta_t	meta;
+
+	memset (&meta, 0, sizeof (meta));
+	meta. type		= RTLSDR_META_BFP;
+	meta. sampleIndex	= index;
+	meta. count		= (samples + BFP_BLOCK - 1) / BFP_BLOCK;
+	meta. value [0]		= BFP_BLOCK;
+	meta. value [1]		= (int32_t)fullScale (ctx);
+	meta. data		= shifts;
+	meta. length		= meta. count;
+	emitMeta (ctx, &meta);
+}
+
+static
+void	passBuffer	(void *arg, uint8_t *buffer, int length,
+	                 uint8_t *shifts, uint64_t index) {
+rtlsdr_dev_t *ctx	= (rtlsdr_dev_t *)arg;
+
+	if ((ctx -> format == RTLSDR_FORMAT_BFP8) && !ctx -> testMode)
+	   bfpMeta (ctx, shifts, index, length / 2);
+	ctx -> callback (buffer, length, ctx -> ctx);
+}
+
+static
+void	silenceMeta	(rtlsdr_dev_t *ctx, uint64_t start, uint64_t count) {
+rtlsdr_meta_t	meta;
+
+	memset (&meta, 0, sizeof (meta));
+	meta. type		= RTLSDR_META_SILENCE;
+	meta. sampleIndex	= start;
+	meta. count		= count;
+	emitMeta (ctx, &meta);
+}
+//
+//	the samples dropped are reported, the buffers kept passed on
+static
+void	squelchFlush	(rtlsdr_dev_t *ctx) {
+uint64_t start, count;
+
+	if (squelchSilence (ctx -> sq, &start, &count, 0))
+	   silenceMeta (ctx, start, count);
+	squelchRelease (ctx -> sq, passBuffer, ctx);
+}
+//
+//	at the end of a read_async, with the callback detached: the
+//	kept buffers never saw the squelch open, they are dropped and
+//	the silence up to here is reported, from the thread running
+//	read_async
+static
+void	squelchEnd	(rtlsdr_dev_t *ctx) {
+uint64_t start, count;
+
+	if (ctx -> sq == NULL)
+	   return;
+	squelchDrop (ctx -> sq);
+	if (squelchSilence (ctx -> sq, &start, &count, 0))
+	   silenceMeta (ctx, start, count);
+}
+//
+//	a full buffer goes to the client, unless the squelch was
+//	closed all the time it was filled
+static
+void	flushBuffer	(rtlsdr_dev_t *ctx, int size) {
+squelch	*sq	= ctx -> sq;
+int	samples	= ctx -> fbP / size;
+uint64_t index	= ctx -> sampleCount - samples;
+uint64_t start, count;
+
+	if ((sq == NULL) || !ctx -> squelchOn || ctx -> testMode ||
+	                                      squelchPassing (sq)) {
+	   if (sq != NULL)
+	      squelchFlush (ctx);
+	   passBuffer (ctx, ctx -> finalBuffer, ctx -> fbP,
+	                             ctx -> bfpShift, index);
+	   return;
+	}
+	squelchHold (sq, &ctx -> finalBuffer, &ctx -> bfpShift,
+	                             ctx -> fbP, samples, index);
+	if (squelchSilence (sq, &start, &count,
+	             (uint64_t)ctx -> outputRate * SQUELCH_MARKER_SECONDS))
+	   silenceMeta (ctx, start, count);
+}
+
+static
+void	deliver		(rtlsdr_dev_t *ctx,
+	                 int16_t *xi, int16_t *xq, int numSamples) {
+int	i	= 0;
+int	size;
+recorder *rec;
+snapshot *history;
+
+	if (__atomic_exchange_n (&ctx -> bankChange, 0, __ATOMIC_ACQ_REL)) {
+	   channelBank *b = __atomic_exchange_n (&ctx -> bankNext, NULL,
+	                                                 __ATOMIC_ACQ_REL);
+	   bankFree (ctx -> bank);
+	   ctx -> bank	= b;
+	}
+	if (ctx -> bank != NULL)
+	   bankProcess (ctx -> bank, xi, xq, numSamples);
+#ifndef	__MINGW32__
+	__atomic_store_n (&ctx -> recBusy, 1, __ATOMIC_SEQ_CST);
+	rec	= __atomic_load_n (&ctx -> rec, __ATOMIC_SEQ_CST);
+	if (rec != NULL)
+	   recSamples (rec, xi, xq, numSamples, ctx -> frequency,
+	                        ctx -> outputRate, totalGain (ctx));
+	history	= __atomic_load_n (&ctx -> history, __ATOMIC_SEQ_CST);
+	if (history != NULL)
+	   snapSamples (history, xi, xq, numSamples, ctx -> frequency,
+	                        ctx -> outputRate, totalGain (ctx));
+	__atomic_store_n (&ctx -> recBusy, 0, __ATOMIC_RELEASE);
+#endif
+	if (ctx -> fbP == 0) {
+//	kept buffers are passed on in the format they have
+	   if ((ctx -> format != ctx -> formatNext) && (ctx -> sq != NULL))
+	      squelchFlush (ctx);
+	   ctx -> format = ctx -> formatNext;
+	}
+//
+//	planar: the samples are passed on as they are, without
+//	copying, only the software AGC needs a look at them
+	if (ctx -> format == RTLSDR_FORMAT_CS16_PLANAR) {
+	   if (ctx -> agcOn && !ctx -> hwAgc)
+	      convert_cs16 (ctx, xi, xq, numSamples, NULL);
+	   ctx -> sampleCount	+= numSamples;
+	   if (ctx -> planarCallback != NULL)
+	      ctx -> planarCallback (xi, xq, numSamples, ctx -> planarCtx);
+	   agcMeasure (ctx);
+	   return;
+	}
+//	a client may only want the channels
+	if (ctx -> callback == NULL)
+	   return;
+	size	= formatSize [ctx -> format];
+	while (i < numSamples) {
+	   int	n	= (ctx -> buf_len - ctx -> fbP) / size;
+	   uint8_t *out	= ctx -> finalBuffer + ctx -> fbP;
+	   int64_t power	= ctx -> agcPower;
+	   if (n > numSamples - i)
+	      n = numSamples - i;
+	   if (ctx -> testMode)
+	      convert_test (ctx, n * size, out);
+	   else
+	   switch (ctx -> format) {
+	      case RTLSDR_FORMAT_MAG16:
+	         convert_mag16 (ctx, xi + i, xq + i, n, out);
+	         break;
+	      case RTLSDR_FORMAT_CS16:
+	         convert_cs16 (ctx, xi + i, xq + i, n, out);
+	         break;
+	      case RTLSDR_FORMAT_CF32:
+	         convert_cf32 (ctx, xi + i, xq + i, n, out);
+	         break;
+	      case RTLSDR_FORMAT_BFP8:
+	         convert_bfp8 (ctx, xi + i, xq + i, n, out);
+	         break;
+	      default:		// the normal case
+	         convert_8 (ctx, xi + i, xq + i, n, out);
+	         break;
+	   }
+//	the power of the run, as measured by the conversion
+	   if ((ctx -> sq != NULL) && (n > 0))
+	      squelchUpdate (ctx -> sq,
+	                     (float)(ctx -> agcPower - power) / (2 * n),
+	                     ctx -> squelchLevel, n,
+	                     ctx -> squelchAttack * (ctx -> outputRate / 1000),
+	                     ctx -> squelchHang * (ctx -> outputRate / 1000));
+	   i		+= n;
+	   ctx -> fbP	+= size * n;
+	   ctx -> sampleCount	+= n;
+	   if ((n == 0) || (ctx -> fbP >= ctx -> buf_len)) {
+#ifndef	__MINGW32__
+	      if (ctx -> shared. role == SHARED_PRODUCER)
+	         publish (ctx);
+#endif
+	      flushBuffer (ctx, size);
+	      ctx -> fbP = 0;
+	   }
+	}
+	agcMeasure (ctx);
+}
+
+//
+//	packets the library could not pass on - the callback fell
+//	behind - show as a gap in the sample numbers. The lost
+//	samples are counted and, in test mode, the counter skips the
+//	bytes they would have been, as the counter of an rtlsdr does
+//	when USB transfers are lost. After a reset the numbering
+//	starts over
+static
+void	countLost	(rtlsdr_dev_t *ctx, uint32_t gap, int inputRate) {
+uint64_t lost	= (uint64_t)gap * ctx -> outputRate / inputRate;
+	ctx -> lostSamples	+= lost;
+	if (ctx -> testMode)
+	   ctx -> testmode_Counter = (ctx -> testmode_Counter +
+	                  lost * formatSize [ctx -> format]) & 0xFF;
+}
+
+static
+void	checkGap	(rtlsdr_dev_t *ctx,
+	                 uint32_t first, uint32_t n, uint32_t reset) {
+uint32_t gap	= first - ctx -> nextSample;
+
+	if (ctx -> sampleSync && !reset && ctx -> attached &&
+	                         (gap != 0) && (gap < 0x80000000))
+	   countLost (ctx, gap, ctx -> inputRate);
+	ctx -> nextSample	= first + n;
+	ctx -> sampleSync	= true;
+}
+//
+//	the wide band has one numbering, the loss is counted for each
+//	attached channel, at the rate of that channel
+static
+void	checkWidebandGap (uint32_t first, uint32_t n, uint32_t reset) {
+uint32_t gap	= first - wideband. nextSample;
+int	i;
+
+	if (wideband. sampleSync && !reset &&
+	                         (gap != 0) && (gap < 0x80000000)) {
+	   for (i = 0; i < wideband. channels; i ++) {
+	      rtlsdr_dev_t *ch	= wideband. members [i];
+	      if ((ch != NULL) && ch -> attached)
+	         countLost (ch, gap, wideband. rate);
+	   }
+	}
+	wideband. nextSample	= first + n;
+	wideband. sampleSync	= true;
+}
 
-static	int16_t testmode_Counter	= 0;
 static
 void myStreamCallback (int16_t		*xi,
 	               int16_t		*xq,
@@ -775,54 +2809,102 @@ void myStreamCallback (int16_t		*xi,
 	               uint32_t		reset,
 	               uint32_t		hwRemoved,
 	               void		*cbContext) {
-int	i;
 struct rtlsdr_dev *ctx = (struct rtlsdr_dev *)cbContext;
-static	int16_t	old_xi	= 0;
-static	int16_t	old_xq	= 0;
-#ifdef	__SHORT__
-int	shiftFactor	= ctx -> shiftFactor;
-#else
-int	downScale	= ctx	-> downScale;
-#endif
-static	int	decimator	= 0;
-
-	for (i = 0; i < numSamples; i ++) {
-	   if (ctx -> inputRate > ctx -> outputRate) {
-	      if (decimator != 0) {
-	         decimator = 0;
-	         old_xi	= xi [i];
-	         old_xq	= xq [i];
-	         continue;
-	      }
-	      decimator ++;
-	      xi [i] = (xi [i] + old_xi) / 2;
-	      xq [i] = (xq [i] + old_xq) / 2;
-	   }
-	   if (ctx -> testMode) {
-	      finalBuffer [ctx -> fbP ++] = testmode_Counter;
-	      testmode_Counter = (testmode_Counter + 1) & 0xFF;
-	      finalBuffer [ctx -> fbP ++] = testmode_Counter;
-	      testmode_Counter = (testmode_Counter + 1) & 0xFF;
+bool	offsetTuning	= __atomic_load_n (&ctx -> offsetTuning,
+	                                           __ATOMIC_ACQUIRE);
+uint64_t ncoNext;
+
+	if (hwRemoved) {
+	   fprintf (stderr, "the device is removed\n");
+	   ctx -> removed	= true;
+	   ctx -> running	= false;
+	   return;
+	}
+	checkUpdate (ctx, fsChanged != 0, rfChanged != 0);
+	if (ctx -> sweep != NULL) {
+	   sweepSamples (ctx -> sweep, xi, xq, numSamples, rfChanged != 0);
+	   return;
+	}
+	checkGap (ctx, firstSampleNum, numSamples, reset);
+//
+//	persistent stream, but no client (yet)
+	__atomic_store_n (&ctx -> deliverBusy, 1, __ATOMIC_SEQ_CST);
+	if (!__atomic_load_n (&ctx -> attached, __ATOMIC_SEQ_CST)) {
+	   __atomic_store_n (&ctx -> deliverBusy, 0, __ATOMIC_RELEASE);
+	   return;
+	}
+	startPacket (ctx, grChanged);
+	ncoNext	= __atomic_exchange_n (&ctx -> ncoPending, 0, __ATOMIC_ACQ_REL);
+	if (ncoNext != 0)
+	   ncoInit (&ctx -> nco, (int)(ncoNext >> 32),
+	                         (int32_t)ncoNext, OFFSET_DECIMATION);
+	if (offsetTuning)
+	   numSamples = ncoProcess (&ctx -> nco, xi, xq, numSamples);
+	else
+	if (ctx -> inputRate > ctx -> outputRate)
+	   numSamples = decimate_2 (ctx, xi, xq, numSamples);
+	deliver (ctx, xi, xq, numSamples);
+	__atomic_store_n (&ctx -> deliverBusy, 0, __ATOMIC_RELEASE);
+}
+//
+//	the wide band: each channel that is attached gets a copy
+//	of the samples, shifted and decimated by its own NCO
+static
+void widebandCallback (int16_t		*xi,
+	               int16_t		*xq,
+	               uint32_t		firstSampleNum, 
+	               int32_t		grChanged,
+	               int32_t		rfChanged,
+	               int32_t		fsChanged,
+	               uint32_t		numSamples,
+	               uint32_t		reset,
+	               uint32_t		hwRemoved,
+	               void		*cbContext) {
+int	i;
+	(void)cbContext;
+	if (!hwRemoved)
+	   checkWidebandGap (firstSampleNum, numSamples, reset);
+	for (i = 0; i < wideband. channels; i ++) {
+	   rtlsdr_dev_t *ch	= wideband. members [i];
+	   int	n;
+	   if (ch == NULL)
+	      continue;
+	   if (hwRemoved) {
+	      ch -> removed	= true;
+	      ch -> running	= false;
+	      continue;
 	   }
-	   else {	// the normal case
-	
-#ifdef  __SHORT__
-	      finalBuffer [ctx -> fbP++] = (int8_t)((xi [i] >> shiftFactor) & 0xFF) + 128;
-	      finalBuffer [ctx -> fbP++] = (int8_t)((xq [i] >> shiftFactor) & 0xFF) + 128;
-#else
-	      finalBuffer [ctx -> fbP++] =
-	                      (int8_t)((float)(xi [i]) * 128.0 / downScale) + 128;
-	      finalBuffer [ctx -> fbP++] =
-	                      (int8_t)((float)(xq [i]) * 128.0 / downScale) + 128;
-#endif
+	   checkUpdate (ch, true, true);
+	   __atomic_store_n (&ch -> deliverBusy, 1, __ATOMIC_SEQ_CST);
+	   if (!__atomic_load_n (&ch -> attached, __ATOMIC_SEQ_CST)) {
+	      __atomic_store_n (&ch -> deliverBusy, 0, __ATOMIC_RELEASE);
+	      continue;
 	   }
-	   if (ctx -> fbP >= ctx -> buf_len) {
-	      ctx -> callback (finalBuffer,
-	                       ctx -> buf_len,
-	                       ctx -> ctx);
-	      ctx -> fbP = 0;
+	   if (__atomic_exchange_n (&ch -> chanPending, 0, __ATOMIC_ACQ_REL))
+	      ncoInitChannel (&ch -> nco, wideband. rate,
+	                      ch -> frequency - wideband. frequency,
+	                      wideband. rate / ch -> outputRate);
+	   if (numSamples > ch -> chanSize) {
+	      int16_t *nI = realloc (ch -> chanI, numSamples * sizeof (int16_t));
+	      int16_t *nQ = realloc (ch -> chanQ, numSamples * sizeof (int16_t));
+	      if (nI != NULL)
+	         ch -> chanI = nI;
+	      if (nQ != NULL)
+	         ch -> chanQ = nQ;
+	      if ((nI == NULL) || (nQ == NULL)) {
+	         __atomic_store_n (&ch -> deliverBusy, 0, __ATOMIC_RELEASE);
+	         continue;
+	      }
+	      ch -> chanSize = numSamples;
 	   }
+	   memcpy (ch -> chanI, xi, numSamples * sizeof (int16_t));
+	   memcpy (ch -> chanQ, xq, numSamples * sizeof (int16_t));
+	   startPacket (ch, grChanged);
+	   n	= ncoProcess (&ch -> nco, ch -> chanI, ch -> chanQ, numSamples);
+	   deliver (ch, ch -> chanI, ch -> chanQ, n);
+	   __atomic_store_n (&ch -> deliverBusy, 0, __ATOMIC_RELEASE);
 	}
+	wideband. packets ++;
 }
 
 static
@@ -844,10 +2926,11 @@ int	samplesPerPacket;
 	fprintf (stderr, "re_init with %d %d %d %d\n",
 	                  localGred, dev -> inputRate,
 	                  dev -> frequency, dev -> bandWidth);
-	err = mir_sdr_Reinit (&localGred,
+	err = sdr. Reinit (&localGred,
 	                      ((double) (dev -> inputRate)) / MHz (1),
-	                      ((double) (dev -> frequency)) / MHz (1),
-	                      dev	-> bandWidth,
+	                      ((double) (loFrequency (dev,
+	                                     dev -> frequency))) / MHz (1),
+	                      hwBandwidth (dev),
 	                      mir_sdr_IF_Zero,
 	                      mir_sdr_LO_Undefined,      // LOMode
 	                      dev -> lnaState, 
@@ -855,12 +2938,16 @@ int	samplesPerPacket;
 	                      mir_sdr_USE_RSP_SET_GR,
 	                      &samplesPerPacket,
 	                      reason);
+	if (err == mir_sdr_Success) {
+	   dev -> appliedLna	= dev -> lnaState;
+	   dev -> appliedGRdB	= localGred;
+	}
 	return err;
 }
 
 static
 mir_sdr_ErrT	handle_gainSetting (rtlsdr_dev_t *dev) {
-mir_sdr_ErrT err = mir_sdr_AgcControl (dev -> agcOn ?
+mir_sdr_ErrT err = sdr. AgcControl (dev -> agcOn ?
 	                               mir_sdr_AGC_100HZ :
 	                               mir_sdr_AGC_DISABLE,
 	                               -dev -> GRdB,
@@ -872,7 +2959,7 @@ mir_sdr_ErrT err = mir_sdr_AgcControl (dev -> agcOn ?
 	   return err;
 	}
 	if (!dev -> agcOn) {
-	   err  =  mir_sdr_RSP_SetGr (dev -> GRdB, dev -> lnaState, 1, 0);
+	   err  =  sdr. RSP_SetGr (dev -> GRdB, dev -> lnaState, 1, 0);
 	   if (err != mir_sdr_Success) {
 	      fprintf (stderr,
 	                   "Error at set_ifgain %s (%d %d)\n",
@@ -883,68 +2970,384 @@ mir_sdr_ErrT err = mir_sdr_AgcControl (dev -> agcOn ?
 	return mir_sdr_Success;
 }
 
-//	rtlsdr_read_async is executed in a thread, created by our "client",
-//	Communication to change the status is by simple signaling.
-//	Note that reinit and Uninit better be done in the same thread
-//	therefore, we choose to have all Reinits done in the 
-//	thread executing the read_async
 //
-RTLSDR_API int rtlsdr_read_async(rtlsdr_dev_t *dev,
-				 rtlsdr_read_async_cb_t cb,
-				 void	*ctx,
-				 uint32_t buf_num,
-				 uint32_t buf_len) {
+//	starting and stopping the SDRplay stream is separated from
+//	read_async, with a persistent stream the stream stays up
+//	between a cancel_async and the next read_async
+static
+int	startStream	(rtlsdr_dev_t *dev) {
 int     gRdBSystem;
 int     samplesPerPacket;
 mir_sdr_ErrT    err;
 int     localGRed;
 
-	if (dev == NULL)
-	   return -1;
-
-	if (dev -> running)
-	   return -1;
-
 //	just to prevent errors from streamInit
 	if (dev -> inputRate < 2000000)
 	   return -1;
+	if ((streamOwner != NULL) && (streamOwner != dev) &&
+	                                      (dev -> channel < 0)) {
+	   fprintf (stderr, "tuner %d is streaming, in single tuner mode one tuner at the time can stream\n",
+	                                          streamOwner -> tuner);
+	   return -1;
+	}
+	if (dev -> tuner != 0) {
+	   err = sdr. rspDuo_TunerSel (dev -> tuner == 1 ?
+	                                     mir_sdr_rspDuo_Tuner_1 :
+	                                     mir_sdr_rspDuo_Tuner_2);
+	   if (err != mir_sdr_Success) {
+	      fprintf (stderr, "Error %s on selecting tuner %d\n",
+	                            sdrplay_errorCodes (err), dev -> tuner);
+	      return -1;
+	   }
+	}
 	if (dev -> GRdB < 20)
 	   dev -> GRdB = 20;
 	if (dev -> GRdB > 59)
 	   dev -> GRdB = 59;
-	dev	-> finished	= false;
-	dev	-> callback	= cb;
-	dev	-> ctx		= ctx;
-	dev	-> buf_num	= buf_num;
-	dev	-> buf_len	= buf_len;
-	finalBuffer             = malloc (buf_len * sizeof (int8_t));
+	if (dev -> offsetTuning)
+	   ncoReset (&dev -> nco);
+	dev	-> sampleSync	= false;
+	if (dev -> channel >= 0) {
+	   int i;
+	   centerWideband ();
+	   wideband. sampleSync	= false;
+	   for (i = 0; i < wideband. channels; i ++)
+	      if (wideband. members [i] != NULL)
+	         wideband. members [i] -> chanPending = 1;
+	}
 	localGRed		= dev -> GRdB;
 #ifdef	__DEBUG__
 	fprintf (stderr, "StreamInit %d %f %f %d %d %d\n",
 	                  dev -> GRdB,
 	                  (double)(dev -> inputRate) / 1000000.0,
-	                  (double)(dev -> frequency) / 1000000.0,
-	                  dev -> bandWidth,
+	                  (double)(loFrequency (dev, dev -> frequency)) / 1000000.0,
+	                  hwBandwidth (dev),
 	                  dev -> lnaState,
 	                  dev -> GRdB
 	        );
 #endif
-	err	= mir_sdr_StreamInit (&localGRed,
+	err	= sdr. StreamInit (&localGRed,
 	                              ((double)(dev -> inputRate)) / 1000000.0,
-	                              ((double)(dev -> frequency)) / 1000000.0,
-	                              dev -> bandWidth,
+	                              ((double)(loFrequency (dev,
+	                                      dev -> frequency))) / 1000000.0,
+	                              hwBandwidth (dev),
 	                              mir_sdr_IF_Zero,
 	                              dev -> lnaState,
 	                              &gRdBSystem,
 	                              mir_sdr_USE_RSP_SET_GR,
 	                              &samplesPerPacket,
-	                              (mir_sdr_StreamCallback_t)myStreamCallback,
+	                              dev -> channel >= 0 ?
+	                                 (mir_sdr_StreamCallback_t)widebandCallback :
+	                                 (mir_sdr_StreamCallback_t)myStreamCallback,
 	                              (mir_sdr_GainChangeCallback_t)myGainChangeCallback,
 	                              dev);
 	if (err != mir_sdr_Success) {
 	   fprintf (stderr,
 	            "Error %s on streamInit\n", sdrplay_errorCodes (err));
-	   dev -> running = false;
+	   return -1;
+	}
+	if (dev -> channel >= 0)
+	   wideband. streamUp	= true;
+	else
+	   dev -> streamUp	= true;
+	streamOwner		= dev;
+	dev	-> appliedLna	= dev -> lnaState;
+	dev	-> appliedGRdB	= localGRed;
+	err		= sdr. SetPpm    ((float)dev -> ppm);
+	return 0;
+}
+
+static
+int	stopStream	(rtlsdr_dev_t *dev) {
+mir_sdr_ErrT    err;
+
+	fprintf (stderr, "going to un-init\n");
+	dev	-> streamUp	= false;
+	if (dev -> channel >= 0)
+	   wideband. streamUp	= false;
+	if ((streamOwner == dev) || (dev -> channel >= 0))
+	   streamOwner = NULL;
+	err = sdr. StreamUninit ();
+	if (err != mir_sdr_Success) {
+	   fprintf (stderr, "Error at StreamUnInit %s\n",
+	                                sdrplay_errorCodes (err));
+	   return -1;
+	}
+	if (dev -> lostSamples > 0)
+	   fprintf (stderr, "%llu samples were lost\n",
+	                     (unsigned long long)dev -> lostSamples);
+	dev	-> lostSamples	= 0;
+	return 0;
+}
+
+//
+//	Commands put on the queue of the device - e.g. by the tcp
+//	server - are executed here, in the thread running read_async
+static
+void	handleCommands	(rtlsdr_dev_t *dev) {
+int	signal;
+int	value;
+
+	while (trySignalfromQueue (&dev -> commands, &signal, &value)) {
+	   switch (signal) {
+	      case CANCEL_ASYNC:
+	         dev -> running	= false;
+	         break;
+	      case SET_FREQUENCY:
+	         rtlsdr_set_center_freq (dev, (uint32_t)value);
+	         break;
+	      case SET_RATE:
+	         rtlsdr_set_sample_rate (dev, (uint32_t)value);
+	         break;
+	      case SET_BW:
+	         rtlsdr_set_tuner_bandwidth (dev, (uint32_t)value);
+	         break;
+	      case SET_GAIN:
+	         rtlsdr_set_tuner_gain (dev, value);
+	         break;
+	      case SET_GAIN_MODE:
+	         rtlsdr_set_tuner_gain_mode (dev, value);
+	         break;
+	      case SET_AGC:
+	         rtlsdr_set_agc_mode (dev, value);
+	         break;
+	      case SET_PPM:
+	         rtlsdr_set_freq_correction (dev, value);
+	         break;
+	      case SET_OFFSET:
+	         rtlsdr_set_offset_tuning (dev, value);
+	         break;
+	      case SET_TESTMODE:
+	         rtlsdr_set_testmode (dev, value);
+	         break;
+	      default:
+	         break;
+	   }
+	}
+}
+
+#ifndef	__MINGW32__
+//
+//	a reader gets buffers directly from the ring, no copying.
+//	Note that the buffer passed to the callback is read only
+static
+int	readShared	(rtlsdr_dev_t *dev) {
+int	res	= 0;
+	dev	-> running	= true;
+	while (dev -> running) {
+	   const uint8_t *buf = sharedNext (&dev -> shared, dev -> buf_len);
+	   handleCommands (dev);
+	   if (buf == NULL) {
+	      if (!sharedProducerAlive (&dev -> shared)) {
+	         fprintf (stderr, "the producer of %s has gone\n",
+	                                            dev -> shared. name);
+	         res	= -1;
+	         break;
+	      }
+	      usleep (1000);
+	      continue;
+	   }
+	   dev -> callback ((unsigned char *)buf, dev -> buf_len, dev -> ctx);
+	   sharedConsume (&dev -> shared, dev -> buf_len);
+	}
+	dev	-> running	= false;
+	dev	-> finished	= true;
+	return res;
+}
+#endif
+
+#ifndef	__MINGW32__
+//
+//	While serving, the tcp server keeps the buffers passed to it
+//	until the kernel has sent them. The buffer is swapped with a
+//	free one of the pool, as the squelch does with the buffers it
+//	keeps, wherever it came from. The samples of a shared device
+//	are in the ring of the producer, they are copied into the pool,
+//	as are the samples of a finalBuffer of another size than the
+//	buffers of the pool, so every buffer keeps its size.
+//	The pool lives as long as rtlsdr_ext_serve_tcp runs: the
+//	sender may use the buffers after read_async returned
+static
+int	tcpPoolCreate	(rtlsdr_dev_t *dev, int size) {
+int	i;
+	dev	-> tcpBufferSize	= size;
+	for (i = 0; i < TCP_BUFFERS; i ++) {
+	   dev -> tcpBuffers [i]	= (uint8_t *)malloc (size);
+	   dev -> tcpHeld [i]		= 0;
+	   if (dev -> tcpBuffers [i] == NULL)
+	      return -1;
+	}
+	return 0;
+}
+
+static
+void	tcpPoolFree	(rtlsdr_dev_t *dev) {
+int	i;
+	for (i = 0; i < TCP_BUFFERS; i ++) {
+	   free (dev -> tcpBuffers [i]);
+	   dev -> tcpBuffers [i]	= NULL;
+	}
+	dev	-> tcpBufferSize	= 0;
+}
+//
+//	called from the callback, with the buffer it got. For a copy,
+//	*buffer is set to the buffer of the pool
+int	tcpHold		(rtlsdr_dev_t *dev, uint8_t **buffer, uint32_t length) {
+uint8_t	**home	= NULL;
+int	i;
+
+	if ((dev -> tcpBuffers [0] == NULL) ||
+	    (length > (uint32_t)dev -> tcpBufferSize))
+	   return -1;
+	if (dev -> finalBufferSize == dev -> tcpBufferSize) {
+	   if (*buffer == dev -> finalBuffer)
+	      home	= &dev -> finalBuffer;
+	   else
+	   if (dev -> sq != NULL) {
+	      for (i = 0; i < dev -> sq -> slots; i ++)
+	         if (dev -> sq -> buffers [i] == *buffer)
+	            home	= &dev -> sq -> buffers [i];
+	   }
+	}
+	for (i = 0; i < TCP_BUFFERS; i ++) {
+	   if (__atomic_load_n (&dev -> tcpHeld [i], __ATOMIC_ACQUIRE))
+	      continue;
+	   if (home != NULL) {
+	      *home	= dev -> tcpBuffers [i];
+	      dev -> tcpBuffers [i]	= *buffer;
+	   }
+	   else {
+	      memcpy (dev -> tcpBuffers [i], *buffer, length);
+	      *buffer	= dev -> tcpBuffers [i];
+	   }
+	   dev -> tcpHeld [i]	= 1;
+	   return i;
+	}
+	return -1;
+}
+
+void	tcpRelease	(rtlsdr_dev_t *dev, int slot) {
+	__atomic_store_n (&dev -> tcpHeld [slot], 0, __ATOMIC_RELEASE);
+}
+#endif
+//
+//	With a persistent stream the callback keeps running after
+//	read_async returns. It flags with deliverBusy that it may use
+//	the output buffer, the next read_async may only replace that
+//	when the callback has seen that the device is not attached
+static
+void	detach		(rtlsdr_dev_t *dev) {
+	__atomic_store_n (&dev -> attached, false, __ATOMIC_SEQ_CST);
+	while (__atomic_load_n (&dev -> deliverBusy, __ATOMIC_SEQ_CST))
+#ifdef	__MINGW32__
+	   Sleep (0);
+#else
+	   usleep (100);
+#endif
+}
+
+//	rtlsdr_read_async is executed in a thread, created by our "client",
+//	Communication to change the status is by simple signaling.
+//	Note that reinit and Uninit better be done in the same thread
+//	therefore, we choose to have all Reinits done in the 
+//	thread executing the read_async
+//
+RTLSDR_API int rtlsdr_read_async(rtlsdr_dev_t *dev,
+				 rtlsdr_read_async_cb_t cb,
+				 void	*ctx,
+				 uint32_t buf_num,
+				 uint32_t buf_len) {
+	if (dev == NULL)
+	   return -1;
+
+	if (dev -> running || dev -> removed)
+	   return -1;
+	if (buf_len == 0)
+	   buf_len	= DEFAULT_BUF_LENGTH;
+	if (buf_len < MAX_SAMPLE_SIZE) {
+	   fprintf (stderr, "buffer length %u is too small\n", buf_len);
+	   return -1;
+	}
+//	the ring takes buffers up to a quarter of its size, larger
+//	ones would never be published, or never be read
+	if ((dev -> shared. role != SHARED_NONE) &&
+	    (buf_len > dev -> shared. ringSize / 4)) {
+	   fprintf (stderr, "buffer length %u does not fit the shared ring of %u bytes\n",
+	                     buf_len, dev -> shared. ringSize);
+	   return -1;
+	}
+
+	dev	-> finished	= false;
+	dev	-> callback	= cb;
+	dev	-> ctx		= ctx;
+	dev	-> buf_num	= buf_num;
+	dev	-> buf_len	= buf_len;
+#ifndef	__MINGW32__
+	if (isReader (dev))
+	   return readShared (dev);
+#endif
+//
+//	with a persistent stream, the buffer is kept as well
+	if (buf_len > dev -> finalBufferSize) {
+	   free (dev -> finalBuffer);
+	   free (dev -> bfpShift);
+	   dev -> finalBuffer	= malloc (buf_len * sizeof (uint8_t));
+	   dev -> bfpShift	= malloc (buf_len / (2 * BFP_BLOCK) + 1);
+	   dev -> finalBufferSize	= buf_len;
+	}
+//	the squelch keeps the buffers of the pre-roll, in the format
+//	selected now
+	squelchFree (dev -> sq);
+	dev	-> sq		= NULL;
+	if (dev -> squelchOn && (formatSize [dev -> formatNext] > 0)) {
+	   int64_t bytes	= (int64_t)dev -> squelchPreroll *
+	                          dev -> outputRate / 1000 *
+	                          formatSize [dev -> formatNext];
+	   dev -> sq	= squelchCreate ((bytes + buf_len - 1) / buf_len,
+	                                 dev -> finalBufferSize,
+	                                 dev -> finalBufferSize /
+	                                         (2 * BFP_BLOCK) + 1);
+	}
+	dev	-> fbP		= 0;
+	dev	-> sampleCount	= 0;
+	dev	-> agcSeen	= dev -> agcSeq;
+	dev	-> agcWaiting	= false;
+	dev	-> firstSample	= true;
+	clock_gettime (CLOCK_MONOTONIC, &dev -> attachTime);
+	dev	-> chanPending	= 1;
+#ifndef	__MINGW32__
+//	a recording asked for in the environment lasts until the close
+	if ((dev -> rec == NULL) && (getenv ("RTLSDR_RECORD") != NULL))
+	   startRecording (dev, getenv ("RTLSDR_RECORD"));
+//	as is a history, RTLSDR_HISTORY=seconds[:seconds after a trigger]
+	if ((dev -> history == NULL) && (getenv ("RTLSDR_HISTORY") != NULL)) {
+	   float seconds	= 0;
+	   float post		= 0;
+	   sscanf (getenv ("RTLSDR_HISTORY"), "%f:%f", &seconds, &post);
+	   if (startHistory (dev, seconds, post) == 0 &&
+	                         (dev -> history != NULL)) {
+	      struct sigaction sa;
+	      memset (&sa, 0, sizeof (sa));
+	      sa. sa_handler	= snapshotHandler;
+	      sigemptyset (&sa. sa_mask);
+	      sa. sa_flags	= SA_RESTART;
+	      __atomic_store_n (&signalTarget, dev -> history,
+	                                           __ATOMIC_RELEASE);
+	      sigaction (SIGUSR1, &sa, NULL);
+	   }
+	}
+#endif
+//	a channel outside the band of a running stream
+	if ((dev -> channel >= 0) && wideband. streamUp &&
+	    !inBand (dev -> frequency, dev -> outputRate) &&
+	    (channelFrequency (dev, dev -> frequency) < 0)) {
+	   dev -> finished	= true;
+	   return -1;
+	}
+	__atomic_store_n (&dev -> attached, true, __ATOMIC_SEQ_CST);
+	if (!streaming (dev) && (startStream (dev) < 0)) {
+	   detach (dev);
+	   dev -> finished	= true;
 	   return -1;
 	}
 #ifdef	__DEBUG__
@@ -952,7 +3355,6 @@ int     localGRed;
 #endif
 
 	dev -> running	= true;
-	err		= mir_sdr_SetPpm    ((float)dev -> ppm);
 //
 //	we make this into a simple event loop with semaphores
 	while (dev -> running) {
@@ -960,19 +3362,139 @@ int     localGRed;
            Sleep (1);
 #else
            usleep (1000);
+	   agcUpdate (dev);
 #endif
+	   handleCommands (dev);
+	}
+	detach (dev);
+	squelchEnd (dev);
+//	the stream of the channels stops with the last one
+	if (dev -> channel >= 0) {
+	   if ((!dev -> persistent || dev -> removed) && !othersAttached (dev))
+	      stopStream (dev);
+	}
+	else
+	if (!dev -> persistent || dev -> removed) {
+	   if (stopStream (dev) < 0)
+	      return -1;
+	   free (dev -> finalBuffer);
+	   free (dev -> bfpShift);
+	   squelchFree (dev -> sq);
+	   dev -> finalBuffer	= NULL;
+	   dev -> bfpShift	= NULL;
+	   dev -> sq		= NULL;
+	   dev -> finalBufferSize	= 0;
+	}
+#ifdef	__DEBUG__
+	fprintf (stderr, "first sample after %.2f msec\n",
+	                                  dev -> firstSampleDelay);
+#endif
+	dev -> finished = true;
+	return dev -> removed ? -1 : 0;
+}
 
+//
+//	the bands of the frontend, for planning the sweep
+static
+int	sweepBand	(int freq) {
+	return bankFor_sdr (freq);
+}
+//
+//	A sweep runs in the thread of the caller, as read_async does.
+//	The steps are tuned with set_center_freq, i.e. a SetRf within
+//	a band. While the worker of the sweep handles a step, the next
+//	one is tuned and captured. Sweeps go up and down alternately,
+//	so the first step of a sweep needs no retune
+RTLSDR_API int rtlsdr_ext_sweep (rtlsdr_dev_t *dev,
+	                         uint32_t start, uint32_t stop,
+	                         uint32_t binWidth, uint32_t averages,
+	                         uint32_t sweeps,
+	                         rtlsdr_sweep_cb_t cb, void *ctx) {
+sweepState	*s;
+int	oldInput, oldOutput, oldBw, oldFreq;
+bool	oldOffset;
+int	step	= 0;
+int	dir	= 1;
+int	buffer	= 0;
+uint32_t sweep	= 0;
+int	res	= 0;
+
+	if ((dev == NULL) || isReader (dev) || (dev -> channel >= 0))
+	   return -1;
+	if (dev -> running || streaming (dev)) {
+	   fprintf (stderr, "sweep: the device is streaming\n");
+	   return -1;
 	}
-	fprintf (stderr, "going to un-init\n");
-	err = mir_sdr_StreamUninit ();
-	if (err != mir_sdr_Success) {
-	   fprintf (stderr, "Error at StreamUnInit %s\n",
-	                                sdrplay_errorCodes (err));
+	if ((start > (uint32_t)INT32_MAX) || (stop > (uint32_t)INT32_MAX))
+	   return -1;
+	s	= sweepCreate (SWEEP_RATE, start, stop, binWidth, averages,
+	                       sweepBand, cb, ctx);
+	if (s == NULL) {
+	   fprintf (stderr, "sweep: cannot sweep %u .. %u with %u Hz bins\n",
+	                                      start, stop, binWidth);
 	   return -1;
 	}
-	free (finalBuffer);
-	dev -> finished = true;
-	return 0;
+#ifdef	__DEBUG__
+	fprintf (stderr, "sweep: %d steps, %d point FFTs\n",
+	                                s -> nSteps, s -> fftSize);
+#endif
+	oldInput	= dev -> inputRate;
+	oldOutput	= dev -> outputRate;
+	oldBw		= dev -> bandWidth;
+	oldFreq		= dev -> frequency;
+	oldOffset	= dev -> offsetTuning;
+	dev	-> inputRate	= SWEEP_RATE;
+	dev	-> outputRate	= SWEEP_RATE;
+	dev	-> bandWidth	= getBandwidth (SWEEP_RATE);
+	dev	-> offsetTuning	= false;
+	dev	-> frequency	= s -> steps [0]. center;
+	selectGainMap (dev);
+	dev	-> finished	= false;
+	dev	-> sweep	= s;
+	if (startStream (dev) < 0) {
+	   res	= -1;
+	   goto restore;
+	}
+	dev	-> running	= true;
+	while (dev -> running) {
+	   int	center	= s -> steps [step]. center;
+	   bool	retune	= center != dev -> frequency;
+	   sweepArm (s, buffer, retune);
+	   if (retune && (rtlsdr_set_center_freq (dev, center) < 0)) {
+	      res	= -1;
+	      break;
+	   }
+	   if (!sweepWait (s, &dev -> running)) {
+	      if (dev -> running) {
+	         fprintf (stderr, "sweep: no samples at %d\n", center);
+	         res	= -1;
+	      }
+	      break;
+	   }
+	   sweepSubmit (s, buffer, step, sweep);
+	   buffer	^= 1;
+	   step		+= dir;
+	   if ((step < 0) || (step >= s -> nSteps)) {
+	      dir	= -dir;
+	      step	+= dir;
+	      sweep ++;
+	      if ((sweeps != 0) && (sweep >= sweeps))
+	         break;
+	   }
+	}
+	dev	-> running	= false;
+	stopStream (dev);
+restore:
+	dev	-> sweep	= NULL;
+	sweepFree (s);
+	dev	-> inputRate	= oldInput;
+	dev	-> outputRate	= oldOutput;
+	dev	-> bandWidth	= oldBw;
+	dev	-> frequency	= oldFreq;
+	dev	-> offsetTuning	= oldOffset;
+	selectGainMap (dev);
+	dev	-> finished	= true;
+	return res;
 }
 
 //
@@ -983,6 +3505,7 @@ RTLSDR_API int rtlsdr_cancel_async (rtlsdr_dev_t *dev) {
 	if (dev == NULL)
 	   return -1;
 
+	dev -> serving	= false;
 	if (!dev -> running)
 	   return 0;
 
@@ -1042,6 +3565,8 @@ RTLSDR_API int rtlsdr_read_eeprom (rtlsdr_dev_t *dev,
 RTLSDR_API uint32_t rtlsdr_get_center_freq (rtlsdr_dev_t *dev) {
 	if (dev	== NULL)
 	   return -1;
+	if (isReader (dev))
+	   return dev -> shared. header -> frequency;
 	return dev -> frequency;
 }
 
@@ -1053,15 +3578,22 @@ RTLSDR_API int rtlsdr_get_freq_correction (rtlsdr_dev_t *dev) {
 }
 
 RTLSDR_API int rtlsdr_get_tuner_gain (rtlsdr_dev_t *dev) {
+	if (isReader (dev))
+	   return dev -> shared. header -> gain;
 	return dev -> tunerGain;
 }
 
 RTLSDR_API uint32_t rtlsdr_get_sample_rate (rtlsdr_dev_t *dev) {
+	if (isReader (dev))
+	   return dev -> shared. header -> sampleRate;
 	return dev	-> outputRate;
 }
 
 RTLSDR_API int rtlsdr_set_testmode (rtlsdr_dev_t *dev, int on) {
+	if (dev == NULL)
+	   return -1;
 	dev -> testMode = on;
+	return 0;
 }
 
 
@@ -1075,13 +3607,82 @@ RTLSDR_API int rtlsdr_get_direct_sampling (rtlsdr_dev_t *dev) {
 }
 
 
+//
+//	Offset tuning: the LO is shifted, the (wider) input is
+//	shifted back by the NCO and decimated, see ncoProcess
 RTLSDR_API int rtlsdr_set_offset_tuning (rtlsdr_dev_t *dev, int on) {
-	return -1;
+	if (dev == NULL)
+	   return -1;
+	if (isReader (dev))
+	   return 0;
+	if (dev -> channel >= 0)	// the NCO is in use already
+	   return on != 0 ? -1 : 0;
+
+	if ((on != 0) == dev -> offsetTuning)
+	   return 0;
+
+	if ((on != 0) && !offsetPossible (dev -> outputRate)) {
+	   fprintf (stderr, "offset tuning not possible with rate %d\n",
+	                                             dev -> outputRate);
+	   return -1;
+	}
+//
+//	the nco is (re)initialized by the callback, see offsetSetup
+	if (on != 0) {
+	   offsetSetup (dev);
+	   dev -> inputRate	= OFFSET_DECIMATION * dev -> outputRate;
+	}
+	else
+	   dev -> inputRate	= getRate (dev -> outputRate);
+	__atomic_store_n (&dev -> offsetTuning, on != 0, __ATOMIC_RELEASE);
+#ifdef	__DEBUG__
+	fprintf (stderr, "offset tuning %s, LO at %d, input rate %d\n",
+	                  dev -> offsetTuning ? "on" : "off",
+	                  loFrequency (dev, dev -> frequency),
+	                  dev -> inputRate);
+#endif
+	if (dev -> streamUp) {
+	   mir_sdr_ErrT err = re_initialize (dev, mir_sdr_CHANGE_FS_FREQ |
+	                                          mir_sdr_CHANGE_RF_FREQ |
+	                                          mir_sdr_CHANGE_BW_TYPE);
+	   if (err != mir_sdr_Success) {
+	      fprintf (stderr, "ReInit failed %s\n",
+	                                      sdrplay_errorCodes (err));
+	      return -1;
+	   }
+	}
+	return 0;
 }
 
 
 RTLSDR_API int rtlsdr_get_offset_tuning (rtlsdr_dev_t *dev) {
+	if (dev == NULL)
+	   return -1;
+	return dev -> offsetTuning ? 1 : 0;
+}
+
+//
+//	serve the device to rtl_tcp clients, until rtlsdr_cancel_async
+RTLSDR_API int rtlsdr_ext_serve_tcp (rtlsdr_dev_t *dev,
+	                             const char *address, int port) {
+#ifdef	__MINGW32__
 	return -1;
+#else
+int	res;
+	if (dev == NULL)
+	   return -1;
+	if (tcpPoolCreate (dev, TCP_BUF_LEN) < 0) {
+	   fprintf (stderr, "no memory for the buffers of the server\n");
+	   tcpPoolFree (dev);
+	   return -1;
+	}
+	dev	-> serving	= true;
+	res	= tcpServe (dev, &dev -> commands, address, port,
+	                                           &dev -> serving);
+	dev	-> serving	= false;
+	tcpPoolFree (dev);
+	return res;
+#endif
 }
 
 static
@@ -0,0 +1,326 @@
+#
+/*
+ *    Copyright (C) 2018
+ *    Jan van Katwijk (J.vanKatwijk@gmail.com)
+ *    Lazy Chair Computing
+ *
+ *    This file is part of the sdrplayBridge.
+ *
+ *    rtlsdrBridge is available under GPL-V2
+ */
+//
+//	Microbenchmarks for the kernels on the path of the stream
+//	callback: the conversions to the output formats, the 2:1
+//	decimation, the NCO of offset tuning, the gain mapping and
+//	the signal queue between the client and the bridge.
+//	The bridge itself is included, its kernels are static.
+//	Every kernel is run on packets of the sizes the SDRplay
+//	delivers (252 samples in zero IF) and on a few multiples, the
+//	best of BENCH_RUNS runs is reported, one CSV line per kernel
+//	and length:
+//	variant,kernel,length,unit,ns_per_unit,units_per_sec,
+//	                     cycles_per_unit,cycles_per_byte
+//	variant is the build (sse2, c, with -short for __SHORT__),
+//	unit is "sample" (a complex sample) or "call", bytes are the
+//	bytes of 16 bit I/Q input, 4 per sample. Cycles are the ticks
+//	of the time stamp counter, nan if there is none.
+//	usage: rtlsdr_bench [-t seconds per run] [-k kernel]
+#include	"rtlsdr-bridge.c"
+//	decided before x86intrin.h, that defines the SSE macros for
+//	its own use
+#if	defined (__SSE2__) && defined (__SHORT__)
+#define	VARIANT		"sse2-short"
+#elif	defined (__SSE2__)
+#define	VARIANT		"sse2"
+#elif	defined (__SHORT__)
+#define	VARIANT		"c-short"
+#else
+#define	VARIANT		"c"
+#endif
+#include	<getopt.h>
+#include	<math.h>
+#if	defined (__x86_64__) || defined (__i386__)
+#include	<x86intrin.h>
+#define	HAVE_TSC	1
+#endif
+
+#define	BENCH_RUNS	5
+#define	BENCH_SECONDS	0.05
+#define	BENCH_MAX	16128
+
+static	const int	lengths [] = {252, 1008, 4032, BENCH_MAX};
+#define	NUM_LENGTHS	(int)(sizeof (lengths) / sizeof (lengths [0]))
+
+static	int16_t	srcI	[BENCH_MAX];
+static	int16_t	srcQ	[BENCH_MAX];
+static	int16_t	workI	[BENCH_MAX]	__attribute__ ((aligned (64)));
+static	int16_t	workQ	[BENCH_MAX]	__attribute__ ((aligned (64)));
+static	uint8_t	outBuf	[8 * BENCH_MAX]	__attribute__ ((aligned (64)));
+
+static	rtlsdr_dev_t	*bctx;
+static	ncoState	bnco;
+static	signalQueue	bqueue;
+static	double		runSeconds	= BENCH_SECONDS;
+static	volatile int	sink;
+
+static
+double	nowNs		(void) {
+struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ts. tv_sec * 1e9 + ts. tv_nsec;
+}
+
+static
+uint64_t ticks		(void) {
+#ifdef	HAVE_TSC
+	return __rdtsc ();
+#else
+	return 0;
+#endif
+}
+//
+//	noise at about a quarter of the 14 bit full scale of an RSP1A,
+//	with the occasional sample beyond the 8 bit range, so the
+//	clipping branches are taken as they are with a real signal
+static
+void	fillSource	(void) {
+uint32_t seed	= 12345;
+int	i;
+
+	for (i = 0; i < BENCH_MAX; i ++) {
+	   int a = 0, b = 0, k;
+	   for (k = 0; k < 4; k ++) {
+	      seed = seed * 1664525 + 1013904223;
+	      a	+= (seed >> 20) & 0xFFF;
+	      seed = seed * 1664525 + 1013904223;
+	      b	+= (seed >> 20) & 0xFFF;
+	   }
+	   srcI [i]	= (a - 2 * 4096) * 3 / 4;
+	   srcQ [i]	= (b - 2 * 4096) * 3 / 4;
+	}
+}
+//
+//	the kernels, with one common signature: process n samples,
+//	in place kernels start from a fresh copy of the input
+typedef	void (*kernel_t) (int n);
+
+static
+void	refill		(int n) {
+	memcpy (workI, srcI, n * sizeof (int16_t));
+	memcpy (workQ, srcQ, n * sizeof (int16_t));
+}
+
+static
+void	k_cu8		(int n) {
+	convert_8 (bctx, srcI, srcQ, n, outBuf);
+}
+
+static
+void	k_mag16		(int n) {
+	convert_mag16 (bctx, srcI, srcQ, n, outBuf);
+}
+
+static
+void	k_cs16		(int n) {
+	convert_cs16 (bctx, srcI, srcQ, n, outBuf);
+}
+
+static
+void	k_measure	(int n) {
+	convert_cs16 (bctx, srcI, srcQ, n, NULL);
+}
+
+static
+void	k_cf32		(int n) {
+	bctx -> dcRemoval	= false;
+	convert_cf32 (bctx, srcI, srcQ, n, outBuf);
+}
+
+static
+void	k_cf32dc	(int n) {
+	bctx -> dcRemoval	= true;
+	convert_cf32 (bctx, srcI, srcQ, n, outBuf);
+}
+
+static
+void	k_bfp8		(int n) {
+	convert_bfp8 (bctx, srcI, srcQ, n, outBuf);
+}
+
+static
+void	k_copy		(int n) {
+	refill (n);
+}
+
+static
+void	k_decimate	(int n) {
+	refill (n);
+	sink	= decimate_2 (bctx, workI, workQ, n);
+}
+
+static
+void	k_nco		(int n) {
+	refill (n);
+	sink	= ncoProcess (&bnco, workI, workQ, n);
+}
+//
+//	n calls, over the gains and a few frequencies in different bands
+static
+void	k_gain		(int n) {
+static	const int freqs [] = {14000000, 100000000, 225000000,
+	                          430000000, 1090000000, 1575000000};
+int	lna, grdb;
+int	i;
+
+	for (i = 0; i < n; i ++) {
+	   gainMapper (bctx -> hwVersion, freqs [i % 6],
+	                              i % GAIN_STEPS, &lna, &grdb);
+	   sink	+= lna + grdb;
+	}
+}
+//
+//	n signals put on the queue and taken off again, as a tuning
+//	call of the client and the callback that handles it do
+static
+void	k_queue		(int n) {
+int	s, v;
+int	i;
+
+	for (i = 0; i < n; i ++) {
+	   putSignalonQueue (&bqueue, SET_FREQUENCY, i);
+	   if (trySignalfromQueue (&bqueue, &s, &v))
+	      sink	+= v;
+	}
+}
+
+typedef struct {
+	const char	*name;
+	kernel_t	fn;
+	bool		perCall;
+} benchKernel;
+
+static	const benchKernel	kernels [] = {
+	{"convert_cu8",		k_cu8,		false},
+	{"convert_mag16",	k_mag16,	false},
+	{"convert_cs16",	k_cs16,		false},
+	{"measure_cs16",	k_measure,	false},
+	{"convert_cf32",	k_cf32,		false},
+	{"convert_cf32_dc",	k_cf32dc,	false},
+	{"convert_bfp8",	k_bfp8,		false},
+	{"copy",		k_copy,		false},
+	{"decimate_2",		k_decimate,	false},
+	{"nco_offset",		k_nco,		false},
+	{"gain_mapper",		k_gain,		true},
+	{"signal_queue",	k_queue,	true},
+};
+#define	NUM_KERNELS	(int)(sizeof (kernels) / sizeof (kernels [0]))
+//
+//	calibrate the number of repetitions to about runSeconds, then
+//	take the fastest of BENCH_RUNS runs
+static
+void	runKernel	(const benchKernel *k, int n) {
+double	best	= 1e30;
+uint64_t bestTicks	= 0;
+long	reps	= 1;
+int	r;
+
+	k -> fn (n);		// warm up
+	while (true) {
+	   double t0	= nowNs ();
+	   for (long i = 0; i < reps; i ++)
+	      k -> fn (n);
+	   double t	= nowNs () - t0;
+	   if (t >= runSeconds * 1e9 / 4)
+	      break;
+	   reps	*= 2;
+	}
+
+	for (r = 0; r < BENCH_RUNS; r ++) {
+	   double t0	= nowNs ();
+	   uint64_t c0	= ticks ();
+	   for (long i = 0; i < reps; i ++)
+	      k -> fn (n);
+	   uint64_t c	= ticks () - c0;
+	   double t	= nowNs () - t0;
+	   if (t < best) {
+	      best	= t;
+	      bestTicks	= c;
+	   }
+	}
+
+	double units	= (double)reps * n;
+	double ns	= best / units;
+#ifdef	HAVE_TSC
+	double cycles	= bestTicks / units;
+#else
+	double cycles	= NAN;
+	(void)bestTicks;
+#endif
+	fprintf (stdout, "%s,%s,%d,%s,%.4f,%.0f,%.3f,",
+	                 VARIANT, k -> name, n,
+	                 k -> perCall ? "call" : "sample",
+	                 ns, 1e9 / ns, cycles);
+	if (k -> perCall)
+	   fprintf (stdout, "nan\n");
+	else
+	   fprintf (stdout, "%.4f\n", cycles / 4);
+	fflush (stdout);
+}
+
+int	main	(int argc, char **argv) {
+const char *only	= NULL;
+int	opt;
+int	i, j;
+
+	while ((opt = getopt (argc, argv, "t:k:")) != -1) {
+	   switch (opt) {
+	      case 't':
+	         runSeconds	= atof (optarg);
+	         if (runSeconds <= 0)
+	            runSeconds	= BENCH_SECONDS;
+	         break;
+	      case 'k':
+	         only		= optarg;
+	         break;
+	      default:
+	         fprintf (stderr,
+	                  "usage: %s [-t seconds per run] [-k kernel]\n",
+	                                             argv [0]);
+	         return 1;
+	   }
+	}
+
+	bctx	= newDevice ();
+	if (bctx == NULL) {
+	   fprintf (stderr, "no memory\n");
+	   return 1;
+	}
+//	the settings of an RSP1A at 2.048 MS/s
+	bctx -> hwVersion	= 255;
+#ifdef	__SHORT__
+	bctx -> shiftFactor	= 6;
+#endif
+	bctx -> downScale	= 8192.0;
+	bctx -> floatScale	= 1.0;
+	bctx -> outputRate	= 2048000;
+	bctx -> bfpShift	= malloc (BENCH_MAX / BFP_BLOCK + 1);
+	ncoInit (&bnco, OFFSET_DECIMATION * 2048000, 250000,
+	                                     OFFSET_DECIMATION);
+	gainTablesInit ();
+	signalInit (&bqueue);
+	fillSource ();
+
+	fprintf (stdout, "variant,kernel,length,unit,ns_per_unit,"
+	                 "units_per_sec,cycles_per_unit,cycles_per_byte\n");
+	for (i = 0; i < NUM_KERNELS; i ++) {
+	   if ((only != NULL) && (strcmp (only, kernels [i]. name) != 0))
+	      continue;
+	   for (j = 0; j < NUM_LENGTHS; j ++)
+	      runKernel (&kernels [i], lengths [j]);
+	}
+
+	ncoFree (&bnco);
+	free (bctx -> bfpShift);
+	freeDevice (bctx);
+	return 0;
+}
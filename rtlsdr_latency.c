@@ -0,0 +1,423 @@
+#
+/*
+ *    Copyright (C) 2018
+ *    Jan van Katwijk (J.vanKatwijk@gmail.com)
+ *    Lazy Chair Computing
+ *
+ *    This file is part of the sdrplayBridge.
+ *
+ *    Measures how long it takes before a change - frequency,
+ *    samplerate, gain - is in the samples a client gets
+ *
+ *    rtlsdrBridge is available under GPL-V2
+ */
+//
+//	Each scenario alternates between two settings, through the
+//	rtlsdr API, as a client would do it. A step is timed from the
+//	API call to
+//	- the return of the call,
+//	- the first packet with the new setting (the bridge tells with
+//	  a meta element, RTLSDR_META_TUNE or RTLSDR_META_GAIN, with
+//	  the index of the first sample with the new setting),
+//	- the callback with the buffer that holds that sample.
+//	For each scenario the distribution of the times is shown, the
+//	percentiles, and with -o every step is written as CSV.
+//	Scenarios:
+//	hop	frequency steps of 1 MHz within a band (SetRf)
+//	band	frequency steps to another band (Reinit)
+//	fs	samplerate steps of 500 ppm (SetFs)
+//	decim	samplerate halved, decimation in the bridge
+//	rate	samplerate tripled, the bandwidth changes (Reinit)
+//	gain	gain steps of 20 dB
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<stdint.h>
+#include	<stdbool.h>
+#include	<string.h>
+#include	<signal.h>
+#include	<unistd.h>
+#include	<time.h>
+#include	<pthread.h>
+#include	<rtl-sdr.h>
+#include	<rtl-sdr_extensions.h>
+
+#define	DEFAULT_STEPS		50
+#define	DEFAULT_BUF_LEN		16384
+#define	DEFAULT_DWELL		50	// msec between steps
+#define	STEP_TIMEOUT		2.0	// seconds
+#define	OTHER_BAND		433920000
+
+#define	SC_HOP		0
+#define	SC_BAND		1
+#define	SC_FS		2
+#define	SC_DECIM	3
+#define	SC_RATE		4
+#define	SC_GAIN		5
+#define	SCENARIOS	6
+
+static const char *scenarioNames [SCENARIOS] =
+	{"hop", "band", "fs", "decim", "rate", "gain"};
+static const char *kindNames [] =
+	{"software", "SetFs", "Reinit", "SetRf", "gain"};
+#define	KIND_GAIN	4
+#define	KINDS		5
+//
+//	written by the callbacks, read by the main thread
+typedef struct {
+	int		waitType;
+	volatile bool	effected;
+	volatile bool	delivered;
+	double		tEffect;
+	double		tDeliver;
+	uint64_t	index;
+	int		kind;
+	uint64_t	samples;
+} stepState;
+
+static
+rtlsdr_dev_t	*theDevice	= NULL;
+static
+stepState	step;
+static
+volatile bool	stopped		= false;
+
+static
+void	sighandler	(int sig) {
+	(void)sig;
+	stopped	= true;
+}
+
+static
+double	now		(void) {
+struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ts. tv_sec + ts. tv_nsec / 1e9;
+}
+
+static
+void	metaCallback	(const rtlsdr_meta_t *meta, void *ctx) {
+double	when	= now ();
+	(void)ctx;
+	if ((meta -> type != __atomic_load_n (&step. waitType,
+	                                      __ATOMIC_ACQUIRE)) ||
+	    step. effected)
+	   return;
+	step. tEffect	= when;
+	step. index	= meta -> sampleIndex;
+	step. kind	= meta -> type == RTLSDR_META_TUNE ?
+	                                    meta -> value [0] : KIND_GAIN;
+	__atomic_store_n (&step. effected, true, __ATOMIC_RELEASE);
+}
+//
+//	8 bit I/Q, two bytes a sample
+static
+void	dataCallback	(unsigned char *buf, uint32_t len, void *ctx) {
+double	when	= now ();
+	(void)buf; (void)ctx;
+	step. samples	+= len / 2;
+	if (__atomic_load_n (&step. effected, __ATOMIC_ACQUIRE) &&
+	    !step. delivered && (step. samples > step. index)) {
+	   step. tDeliver	= when;
+	   __atomic_store_n (&step. delivered, true, __ATOMIC_RELEASE);
+	}
+}
+
+static
+void	*reader		(void *arg) {
+uint32_t bufLen	= *(uint32_t *)arg;
+	if (rtlsdr_read_async (theDevice, dataCallback, NULL, 0, bufLen) < 0) {
+	   fprintf (stderr, "read_async failed\n");
+	   stopped	= true;
+	}
+	return NULL;
+}
+
+typedef struct {
+	uint32_t	frequency;
+	uint32_t	rate;
+	int		gain;
+} setting;
+//
+//	the two settings a scenario alternates between
+static
+void	settingsFor	(int scenario, setting *base, setting s [2]) {
+	s [0]	= *base;
+	s [1]	= *base;
+	switch (scenario) {
+	   case SC_HOP:
+	      s [1]. frequency	= base -> frequency + 1000000;
+	      break;
+	   case SC_BAND:
+	      s [1]. frequency	= OTHER_BAND;
+	      break;
+	   case SC_FS:
+	      s [1]. rate	= base -> rate + base -> rate / 2000;
+	      break;
+	   case SC_DECIM:
+	      s [1]. rate	= base -> rate / 2;
+	      break;
+	   case SC_RATE:
+	      s [1]. rate	= 3 * base -> rate;
+	      break;
+	   case SC_GAIN:
+	      s [1]. gain	= base -> gain + 200;
+	      break;
+	}
+}
+
+static
+int	apply		(int scenario, setting *s) {
+	switch (scenario) {
+	   case SC_HOP:
+	   case SC_BAND:
+	      return rtlsdr_set_center_freq (theDevice, s -> frequency);
+	   case SC_FS:
+	   case SC_DECIM:
+	   case SC_RATE:
+	      return rtlsdr_set_sample_rate (theDevice, s -> rate);
+	   default:
+	      return rtlsdr_set_tuner_gain (theDevice, s -> gain);
+	}
+}
+
+typedef struct {
+	double	*call;
+	double	*effect;
+	double	*deliver;
+	int	count;
+	int	missed;
+	int	failed;
+	int	kinds [KINDS];
+} results;
+
+static
+int	compare		(const void *a, const void *b) {
+double	x	= *(const double *)a;
+double	y	= *(const double *)b;
+	return x < y ? -1 : x > y ? 1 : 0;
+}
+
+static
+double	percentile	(double *v, int n, double q) {
+	return v [(int)(q * (n - 1) + 0.5)];
+}
+
+static
+void	showLine	(const char *scenario, const char *kinds,
+	                 const char *measure, double *v, int n) {
+	qsort (v, n, sizeof (double), compare);
+	fprintf (stdout, "%-6s %-16s %-8s %5d %8.3f %8.3f %8.3f %8.3f %8.3f\n",
+	                 scenario, kinds, measure, n,
+	                 v [0] * 1000,
+	                 percentile (v, n, 0.50) * 1000,
+	                 percentile (v, n, 0.90) * 1000,
+	                 percentile (v, n, 0.99) * 1000,
+	                 v [n - 1] * 1000);
+}
+
+static
+void	showResults	(int scenario, results *r) {
+char	kinds [64]	= "";
+int	i;
+
+	for (i = 0; i < KINDS; i ++)
+	   if (r -> kinds [i] > 0)
+	      snprintf (kinds + strlen (kinds), sizeof (kinds) - strlen (kinds),
+	                "%s%s", kinds [0] ? "+" : "", kindNames [i]);
+	if (r -> count == 0) {
+	   fprintf (stdout, "%-6s no change seen, %d missed, %d failed\n",
+	                     scenarioNames [scenario], r -> missed, r -> failed);
+	   return;
+	}
+	showLine (scenarioNames [scenario], kinds, "call", r -> call, r -> count);
+	showLine ("", "", "effect", r -> effect, r -> count);
+	showLine ("", "", "deliver", r -> deliver, r -> count);
+	if (r -> missed + r -> failed > 0)
+	   fprintf (stdout, "%-6s %d steps without effect, %d calls failed\n",
+	                     "", r -> missed, r -> failed);
+}
+
+static
+void	runScenario	(int scenario, setting *base, int steps,
+	                 int dwell, FILE *raw) {
+setting	s [2];
+results	r;
+int	i;
+
+	memset (&r, 0, sizeof (r));
+	r. call		= calloc (steps, sizeof (double));
+	r. effect	= calloc (steps, sizeof (double));
+	r. deliver	= calloc (steps, sizeof (double));
+	settingsFor (scenario, base, s);
+	apply (scenario, &s [0]);
+	usleep (4 * dwell * 1000);
+
+	for (i = 0; (i < steps) && !stopped; i ++) {
+	   setting *target	= &s [(i + 1) % 2];
+	   double t0, tCall, deadline;
+	   int	res;
+
+	   step. effected	= false;
+	   step. delivered	= false;
+	   __atomic_store_n (&step. waitType,
+	                     scenario == SC_GAIN ? RTLSDR_META_GAIN :
+	                                           RTLSDR_META_TUNE,
+	                     __ATOMIC_RELEASE);
+	   t0	= now ();
+	   res	= apply (scenario, target);
+	   tCall	= now ();
+	   if (res < 0) {
+	      r. failed ++;
+	      __atomic_store_n (&step. waitType, 0, __ATOMIC_RELEASE);
+	      usleep (dwell * 1000);
+	      continue;
+	   }
+	   deadline	= tCall + STEP_TIMEOUT;
+	   while (!__atomic_load_n (&step. delivered, __ATOMIC_ACQUIRE) &&
+	          (now () < deadline) && !stopped)
+	      usleep (100);
+	   __atomic_store_n (&step. waitType, 0, __ATOMIC_RELEASE);
+	   if (!step. delivered) {
+	      r. missed ++;
+	      usleep (dwell * 1000);
+	      continue;
+	   }
+	   r. call	[r. count]	= tCall - t0;
+	   r. effect	[r. count]	= step. tEffect - t0;
+	   r. deliver	[r. count]	= step. tDeliver - t0;
+	   if ((step. kind >= 0) && (step. kind < KINDS))
+	      r. kinds [step. kind] ++;
+	   if (raw != NULL)
+	      fprintf (raw, "%s,%d,%s,%.6f,%.6f,%.6f\n",
+	                    scenarioNames [scenario], i,
+	                    (step. kind >= 0) && (step. kind < KINDS) ?
+	                                    kindNames [step. kind] : "?",
+	                    r. call [r. count] * 1000,
+	                    r. effect [r. count] * 1000,
+	                    r. deliver [r. count] * 1000);
+	   r. count ++;
+	   usleep (dwell * 1000);
+	}
+	apply (scenario, &s [0]);
+	showResults (scenario, &r);
+	free (r. call);
+	free (r. effect);
+	free (r. deliver);
+}
+
+static
+void	usage		(void) {
+	fprintf (stderr,
+	         "rtlsdr_latency, the time from a change to the samples\n\n"
+	         "Usage:\t[-d device index (default: 0)]\n"
+	         "\t[-f frequency [Hz] (default: 100000000)]\n"
+	         "\t[-s samplerate [Hz] (default: 2048000)]\n"
+	         "\t[-g gain in tenths of dB (default: 200)]\n"
+	         "\t[-n steps per scenario (default: %d)]\n"
+	         "\t[-b output block size (default: %d)]\n"
+	         "\t[-w msec between steps (default: %d)]\n"
+	         "\t[-x scenarios, from hop,band,fs,decim,rate,gain (default: all)]\n"
+	         "\t[-o file for the times of each step, as CSV]\n",
+	         DEFAULT_STEPS, DEFAULT_BUF_LEN, DEFAULT_DWELL);
+	exit (1);
+}
+
+int	main	(int argc, char **argv) {
+setting	base;
+int	index		= 0;
+int	steps		= DEFAULT_STEPS;
+uint32_t bufLen		= DEFAULT_BUF_LEN;
+int	dwell		= DEFAULT_DWELL;
+bool	selected [SCENARIOS];
+char	*list		= NULL;
+FILE	*raw		= NULL;
+pthread_t	thread;
+struct sigaction	sa;
+int	opt;
+int	i;
+
+	base. frequency	= 100000000;
+	base. rate	= 2048000;
+	base. gain	= 200;
+	while ((opt = getopt (argc, argv, "d:f:s:g:n:b:w:x:o:")) != -1) {
+	   switch (opt) {
+	      case 'd':
+	         index		= atoi (optarg);
+	         break;
+	      case 'f':
+	         base. frequency	= (uint32_t)atof (optarg);
+	         break;
+	      case 's':
+	         base. rate	= (uint32_t)atof (optarg);
+	         break;
+	      case 'g':
+	         base. gain	= atoi (optarg);
+	         break;
+	      case 'n':
+	         steps		= atoi (optarg);
+	         break;
+	      case 'b':
+	         bufLen		= (uint32_t)atof (optarg);
+	         break;
+	      case 'w':
+	         dwell		= atoi (optarg);
+	         break;
+	      case 'x':
+	         list		= optarg;
+	         break;
+	      case 'o':
+	         raw		= fopen (optarg, "w");
+	         if (raw == NULL) {
+	            fprintf (stderr, "cannot open %s\n", optarg);
+	            return 1;
+	         }
+	         fprintf (raw, "scenario,step,kind,call_ms,effect_ms,deliver_ms\n");
+	         break;
+	      default:
+	         usage ();
+	   }
+	}
+	if ((steps <= 0) || (bufLen == 0) || (bufLen % 512 != 0))
+	   usage ();
+	for (i = 0; i < SCENARIOS; i ++)
+	   selected [i] = (list == NULL) ||
+	                  (strstr (list, scenarioNames [i]) != NULL);
+
+	if (rtlsdr_open (&theDevice, index) < 0) {
+	   fprintf (stderr, "opening device %d failed\n", index);
+	   return 1;
+	}
+	memset (&sa, 0, sizeof (sa));
+	sa. sa_handler	= sighandler;
+	sigemptyset (&sa. sa_mask);
+	sigaction (SIGINT, &sa, NULL);
+	sigaction (SIGTERM, &sa, NULL);
+
+	rtlsdr_set_sample_rate (theDevice, base. rate);
+	rtlsdr_set_center_freq (theDevice, base. frequency);
+	rtlsdr_set_tuner_gain_mode (theDevice, 1);
+	rtlsdr_set_tuner_gain (theDevice, base. gain);
+	rtlsdr_ext_set_meta_callback (theDevice, metaCallback, NULL);
+	rtlsdr_reset_buffer (theDevice);
+	if (pthread_create (&thread, NULL, reader, &bufLen) != 0) {
+	   rtlsdr_close (theDevice);
+	   return 1;
+	}
+
+	fprintf (stdout, "%-6s %-16s %-8s %5s %8s %8s %8s %8s %8s  (msec)\n",
+	                 "", "done by", "until", "n",
+	                 "min", "p50", "p90", "p99", "max");
+	for (i = 0; (i < SCENARIOS) && !stopped; i ++) {
+	   if (!selected [i])
+	      continue;
+	   runScenario (i, &base, steps, dwell, raw);
+	   fflush (stdout);
+	}
+
+	rtlsdr_cancel_async (theDevice);
+	pthread_join (thread, NULL);
+	rtlsdr_close (theDevice);
+	if (raw != NULL)
+	   fclose (raw);
+	return 0;
+}
@@ -0,0 +1,132 @@
+#
+/*
+ *    Copyright (C) 2018
+ *    Jan van Katwijk (J.vanKatwijk@gmail.com)
+ *    Lazy Chair Computing
+ *
+ *    This file is part of the sdrplayBridge.
+ *
+ *    A small rtl_tcp replacement, serving an SDRplay device
+ *    through the tcp server built into the bridge
+ *
+ *    rtlsdrBridge is available under GPL-V2
+ */
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<signal.h>
+#include	<unistd.h>
+#include	<pthread.h>
+#include	<rtl-sdr.h>
+#include	<rtl-sdr_extensions.h>
+
+static
+rtlsdr_dev_t	*theDevice	= NULL;
+static
+char	*address	= NULL;
+static
+int	port		= 1234;
+//
+//	the server runs in a thread of its own, the main thread
+//	cancels it on a signal: a handler may only set a flag
+static
+volatile sig_atomic_t	stopped	= 0;
+static
+volatile int	serverDone	= 0;
+static
+int	serverResult	= 0;
+
+static
+void	sighandler	(int sig) {
+	(void)sig;
+	stopped	= 1;
+}
+
+static
+void	*server		(void *arg) {
+	(void)arg;
+	serverResult	= rtlsdr_ext_serve_tcp (theDevice, address, port);
+	__atomic_store_n (&serverDone, 1, __ATOMIC_RELEASE);
+	return NULL;
+}
+
+static
+void	usage		(void) {
+	fprintf (stderr,
+	         "rtlsdr_tcp, an rtl_tcp server for SDRplay devices\n\n"
+	         "Usage:\t[-a listen address or unix socket path (default: 127.0.0.1)]\n"
+	         "\t[-p listen port (default: 1234)]\n"
+	         "\t[-f frequency to tune to [Hz]]\n"
+	         "\t[-g gain in tenths of dB (default: auto)]\n"
+	         "\t[-s samplerate in Hz (default: 2048000 Hz)]\n"
+	         "\t[-d device index (default: 0)]\n");
+	exit (1);
+}
+
+int	main	(int argc, char **argv) {
+uint32_t frequency	= 100000000;
+uint32_t rate		= 2048000;
+int	gain		= -1;
+int	index		= 0;
+int	opt;
+struct sigaction	sa;
+pthread_t	serverThread;
+
+	while ((opt = getopt (argc, argv, "a:p:f:g:s:d:")) != -1) {
+	   switch (opt) {
+	      case 'a':
+	         address	= optarg;
+	         break;
+	      case 'p':
+	         port		= atoi (optarg);
+	         break;
+	      case 'f':
+	         frequency	= (uint32_t)atof (optarg);
+	         break;
+	      case 'g':
+	         gain		= atoi (optarg);
+	         break;
+	      case 's':
+	         rate		= (uint32_t)atof (optarg);
+	         break;
+	      case 'd':
+	         index		= atoi (optarg);
+	         break;
+	      default:
+	         usage ();
+	   }
+	}
+
+	if (rtlsdr_open (&theDevice, index) < 0) {
+	   fprintf (stderr, "cannot open device %d\n", index);
+	   return 1;
+	}
+	rtlsdr_set_sample_rate	(theDevice, rate);
+	rtlsdr_set_center_freq	(theDevice, frequency);
+	if (gain < 0)
+	   rtlsdr_set_tuner_gain_mode (theDevice, 0);
+	else {
+	   rtlsdr_set_tuner_gain_mode (theDevice, 1);
+	   rtlsdr_set_tuner_gain (theDevice, gain);
+	}
+
+	memset (&sa, 0, sizeof (sa));
+	sa. sa_handler	= sighandler;
+	sigaction (SIGINT, &sa, NULL);
+	sigaction (SIGTERM, &sa, NULL);
+	signal (SIGPIPE, SIG_IGN);
+
+	if (pthread_create (&serverThread, NULL, server, NULL) != 0) {
+	   fprintf (stderr, "cannot start the server\n");
+	   rtlsdr_close (theDevice);
+	   return 1;
+	}
+	while (!stopped && !__atomic_load_n (&serverDone, __ATOMIC_ACQUIRE))
+	   usleep (100000);
+	if (stopped)
+	   rtlsdr_cancel_async (theDevice);
+	pthread_join (serverThread, NULL);
+	rtlsdr_close (theDevice);
+	return serverResult < 0 ? 1 : 0;
+}
+
@@ -0,0 +1,314 @@
+#
+/*
+ *    Copyright (C) 2018
+ *    Jan van Katwijk (J.vanKatwijk@gmail.com)
+ *    Lazy Chair Computing
+ *
+ *    This file is part of the sdrplayBridge.
+ *
+ *    An rtl_test look alike: streams from a device - an SDRplay,
+ *    the stub or a replay - and checks what arrives
+ *
+ *    rtlsdrBridge is available under GPL-V2
+ */
+//
+//	In test mode the bridge delivers a counter, one byte per
+//	output byte, a break in the count means bytes were lost (at
+//	least the difference of the counter, it wraps at 256). Each
+//	interval the rate of the bytes that arrived is compared with
+//	the nominal rate and the spread of the time between callbacks
+//	is shown. With a load, the callback spends that time before
+//	returning; with a load step, the load is increased each
+//	interval until bytes get lost, that is how much time a client
+//	has per buffer.
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<stdint.h>
+#include	<stdbool.h>
+#include	<string.h>
+#include	<signal.h>
+#include	<unistd.h>
+#include	<math.h>
+#include	<time.h>
+#include	<rtl-sdr.h>
+
+#define	DEFAULT_BUF_LEN		(16 * 16384)
+#define	DEFAULT_BUF_NUM		15
+#define	DEFAULT_INTERVAL	1.0
+
+typedef struct {
+//	settings
+	uint32_t	rate;
+	uint32_t	bufLen;
+	bool		testMode;
+	double		load;		// usec per callback
+	double		loadStep;
+	double		interval;
+	double		duration;
+//	the counter
+	bool		synced;
+	uint8_t		expected;
+	uint64_t	lostTotal;
+//	the interval, from the first callback on
+	bool		started;
+	double		start;
+	double		intervalStart;
+	double		lastCall;
+	uint64_t	bytes;
+	uint64_t	lost;
+	uint64_t	calls;
+	double		sumDev;
+	double		sumDev2;
+	double		maxDev;
+//	the totals
+	uint64_t	bytesTotal;
+	double		dropLoad;
+	bool		done;
+} testState;
+
+static
+rtlsdr_dev_t	*theDevice	= NULL;
+
+static
+void	sighandler	(int sig) {
+	(void)sig;
+	if (theDevice != NULL)
+	   rtlsdr_cancel_async (theDevice);
+}
+
+static
+double	now		(void) {
+struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ts. tv_sec + ts. tv_nsec / 1e9;
+}
+//
+//	the load is time spent, not time slept, as a client doing its
+//	work would
+static
+void	spend		(double usec) {
+double	until	= now () + usec / 1e6;
+	while (now () < until)
+	   ;
+}
+
+static
+void	checkCounter	(testState *t, const uint8_t *buf, uint32_t len) {
+uint32_t i;
+
+	if (!t -> synced && (len > 0)) {
+	   t -> expected	= buf [0];
+	   t -> synced		= true;
+	}
+	for (i = 0; i < len; i ++) {
+	   if (buf [i] != t -> expected)
+	      t -> lost += (uint8_t)(buf [i] - t -> expected);
+	   t -> expected	= buf [i] + 1;
+	}
+}
+
+static
+void	report		(testState *t, double when) {
+double	elapsed	= when - t -> intervalStart;
+double	nominal	= 2.0 * t -> rate;	// bytes per second, 8 bit I/Q
+double	measured	= t -> bytes / elapsed;
+double	mean	= 0;
+double	spread	= 0;
+
+	if (t -> calls > 1) {
+	   mean		= t -> sumDev / (t -> calls - 1);
+	   spread	= sqrt (t -> sumDev2 / (t -> calls - 1) - mean * mean);
+	}
+	fprintf (stderr, "%7.1f s: %.4f MS/s (%+.0f ppm), "
+	                 "jitter %.0f/%.0f usec (sd/max)",
+	                 when - t -> start,
+	                 measured / 2e6,
+	                 (measured - nominal) / nominal * 1e6,
+	                 spread * 1e6, t -> maxDev * 1e6);
+	if (t -> testMode)
+	   fprintf (stderr, ", lost at least %llu bytes",
+	                      (unsigned long long)t -> lost);
+	if (t -> load > 0)
+	   fprintf (stderr, ", load %.0f usec", t -> load);
+	fprintf (stderr, "\n");
+}
+
+static
+void	callback	(unsigned char *buf, uint32_t len, void *ctx) {
+testState *t	= (testState *)ctx;
+double	when	= now ();
+double	period	= len / (2.0 * t -> rate);
+
+	if (t -> done)
+	   return;
+	if (!t -> started) {
+	   t -> started		= true;
+	   t -> start		= when - period;
+	   t -> intervalStart	= t -> start;
+	}
+	if (t -> testMode)
+	   checkCounter (t, buf, len);
+	if (t -> calls > 0) {
+	   double dev	= fabs (when - t -> lastCall - period);
+	   t -> sumDev	+= dev;
+	   t -> sumDev2	+= dev * dev;
+	   if (dev > t -> maxDev)
+	      t -> maxDev = dev;
+	}
+	t -> lastCall	= when;
+	t -> calls	++;
+	t -> bytes	+= len;
+
+	if (when - t -> intervalStart >= t -> interval) {
+	   report (t, when);
+	   t -> bytesTotal	+= t -> bytes;
+	   t -> lostTotal	+= t -> lost;
+	   if ((t -> loadStep > 0) && (t -> lost > 0) && (t -> dropLoad < 0)) {
+	      t -> dropLoad	= t -> load;
+	      t -> done	= true;
+	   }
+	   if ((t -> duration > 0) && (when - t -> start >= t -> duration))
+	      t -> done	= true;
+	   if (t -> loadStep > 0)
+	      t -> load		+= t -> loadStep;
+	   t -> intervalStart	= when;
+	   t -> bytes	= 0;
+	   t -> lost	= 0;
+	   t -> calls	= 0;
+	   t -> sumDev	= 0;
+	   t -> sumDev2	= 0;
+	   t -> maxDev	= 0;
+	   if (t -> done) {
+	      rtlsdr_cancel_async (theDevice);
+	      return;
+	   }
+	}
+	if (t -> load > 0)
+	   spend (t -> load);
+}
+
+static
+void	usage		(void) {
+	fprintf (stderr,
+	         "rtlsdr_test, a tool to test the bridge\n\n"
+	         "Usage:\t[-s samplerate (default: 2048000 Hz)]\n"
+	         "\t[-d device index (default: 0)]\n"
+	         "\t[-b output block size (default: %d)]\n"
+	         "\t[-n number of buffers (default: %d)]\n"
+	         "\t[-t seconds to run (default: until ^C)]\n"
+	         "\t[-i seconds per report (default: %.0f)]\n"
+	         "\t[-l load in the callback [usec] (default: 0)]\n"
+	         "\t[-L load step per report [usec], stop at the first loss]\n"
+	         "\t[-r real samples, no test mode: no counter check]\n",
+	         DEFAULT_BUF_LEN, DEFAULT_BUF_NUM, DEFAULT_INTERVAL);
+	exit (1);
+}
+
+int	main	(int argc, char **argv) {
+testState	t;
+int	index		= 0;
+uint32_t bufNum		= DEFAULT_BUF_NUM;
+int	opt;
+int	res;
+struct sigaction	sa;
+
+	memset (&t, 0, sizeof (t));
+	t. rate		= 2048000;
+	t. bufLen	= DEFAULT_BUF_LEN;
+	t. testMode	= true;
+	t. interval	= DEFAULT_INTERVAL;
+	t. dropLoad	= -1;
+	while ((opt = getopt (argc, argv, "s:d:b:n:t:i:l:L:r")) != -1) {
+	   switch (opt) {
+	      case 's':
+	         t. rate	= (uint32_t)atof (optarg);
+	         break;
+	      case 'd':
+	         index		= atoi (optarg);
+	         break;
+	      case 'b':
+	         t. bufLen	= (uint32_t)atof (optarg);
+	         break;
+	      case 'n':
+	         bufNum		= atoi (optarg);
+	         break;
+	      case 't':
+	         t. duration	= atof (optarg);
+	         break;
+	      case 'i':
+	         t. interval	= atof (optarg);
+	         break;
+	      case 'l':
+	         t. load	= atof (optarg);
+	         break;
+	      case 'L':
+	         t. loadStep	= atof (optarg);
+	         break;
+	      case 'r':
+	         t. testMode	= false;
+	         break;
+	      default:
+	         usage ();
+	   }
+	}
+	if ((t. bufLen == 0) || (t. bufLen % 512 != 0)) {
+	   fprintf (stderr, "the block size should be a multiple of 512\n");
+	   return 1;
+	}
+	if (t. interval <= 0)
+	   t. interval	= DEFAULT_INTERVAL;
+
+	if (index >= (int)rtlsdr_get_device_count ()) {
+	   fprintf (stderr, "no device %d\n", index);
+	   return 1;
+	}
+	res	= rtlsdr_open (&theDevice, index);
+	if (res < 0) {
+	   fprintf (stderr, "opening device %d failed\n", index);
+	   return 1;
+	}
+	fprintf (stderr, "using %s\n", rtlsdr_get_device_name (index));
+
+	memset (&sa, 0, sizeof (sa));
+	sa. sa_handler	= sighandler;
+	sigemptyset (&sa. sa_mask);
+	sigaction (SIGINT, &sa, NULL);
+	sigaction (SIGTERM, &sa, NULL);
+
+	if (rtlsdr_set_sample_rate (theDevice, t. rate) < 0)
+	   fprintf (stderr, "setting the samplerate failed\n");
+	rtlsdr_set_testmode (theDevice, t. testMode ? 1 : 0);
+	rtlsdr_reset_buffer (theDevice);
+	fprintf (stderr, "%s at %u S/s, blocks of %u bytes (%.2f msec)\n",
+	                 t. testMode ? "counting" : "streaming", t. rate,
+	                 t. bufLen, t. bufLen / (2.0 * t. rate) * 1000);
+
+	res	= rtlsdr_read_async (theDevice, callback, &t,
+	                                   bufNum, t. bufLen);
+	if (res < 0)
+	   fprintf (stderr, "read_async failed\n");
+
+	if (t. calls > 1)
+	   report (&t, now ());
+	t. bytesTotal	+= t. bytes;
+	t. lostTotal	+= t. lost;
+	fprintf (stderr, "%.1f s, %llu bytes",
+	                 t. started ? now () - t. start : 0,
+	                 (unsigned long long)t. bytesTotal);
+	if (t. testMode)
+	   fprintf (stderr, ", lost at least %llu bytes",
+	                      (unsigned long long)t. lostTotal);
+	fprintf (stderr, "\n");
+	if (t. loadStep > 0) {
+	   if (t. dropLoad >= 0)
+	      fprintf (stderr, "bytes were lost with a load of %.0f usec "
+	                       "per block of %.2f msec (%.0f%%)\n",
+	                       t. dropLoad, t. bufLen / (2.0 * t. rate) * 1000,
+	                       t. dropLoad / (t. bufLen / (2.0 * t. rate) * 1e6) * 100);
+	   else
+	      fprintf (stderr, "no loss up to a load of %.0f usec\n",
+	                       t. load - t. loadStep);
+	}
+	rtlsdr_close (theDevice);
+	return (res < 0) || (t. lostTotal > 0) ? 1 : 0;
+}
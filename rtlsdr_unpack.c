@@ -0,0 +1,128 @@
+#
+/*
+ *    Copyright (C) 2018
+ *    Jan van Katwijk (J.vanKatwijk@gmail.com)
+ *    Lazy Chair Computing
+ *
+ *    This file is part of the sdrplayBridge.
+ *
+ *    Unpacking a compressed (.iqz) recording to ci16_le samples,
+ *    the format of the SigMF recordings
+ *
+ *    rtlsdrBridge is available under GPL-V2
+ */
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<unistd.h>
+#include	"iqz.h"
+
+static
+void	usage		(void) {
+	fprintf (stderr,
+	         "rtlsdr_unpack, unpacking .iqz recordings\n\n"
+	         "Usage:\trtlsdr_unpack [options] recording.iqz [output file]\n"
+	         "\t[-l list the blocks]\n"
+	         "\t[-s first sample (default: 0)]\n"
+	         "\t[-n number of samples (default: all)]\n"
+	         "\twithout output file (or with '-') to stdout\n");
+	exit (1);
+}
+
+int	main	(int argc, char **argv) {
+uint64_t start		= 0;
+uint64_t count		= ~(uint64_t)0;
+int	list		= 0;
+static int16_t xi [IQZ_BLOCK];
+static int16_t xq [IQZ_BLOCK];
+static int16_t out [2 * IQZ_BLOCK];
+iqzReader *r;
+FILE	*f		= stdout;
+int	opt;
+int	block;
+
+	while ((opt = getopt (argc, argv, "ls:n:")) != -1) {
+	   switch (opt) {
+	      case 'l':
+	         list	= 1;
+	         break;
+	      case 's':
+	         start	= strtoull (optarg, NULL, 0);
+	         break;
+	      case 'n':
+	         count	= strtoull (optarg, NULL, 0);
+	         break;
+	      default:
+	         usage ();
+	   }
+	}
+	if (optind >= argc)
+	   usage ();
+	r	= iqzOpen (argv [optind]);
+	if (r == NULL)
+	   return 1;
+	if (r -> header. blockSize > IQZ_BLOCK) {
+	   fprintf (stderr, "%s: blocks of %u samples not supported\n",
+	                     argv [optind], r -> header. blockSize);
+	   iqzClose (r);
+	   return 1;
+	}
+
+	if (list) {
+	   fprintf (stdout, "%s, %s, %d blocks\n",
+	                     r -> header. hw, r -> header. datetime, r -> blocks);
+	   for (block = 0; block < r -> blocks; block ++) {
+	      iqzIndexEntry *e = &r -> index [block];
+	      fprintf (stdout, "%6d %12llu %6u %10d Hz %9d S/s %5.1f dB\n",
+	                        block,
+	                        (unsigned long long)e -> firstSample,
+	                        e -> samples, e -> frequency, e -> rate,
+	                        e -> gain / 10.0);
+	   }
+	   iqzClose (r);
+	   return 0;
+	}
+
+	if ((optind + 1 < argc) && (strcmp (argv [optind + 1], "-") != 0)) {
+	   f	= fopen (argv [optind + 1], "wb");
+	   if (f == NULL) {
+	      fprintf (stderr, "cannot create %s\n", argv [optind + 1]);
+	      iqzClose (r);
+	      return 1;
+	   }
+	}
+//
+//	samples dropped while recording are not in the file, the
+//	sample numbers continue after a gap
+	block	= iqzFind (r, start);
+	for (; (block >= 0) && (block < r -> blocks) && (count > 0); block ++) {
+	   iqzIndexEntry *e = &r -> index [block];
+	   uint64_t first	= 0;
+	   uint64_t n;
+	   uint64_t i;
+	   if (iqzRead (r, block, xi, xq) < 0) {
+	      fprintf (stderr, "block %d cannot be decoded\n", block);
+	      break;
+	   }
+	   if (start > e -> firstSample)
+	      first	= start - e -> firstSample;
+	   if (first >= e -> samples)
+	      continue;
+	   n	= e -> samples - first;
+	   if (n > count)
+	      n = count;
+	   for (i = 0; i < n; i ++) {
+	      out [2 * i]	= xi [first + i];
+	      out [2 * i + 1]	= xq [first + i];
+	   }
+	   if (fwrite (out, 4, n, f) != n) {
+	      fprintf (stderr, "write error\n");
+	      break;
+	   }
+	   count	-= n;
+	}
+	if (f != stdout)
+	   fclose (f);
+	iqzClose (r);
+	return 0;
+}
@@ -0,0 +1,273 @@
+#
+/*
+ *    Copyright (C) 2018
+ *    Jan van Katwijk (J.vanKatwijk@gmail.com)
+ *    Lazy Chair Computing
+ *
+ *    This file is part of the sdrplayBridge.
+ *
+ *    rtlsdrBridge is available under GPL-V2
+ */
+#include	"shared-ring.h"
+#include	<stdio.h>
+#include	<string.h>
+#include	<errno.h>
+#include	<fcntl.h>
+#include	<signal.h>
+#include	<unistd.h>
+#include	<sys/mman.h>
+#include	<sys/stat.h>
+
+#define	SHARED_MAGIC	0x52534252	// "RSBR"
+#define	SHARED_VERSION	1
+
+static
+bool	alive		(int32_t pid) {
+	if (pid <= 0)
+	   return false;
+	return (kill (pid, 0) == 0) || (errno == EPERM);
+}
+//
+//	reserve twice the size of the ring and map the data part
+//	of the segment in both halves
+static
+uint8_t	*mapMirror	(int fd, uint32_t size, int prot) {
+uint8_t	*base	= mmap (NULL, 2 * (size_t)size, PROT_NONE,
+	                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (base == MAP_FAILED)
+	   return NULL;
+	if ((mmap (base, size, prot, MAP_SHARED | MAP_FIXED,
+	                        fd, SHARED_HEADER_SIZE) == MAP_FAILED) ||
+	    (mmap (base + size, size, prot, MAP_SHARED | MAP_FIXED,
+	                        fd, SHARED_HEADER_SIZE) == MAP_FAILED)) {
+	   munmap (base, 2 * (size_t)size);
+	   return NULL;
+	}
+	return base;
+}
+
+static
+void	unmapAll	(sharedRing *ring) {
+	if (ring -> data != NULL)
+	   munmap (ring -> data, 2 * (size_t)ring -> ringSize);
+	if (ring -> header != NULL)
+	   munmap (ring -> header, SHARED_HEADER_SIZE);
+	ring	-> data		= NULL;
+	ring	-> header	= NULL;
+}
+
+static
+int	create		(sharedRing *ring, int fd, uint32_t size) {
+sharedHeader	*h;
+	if (ftruncate (fd, SHARED_HEADER_SIZE + (off_t)size) < 0)
+	   return -1;
+	h	= mmap (NULL, SHARED_HEADER_SIZE, PROT_READ | PROT_WRITE,
+	                                        MAP_SHARED, fd, 0);
+	if (h == MAP_FAILED)
+	   return -1;
+	ring	-> header	= h;
+	ring	-> ringSize	= size;
+	ring	-> data		= mapMirror (fd, size, PROT_READ | PROT_WRITE);
+	if (ring -> data == NULL)
+	   return -1;
+	memset (h, 0, sizeof (sharedHeader));
+	h	-> version	= SHARED_VERSION;
+	h	-> producer	= getpid ();
+	h	-> ringSize	= size;
+//	the magic is written last, a reader waits for it
+	__atomic_store_n (&h -> magic, SHARED_MAGIC, __ATOMIC_RELEASE);
+	ring	-> role		= SHARED_PRODUCER;
+	return SHARED_PRODUCER;
+}
+//
+//	returns SHARED_READER on success, 0 if the segment is stale
+//	(the producer is gone), -1 on errors
+static
+int	attach		(sharedRing *ring, int fd) {
+sharedHeader	*h	= NULL;
+struct stat	st;
+int	i;
+int32_t	me	= getpid ();
+
+//	the producer may still be initializing the segment
+	for (i = 0; i < 1000; i ++) {
+	   if ((fstat (fd, &st) == 0) && (st. st_size >= SHARED_HEADER_SIZE)) {
+	      if (h == NULL)
+	         h = mmap (NULL, SHARED_HEADER_SIZE, PROT_READ | PROT_WRITE,
+	                                        MAP_SHARED, fd, 0);
+	      if (h == MAP_FAILED)
+	         return -1;
+	      if (__atomic_load_n (&h -> magic, __ATOMIC_ACQUIRE) == SHARED_MAGIC)
+	         break;
+	   }
+	   usleep (1000);
+	}
+	if (h == NULL)
+	   return 0;
+	ring	-> header	= h;
+	if ((h -> magic != SHARED_MAGIC) || !alive (h -> producer)) {
+	   unmapAll (ring);
+	   return 0;
+	}
+	if ((h -> version != SHARED_VERSION) || (h -> producer == me)) {
+	   fprintf (stderr, "%s cannot be shared with this process\n",
+	                                                   ring -> name);
+	   unmapAll (ring);
+	   return -1;
+	}
+	ring	-> ringSize	= h -> ringSize;
+	ring	-> data		= mapMirror (fd, h -> ringSize, PROT_READ);
+	if (ring -> data == NULL) {
+	   unmapAll (ring);
+	   return -1;
+	}
+//
+//	claim a slot, slots of readers that died are reused
+	for (i = 0; i < SHARED_MAX_READERS; i ++) {
+	   int32_t pid = h -> readers [i]. pid;
+	   if ((pid != 0) && alive (pid))
+	      continue;
+	   if (__atomic_compare_exchange_n (&h -> readers [i]. pid, &pid, me,
+	                          false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+	      h -> readers [i]. drops	= 0;
+	      __atomic_store_n (&h -> readers [i]. readPos,
+	                        __atomic_load_n (&h -> writePos,
+	                                         __ATOMIC_ACQUIRE),
+	                        __ATOMIC_RELEASE);
+	      ring -> slot	= i;
+	      ring -> role	= SHARED_READER;
+	      return SHARED_READER;
+	   }
+	}
+	fprintf (stderr, "%s has already %d readers\n",
+	                                ring -> name, SHARED_MAX_READERS);
+	unmapAll (ring);
+	return -1;
+}
+//
+//	the name of the segment is derived from the serial number,
+//	so all processes opening the same device find it
+int	sharedOpen	(sharedRing *ring,
+	                 const char *serial, uint32_t ringSize) {
+long	page	= sysconf (_SC_PAGESIZE);
+int	attempt;
+char	*p;
+
+	memset (ring, 0, sizeof (sharedRing));
+	ring	-> role	= SHARED_NONE;
+	if ((ringSize == 0) || (ringSize % page != 0) ||
+	                 ((ringSize & (ringSize - 1)) != 0) ||
+	                 (sizeof (sharedHeader) > SHARED_HEADER_SIZE)) {
+	   fprintf (stderr, "invalid size %u for the shared ring\n", ringSize);
+	   return -1;
+	}
+	snprintf (ring -> name, sizeof (ring -> name), "/rtlsdr-%s", serial);
+	for (p = ring -> name + 1; *p != 0; p ++)
+	   if ((*p == '/') || (*p == ' '))
+	      *p = '_';
+
+	for (attempt = 0; attempt < 3; attempt ++) {
+	   int	res;
+	   int	fd = shm_open (ring -> name, O_RDWR | O_CREAT | O_EXCL, 0666);
+	   if (fd >= 0) {
+	      fchmod (fd, 0666);
+	      res = create (ring, fd, ringSize);
+	      close (fd);
+	      if (res < 0) {
+	         fprintf (stderr, "cannot create %s (%s)\n",
+	                                    ring -> name, strerror (errno));
+	         unmapAll (ring);
+	         shm_unlink (ring -> name);
+	      }
+	      return res;
+	   }
+	   if (errno != EEXIST) {
+	      fprintf (stderr, "cannot open %s (%s)\n",
+	                                    ring -> name, strerror (errno));
+	      return -1;
+	   }
+	   fd	= shm_open (ring -> name, O_RDWR, 0);
+	   if (fd < 0)		// just removed
+	      continue;
+	   res	= attach (ring, fd);
+	   close (fd);
+	   if (res != 0)
+	      return res;
+//	a left over from a producer that died, remove it and retry
+	   shm_unlink (ring -> name);
+	}
+	return -1;
+}
+
+void	sharedClose	(sharedRing *ring) {
+sharedHeader	*h	= ring -> header;
+	if (ring -> role == SHARED_NONE)
+	   return;
+	if (ring -> role == SHARED_PRODUCER) {
+	   __atomic_store_n (&h -> producer, 0, __ATOMIC_RELEASE);
+	   shm_unlink (ring -> name);
+	}
+	else {
+	   if (h -> readers [ring -> slot]. drops != 0)
+	      fprintf (stderr, "%s: reader dropped %llu bytes\n",
+	                 ring -> name,
+	                 (unsigned long long)h -> readers [ring -> slot]. drops);
+	   __atomic_store_n (&h -> readers [ring -> slot]. pid, 0,
+	                                          __ATOMIC_RELEASE);
+	}
+	unmapAll (ring);
+	ring	-> role	= SHARED_NONE;
+}
+//
+//	single writer: copy, then make the data visible by
+//	moving writePos. The producer does not look at the readers
+void	sharedPublish	(sharedRing *ring, const uint8_t *buf, int len) {
+sharedHeader	*h	= ring -> header;
+uint64_t	w	= h -> writePos;
+	if ((len <= 0) || (len > ring -> ringSize / 4))
+	   return;
+	memcpy (ring -> data + (w & (ring -> ringSize - 1)), buf, len);
+	__atomic_store_n (&h -> writePos, w + len, __ATOMIC_RELEASE);
+}
+//
+//	a pointer to the next len bytes for this reader, NULL if not
+//	available yet. A reader lagging more than half the ring
+//	is moved to the most recent data
+const uint8_t	*sharedNext	(sharedRing *ring, int len) {
+sharedHeader	*h	= ring -> header;
+sharedReader	*r	= &h -> readers [ring -> slot];
+uint64_t	w	= __atomic_load_n (&h -> writePos, __ATOMIC_ACQUIRE);
+uint64_t	pos	= r -> readPos;
+
+	if ((len <= 0) || (len > ring -> ringSize / 4))
+	   return NULL;
+	if (w - pos > ring -> ringSize / 2) {
+	   uint64_t skip = (w - pos - len) & ~(uint64_t)63;
+	   pos		+= skip;
+	   r -> drops	+= skip;
+	   __atomic_store_n (&r -> readPos, pos, __ATOMIC_RELEASE);
+	}
+	if (w - pos < (uint64_t)len)
+	   return NULL;
+	return ring -> data + (pos & (ring -> ringSize - 1));
+}
+//
+//	called after the data is used. If the producer went around
+//	the ring in the mean time the data was overwritten while
+//	being used, that is counted as a drop as well
+void	sharedConsume	(sharedRing *ring, int len) {
+sharedHeader	*h	= ring -> header;
+sharedReader	*r	= &h -> readers [ring -> slot];
+uint64_t	w	= __atomic_load_n (&h -> writePos, __ATOMIC_ACQUIRE);
+uint64_t	pos	= r -> readPos;
+
+	if (w + ring -> ringSize / 4 > pos + ring -> ringSize)
+	   r -> drops += len;
+	__atomic_store_n (&r -> readPos, pos + len, __ATOMIC_RELEASE);
+}
+
+bool	sharedProducerAlive	(sharedRing *ring) {
+	return alive (__atomic_load_n (&ring -> header -> producer,
+	                                            __ATOMIC_ACQUIRE));
+}
+
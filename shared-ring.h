@@ -0,0 +1,72 @@
+#
+/*
+ *    Copyright (C) 2018
+ *    Jan van Katwijk (J.vanKatwijk@gmail.com)
+ *    Lazy Chair Computing
+ *
+ *    This file is part of the sdrplayBridge.
+ *
+ *    rtlsdrBridge is available under GPL-V2
+ */
+#ifndef	__SHARED_RING__
+#define	__SHARED_RING__
+
+#include	<stdint.h>
+#include	<stdbool.h>
+
+//	Sharing the output of one device with other processes.
+//	The first process opening the device creates a POSIX shared
+//	memory segment with a ring buffer and becomes the producer,
+//	later processes attach as readers. There is a single writer,
+//	each reader has a cursor of its own in the segment, the
+//	producer never waits for a reader. A reader that lags
+//	more than half the ring is moved ahead, the bytes skipped
+//	are counted as drops.
+//	The data part of the segment is mapped twice, back to back,
+//	so a buffer that wraps around the end of the ring is still
+//	contiguous in memory and can be handed out without copying.
+#define	SHARED_DEFAULT_SIZE	(16 << 20)
+#define	SHARED_MAX_READERS	16
+#define	SHARED_HEADER_SIZE	4096
+
+#define	SHARED_NONE		0
+#define	SHARED_PRODUCER		1
+#define	SHARED_READER		2
+
+typedef struct {
+	volatile int32_t	pid;	// 0 if the slot is free
+	volatile uint64_t	readPos;
+	volatile uint64_t	drops;
+} sharedReader;
+
+typedef struct {
+	volatile uint32_t	magic;
+	uint32_t		version;
+	volatile int32_t	producer;
+	uint32_t		ringSize;
+//	the settings of the producer, for the readers to see
+	volatile uint32_t	frequency;
+	volatile uint32_t	sampleRate;
+	volatile int32_t	gain;
+	volatile uint64_t	writePos;
+	sharedReader		readers [SHARED_MAX_READERS];
+} sharedHeader;
+
+typedef struct {
+	int		role;
+	char		name [80];
+	sharedHeader	*header;
+	uint8_t		*data;		// 2 * ringSize, mirrored
+	uint32_t	ringSize;
+	int		slot;		// for a reader
+} sharedRing;
+
+int	sharedOpen	(sharedRing *ring,
+	                 const char *serial, uint32_t ringSize);
+void	sharedClose	(sharedRing *ring);
+void	sharedPublish	(sharedRing *ring, const uint8_t *buf, int len);
+const uint8_t	*sharedNext	(sharedRing *ring, int len);
+void	sharedConsume	(sharedRing *ring, int len);
+bool	sharedProducerAlive	(sharedRing *ring);
+#endif
+
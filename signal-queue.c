@@ -1,45 +1,76 @@
 
 #include	"signal-queue.h"
 
-static  pthread_mutex_t locker;
-static  sem_t   signalElements;
-
-void	signalInit	(theSignal **q) {
-	pthread_mutex_init (&locker, NULL);
-	sem_init (&signalElements, 0, 0);
-	*q	= NULL;
+void	signalInit	(signalQueue *q) {
+	pthread_mutex_init (&q -> locker, NULL);
+	sem_init (&q -> signalElements, 0, 0);
+	q	-> head	= NULL;
+	q	-> tail	= NULL;
 }
 
-void	signalReset (theSignal **q) {
-	pthread_mutex_trylock (&locker);
-	pthread_mutex_unlock (&locker);
-	while (*q != NULL) {
-	   theSignal *x = (*q) -> next;
-	   free (*q);
-	   *q = x;
+void	signalReset (signalQueue *q) {
+	pthread_mutex_lock (&q -> locker);
+	while (q -> head != NULL) {
+	   theSignal *x = q -> head -> next;
+	   free (q -> head);
+	   q -> head = x;
 	}
+	q	-> tail	= NULL;
+	while (sem_trywait (&q -> signalElements) == 0)
+	   ;
+	pthread_mutex_unlock (&q -> locker);
 }
 
-void	putSignalonQueue (theSignal **q, int signal, int value) {
+void	putSignalonQueue (signalQueue *q, int signal, int value) {
 theSignal	*n;
-	pthread_mutex_lock (&locker);
 	n	= (theSignal *)malloc (sizeof (theSignal));
+	if (n == NULL)
+	   return;
 	n	-> signal	= signal;
 	n	-> value	= value;
-	n	-> next		= (*q);
-	(*q)			= n;
-	sem_post (&signalElements);
-	pthread_mutex_unlock (&locker);
+	n	-> next		= NULL;
+	pthread_mutex_lock (&q -> locker);
+	if (q -> tail == NULL)
+	   q -> head		= n;
+	else
+	   q -> tail -> next	= n;
+	q	-> tail		= n;
+	sem_post (&q -> signalElements);
+	pthread_mutex_unlock (&q -> locker);
 }
 
-void	getSignalfromQueue (theSignal **q, int *signal, int *value) {
+void	getSignalfromQueue (signalQueue *q, int *signal, int *value) {
+theSignal *tmp;
+	sem_wait (&q -> signalElements);
+	pthread_mutex_lock (&q -> locker);
+	tmp	= q -> head;
+	*signal	= tmp	-> signal;
+	*value	= tmp	-> value;
+	q	-> head	= tmp -> next;
+	if (q -> head == NULL)
+	   q -> tail = NULL;
+	free (tmp);
+	pthread_mutex_unlock (&q -> locker);
+}
+//
+//	as getSignalfromQueue, but returns false rather than
+//	waiting when the queue is empty
+bool	trySignalfromQueue (signalQueue *q, int *signal, int *value) {
 theSignal *tmp;
-	sem_wait (&signalElements);
-	pthread_mutex_lock (&locker);
-	tmp	= (*q);
-	*signal	= (*q)	-> signal;
-	*value	= (*q)	-> value;
-	(*q)	= (*q)	-> next;
+	pthread_mutex_lock (&q -> locker);
+	tmp	= q -> head;
+	if (tmp == NULL) {
+	   pthread_mutex_unlock (&q -> locker);
+	   return false;
+	}
+	sem_trywait (&q -> signalElements);
+	*signal	= tmp	-> signal;
+	*value	= tmp	-> value;
+	q	-> head	= tmp -> next;
+	if (q -> head == NULL)
+	   q -> tail = NULL;
 	free (tmp);
-	pthread_mutex_unlock (&locker);
+	pthread_mutex_unlock (&q -> locker);
+	return true;
 }
+
@@ -7,25 +7,41 @@
 #include        <pthread.h>
 #include        <stdlib.h>
 #include        <stdint.h>
+#include        <stdbool.h>
 
 //	the "signals" for handling commands asynchronously.
 #define	CANCEL_ASYNC	0100
 #define	SET_FREQUENCY	0101
 #define	SET_BW		0102
 #define	SET_RATE	0103
+#define	SET_GAIN	0104
+#define	SET_GAIN_MODE	0105
+#define	SET_AGC		0106
+#define	SET_PPM		0107
+#define	SET_OFFSET	0110
+#define	SET_TESTMODE	0111
 
 typedef	struct __theSignal {
 	int	signal;
 	void	*device;
 	int	value;
 	struct __theSignal	*next;
+} theSignal;
+//
+//	each device has its own queue, signals are handled in
+//	the order in which they were put on the queue
+typedef struct {
+	theSignal	*head;
+	theSignal	*tail;
 	pthread_mutex_t locker;
 	sem_t	signalElements;
-} theSignal;
+} signalQueue;
 
-void	signalInit		(theSignal **);
-void	signalReset		(theSignal **);
-void	putSignalonQueue	(theSignal **queue, int signal, int value);
-void	getSignalfromQueue	(theSignal **queue, int *signal, int *value);
+void	signalInit		(signalQueue *);
+void	signalReset		(signalQueue *);
+void	putSignalonQueue	(signalQueue *queue, int signal, int value);
+void	getSignalfromQueue	(signalQueue *queue, int *signal, int *value);
+bool	trySignalfromQueue	(signalQueue *queue, int *signal, int *value);
 
 #endif
+
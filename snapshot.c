@@ -0,0 +1,352 @@
+#
+/*
+ *    Copyright (C) 2018
+ *    Jan van Katwijk (J.vanKatwijk@gmail.com)
+ *    Lazy Chair Computing
+ *
+ *    This file is part of the sdrplayBridge.
+ *
+ *    rtlsdrBridge is available under GPL-V2
+ */
+#include	"snapshot.h"
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<errno.h>
+#include	<fcntl.h>
+#include	<unistd.h>
+#include	<sys/mman.h>
+
+#define	SNAP_LOSSES		64
+
+static
+bool	writeAll	(int fd, const uint8_t *p, size_t len) {
+	while (len > 0) {
+	   ssize_t w = write (fd, p, len);
+	   if (w < 0) {
+	      if (errno == EINTR)
+	         continue;
+	      return false;
+	   }
+	   p	+= w;
+	   len	-= w;
+	}
+	return true;
+}
+//
+//	the segment - frequency, rate and gain - a sample belongs to
+static
+int	segmentOf	(snapshot *s, uint64_t sample, uint32_t n) {
+uint32_t lo	= n > SNAP_SEGMENTS ? n - SNAP_SEGMENTS : 0;
+uint32_t i;
+	if (n == 0)
+	   return -1;
+	for (i = n - 1; i > lo; i --)
+	   if (s -> segments [i % SNAP_SEGMENTS]. first <= sample)
+	      break;
+	return i % SNAP_SEGMENTS;
+}
+
+static
+void	writeMeta	(snapshot *s, const char *name,
+	                 uint64_t start, uint64_t end,
+	                 snapLoss *losses, int nLosses) {
+FILE	*f	= fopen (name, "w");
+uint32_t n	= __atomic_load_n (&s -> nSegments, __ATOMIC_ACQUIRE);
+uint32_t lo	= n > SNAP_SEGMENTS ? n - SNAP_SEGMENTS : 0;
+int	first	= segmentOf (s, start, n);
+int	rate	= first < 0 ? 0 : s -> segments [first]. rate;
+time_t	t	= s -> triggerTime. tv_sec;
+char	datetime [32];
+bool	comma	= false;
+int	gain	= 0;
+uint32_t i;
+int	j;
+
+	if (f == NULL) {
+	   fprintf (stderr, "cannot create %s\n", name);
+	   return;
+	}
+//	the time of the first sample, going back from the trigger
+	if (rate > 0)
+	   t	-= (s -> triggerSample - start) / rate;
+	strftime (datetime, sizeof (datetime),
+	                       "%Y-%m-%dT%H:%M:%SZ", gmtime (&t));
+	fprintf (f, "{\n  \"global\": {\n");
+	fprintf (f, "    \"core:datatype\": \"ci16_le\",\n");
+	fprintf (f, "    \"core:sample_rate\": %d,\n", rate);
+	fprintf (f, "    \"core:version\": \"1.0.0\",\n");
+	fprintf (f, "    \"core:recorder\": \"rtlsdr-bridge\",\n");
+	fprintf (f, "    \"core:hw\": \"%s\",\n", s -> hw);
+	fprintf (f, "    \"core:extensions\": [{\"name\": \"rtlsdr\", "
+	            "\"version\": \"1.0.0\", \"optional\": true}]\n  },\n");
+//
+//	the segment the snapshot starts in and the ones that follow
+	fprintf (f, "  \"captures\": [");
+	for (i = lo; (first >= 0) && (i < n); i ++) {
+	   snapSegment *g	= &s -> segments [i % SNAP_SEGMENTS];
+	   uint64_t from	= g -> first < start ? start : g -> first;
+	   if ((int)(i % SNAP_SEGMENTS) != first && g -> first <= start)
+	      continue;
+	   if (from >= end)
+	      break;
+	   fprintf (f, "%s\n    {\"core:sample_start\": %llu, "
+	               "\"core:frequency\": %d, \"rtlsdr:sample_rate\": %d",
+	               comma ? "," : "",
+	               (unsigned long long)(from - start),
+	               g -> frequency, g -> rate);
+	   if (!comma)
+	      fprintf (f, ", \"core:datetime\": \"%s\"", datetime);
+	   fprintf (f, "}");
+	   comma	= true;
+	}
+	fprintf (f, "\n  ],\n");
+//
+//	the trigger, the gains and the samples that were lost
+	fprintf (f, "  \"annotations\": [");
+	fprintf (f, "\n    {\"core:sample_start\": %llu, "
+	            "\"core:comment\": \"trigger\"}",
+	            (unsigned long long)(s -> triggerSample - start));
+	for (i = lo; (first >= 0) && (i < n); i ++) {
+	   snapSegment *g	= &s -> segments [i % SNAP_SEGMENTS];
+	   uint64_t from	= g -> first < start ? start : g -> first;
+	   if ((int)(i % SNAP_SEGMENTS) != first && g -> first <= start)
+	      continue;
+	   if (from >= end)
+	      break;
+	   if ((int)(i % SNAP_SEGMENTS) != first && g -> gain == gain)
+	      continue;
+	   gain	= g -> gain;
+	   fprintf (f, ",\n    {\"core:sample_start\": %llu, "
+	               "\"core:comment\": \"gain %.1f dB\", "
+	               "\"rtlsdr:gain\": %d}",
+	               (unsigned long long)(from - start),
+	               g -> gain / 10.0, g -> gain);
+	}
+	for (j = 0; j < nLosses; j ++)
+	   fprintf (f, ",\n    {\"core:sample_start\": %llu, "
+	               "\"core:sample_count\": %llu, "
+	               "\"core:comment\": \"overwritten, zero filled\"}",
+	               (unsigned long long)(losses [j]. sample - start),
+	               (unsigned long long)losses [j]. count);
+	fprintf (f, "\n  ]\n}\n");
+	fclose (f);
+}
+//
+//	Writing the samples from the start of the history to the end
+//	of the post trigger window, the latter as they come in.
+//	A chunk is copied, then checked: if the callback started
+//	to overwrite it in the meantime it is replaced by zeros
+static
+void	writeSnapshot	(snapshot *s) {
+uint64_t head	= __atomic_load_n (&s -> head, __ATOMIC_ACQUIRE);
+uint64_t start	= s -> triggerSample > s -> history ?
+	                       s -> triggerSample - s -> history : 0;
+uint64_t end	= s -> triggerSample + s -> post;
+snapLoss losses [SNAP_LOSSES];
+int	nLosses	= 0;
+char	dataName [300];
+char	metaName [300];
+uint64_t sample;
+int	fd;
+
+	if (head > s -> capacity && start < head - s -> capacity)
+	   start	= head - s -> capacity;
+	if (s -> base [0] == 0) {
+	   char stamp [32];
+	   strftime (stamp, sizeof (stamp), "%Y%m%d-%H%M%S",
+	                        gmtime (&s -> triggerTime. tv_sec));
+	   snprintf (s -> base, sizeof (s -> base), "%.200s-%s",
+	                                       s -> prefix, stamp);
+	}
+	snprintf (dataName, sizeof (dataName), "%s.sigmf-data", s -> base);
+	snprintf (metaName, sizeof (metaName), "%s.sigmf-meta", s -> base);
+	fd	= open (dataName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+	   fprintf (stderr, "cannot create %s: %s\n",
+	                            dataName, strerror (errno));
+	   return;
+	}
+
+	for (sample = start; sample < end; ) {
+	   uint64_t len	= end - sample;
+	   uint64_t pos, k, i, filling;
+	   if (len > SNAP_CHUNK)
+	      len = SNAP_CHUNK;
+	   while (__atomic_load_n (&s -> head, __ATOMIC_ACQUIRE) <
+	                                                 sample + len) {
+	      if (s -> stopping) {
+	         end	= __atomic_load_n (&s -> head, __ATOMIC_ACQUIRE);
+	         len	= end > sample ? end - sample : 0;
+	         break;
+	      }
+	      usleep (SNAP_POLL_USEC);
+	   }
+	   if (len == 0)
+	      break;
+	   pos	= sample % s -> capacity;
+	   k	= s -> capacity - pos;
+	   if (k > len)
+	      k = len;
+	   for (i = 0; i < k; i ++) {
+	      s -> out [2 * i]		= s -> xi [pos + i];
+	      s -> out [2 * i + 1]	= s -> xq [pos + i];
+	   }
+	   for (; i < len; i ++) {
+	      s -> out [2 * i]		= s -> xi [i - k];
+	      s -> out [2 * i + 1]	= s -> xq [i - k];
+	   }
+	   __atomic_thread_fence (__ATOMIC_ACQUIRE);
+	   filling	= __atomic_load_n (&s -> filling, __ATOMIC_RELAXED);
+	   if (filling - sample > s -> capacity) {
+	      memset (s -> out, 0, len * 4);
+	      if ((nLosses > 0) &&
+	          (losses [nLosses - 1]. sample +
+	                    losses [nLosses - 1]. count == sample))
+	         losses [nLosses - 1]. count += len;
+	      else
+	      if (nLosses < SNAP_LOSSES) {
+	         losses [nLosses]. sample	= sample;
+	         losses [nLosses]. count	= len;
+	         nLosses ++;
+	      }
+	   }
+	   if (!writeAll (fd, (uint8_t *)s -> out, len * 4)) {
+	      fprintf (stderr, "snapshot %s: %s\n",
+	                            dataName, strerror (errno));
+	      break;
+	   }
+	   sample	+= len;
+	}
+	close (fd);
+	writeMeta (s, metaName, start, sample, losses, nLosses);
+	fprintf (stderr, "snapshot of %llu samples in %s%s\n",
+	                 (unsigned long long)(sample - start), dataName,
+	                 nLosses > 0 ? ", some samples overwritten" : "");
+}
+
+static
+void	*snapWriter	(void *arg) {
+snapshot *s	= (snapshot *)arg;
+
+	while (true) {
+	   sem_wait (&s -> trigger);
+	   if (__atomic_load_n (&s -> pending, __ATOMIC_ACQUIRE)) {
+	      writeSnapshot (s);
+	      __atomic_store_n (&s -> pending, 0, __ATOMIC_RELEASE);
+	   }
+	   if (s -> stopping)
+	      break;
+	}
+	return NULL;
+}
+//
+//	The arena holds the ring, I and Q, and the buffer of the writer.
+//	It is populated at creation, the callback does not page fault
+//	on its first round. The ring holds the post trigger window as
+//	well, the start of the history is still there when the writer
+//	gets to it.
+snapshot	*snapCreate	(uint64_t history, uint64_t post,
+	                         const char *hw, const char *prefix) {
+snapshot *s	= (snapshot *)calloc (1, sizeof (snapshot));
+uint64_t capacity	= history + post;
+
+	if (s == NULL)
+	   return NULL;
+	if (capacity < SNAP_CHUNK)
+	   capacity	= SNAP_CHUNK;
+	s	-> capacity	= capacity;
+	s	-> history	= history;
+	s	-> post		= post;
+	s	-> arenaSize	= (2 * capacity + 2 * SNAP_CHUNK) * sizeof (int16_t);
+	s	-> arena	= mmap (NULL, s -> arenaSize,
+	                                PROT_READ | PROT_WRITE,
+	                                MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE,
+	                                -1, 0);
+	if (s -> arena == MAP_FAILED) {
+	   fprintf (stderr, "no memory for a history of %llu samples\n",
+	                                 (unsigned long long)capacity);
+	   free (s);
+	   return NULL;
+	}
+	s	-> xi		= (int16_t *)s -> arena;
+	s	-> xq		= s -> xi + capacity;
+	s	-> out		= s -> xq + capacity;
+	snprintf (s -> hw, sizeof (s -> hw), "%s", hw);
+	snprintf (s -> prefix, sizeof (s -> prefix), "%s", prefix);
+	sem_init (&s -> trigger, 0, 0);
+	if (pthread_create (&s -> writer, NULL, snapWriter, s) != 0) {
+	   sem_destroy (&s -> trigger);
+	   munmap (s -> arena, s -> arenaSize);
+	   free (s);
+	   return NULL;
+	}
+	return s;
+}
+//
+//	the callback should not use the history anymore, a snapshot
+//	being written is cut off at the samples that are there
+void	snapFree	(snapshot *s) {
+	if (s == NULL)
+	   return;
+	s	-> stopping	= true;
+	sem_post (&s -> trigger);
+	pthread_join (s -> writer, NULL);
+	sem_destroy (&s -> trigger);
+	munmap (s -> arena, s -> arenaSize);
+	free (s);
+}
+//
+//	called in the callback thread: a copy of I and of Q into the
+//	ring. filling announces the samples being overwritten before
+//	they are, head the samples that are there
+void	snapSamples	(snapshot *s,
+	                 const int16_t *xi, const int16_t *xq, int n,
+	                 int frequency, int rate, int gain) {
+uint64_t head	= s -> head;
+uint32_t nSeg	= s -> nSegments;
+
+	if ((nSeg == 0) ||
+	    (s -> segments [(nSeg - 1) % SNAP_SEGMENTS]. frequency != frequency) ||
+	    (s -> segments [(nSeg - 1) % SNAP_SEGMENTS]. rate != rate) ||
+	    (s -> segments [(nSeg - 1) % SNAP_SEGMENTS]. gain != gain)) {
+	   snapSegment *g	= &s -> segments [nSeg % SNAP_SEGMENTS];
+	   g -> first		= head;
+	   g -> frequency	= frequency;
+	   g -> rate		= rate;
+	   g -> gain		= gain;
+	   __atomic_store_n (&s -> nSegments, nSeg + 1, __ATOMIC_RELEASE);
+	}
+	__atomic_store_n (&s -> filling, head + n, __ATOMIC_RELAXED);
+	__atomic_thread_fence (__ATOMIC_RELEASE);
+	while (n > 0) {
+	   uint64_t pos	= head % s -> capacity;
+	   uint64_t k	= s -> capacity - pos;
+	   if (k > (uint64_t)n)
+	      k = n;
+	   memcpy (s -> xi + pos, xi, k * sizeof (int16_t));
+	   memcpy (s -> xq + pos, xq, k * sizeof (int16_t));
+	   xi	+= k;
+	   xq	+= k;
+	   n	-= k;
+	   head	+= k;
+	}
+	__atomic_store_n (&s -> head, head, __ATOMIC_RELEASE);
+}
+//
+//	The trigger takes the current sample as trigger point, the
+//	writer does the rest. Only async signal safe calls: it is
+//	used in a signal handler. -1 while a snapshot is being written
+int	snapTrigger	(snapshot *s, const char *base) {
+int	i;
+	if (__atomic_exchange_n (&s -> pending, 1, __ATOMIC_ACQ_REL))
+	   return -1;
+	s	-> triggerSample = __atomic_load_n (&s -> head, __ATOMIC_ACQUIRE);
+	clock_gettime (CLOCK_REALTIME, &s -> triggerTime);
+	for (i = 0; (base != NULL) && (base [i] != 0) &&
+	                      (i < (int)sizeof (s -> base) - 1); i ++)
+	   s -> base [i] = base [i];
+	s	-> base [i]	= 0;
+	sem_post (&s -> trigger);
+	return 0;
+}
@@ -0,0 +1,80 @@
+#
+/*
+ *    Copyright (C) 2018
+ *    Jan van Katwijk (J.vanKatwijk@gmail.com)
+ *    Lazy Chair Computing
+ *
+ *    This file is part of the sdrplayBridge.
+ *
+ *    rtlsdrBridge is available under GPL-V2
+ */
+#ifndef	__SNAPSHOT__
+#define	__SNAPSHOT__
+
+#include	<stdint.h>
+#include	<stdbool.h>
+#include	<pthread.h>
+#include	<semaphore.h>
+#include	<time.h>
+
+//	A history of the last seconds of the 16 bit samples a client
+//	gets, to save what came before an event. The samples are kept
+//	as they come - I and Q apart - in a ring in a preallocated arena,
+//	the callback thread only copies them in. On a trigger a thread
+//	writes the history, and the samples of the post trigger window
+//	while they come in, as a SigMF recording. The writer reads
+//	from the ring while it is being filled, samples overwritten
+//	before they were written are noted in the metadata.
+//	The changes of frequency, rate and gain are kept in a second,
+//	small, ring.
+#define	SNAP_SEGMENTS		1024
+#define	SNAP_CHUNK		65536
+#define	SNAP_POLL_USEC		10000
+
+typedef struct {
+	uint64_t	first;
+	int32_t		frequency;
+	int32_t		rate;
+	int32_t		gain;
+} snapSegment;
+
+typedef struct {
+	uint64_t	sample;
+	uint64_t	count;
+} snapLoss;
+
+typedef struct {
+	uint8_t		*arena;
+	size_t		arenaSize;
+	int16_t		*xi;
+	int16_t		*xq;
+	uint64_t	capacity;
+	uint64_t	history;
+	uint64_t	post;
+	char		hw [64];
+	char		prefix [256];
+//	written by the callback thread
+	volatile uint64_t	filling;
+	volatile uint64_t	head;
+	snapSegment	segments [SNAP_SEGMENTS];
+	volatile uint32_t	nSegments;
+//	a trigger, handled by the writer
+	sem_t		trigger;
+	volatile int	pending;
+	uint64_t	triggerSample;
+	struct timespec	triggerTime;
+	char		base [256];
+	pthread_t	writer;
+	volatile bool	stopping;
+	int16_t		*out;
+} snapshot;
+
+snapshot	*snapCreate	(uint64_t history, uint64_t post,
+	                         const char *hw, const char *prefix);
+void	snapFree	(snapshot *s);
+void	snapSamples	(snapshot *s,
+	                 const int16_t *xi, const int16_t *xq, int n,
+	                 int frequency, int rate, int gain);
+int	snapTrigger	(snapshot *s, const char *base);
+#endif
+
@@ -0,0 +1,159 @@
+#
+/*
+ *    Copyright (C) 2018
+ *    Jan van Katwijk (J.vanKatwijk@gmail.com)
+ *    Lazy Chair Computing
+ *
+ *    This file is part of the sdrplayBridge.
+ *
+ *    rtlsdrBridge is available under GPL-V2
+ */
+#include	<stdlib.h>
+#include	"squelch.h"
+
+squelch	*squelchCreate	(int slots, int bufferSize, int shiftSize) {
+squelch	*sq	= (squelch *)calloc (1, sizeof (squelch));
+int	i;
+
+	if (sq == NULL)
+	   return NULL;
+	sq	-> slots	= slots;
+	if (slots > 0) {
+	   sq -> buffers	= (uint8_t **)calloc (slots, sizeof (uint8_t *));
+	   sq -> shifts		= (uint8_t **)calloc (slots, sizeof (uint8_t *));
+	   sq -> lengths	= (int *)calloc (slots, sizeof (int));
+	   sq -> counts		= (int *)calloc (slots, sizeof (int));
+	   sq -> indices	= (uint64_t *)calloc (slots, sizeof (uint64_t));
+	   if ((sq -> buffers == NULL) || (sq -> shifts == NULL) ||
+	       (sq -> lengths == NULL) || (sq -> counts == NULL) ||
+	       (sq -> indices == NULL)) {
+	      squelchFree (sq);
+	      return NULL;
+	   }
+	   for (i = 0; i < slots; i ++) {
+	      sq -> buffers [i]	= (uint8_t *)malloc (bufferSize);
+	      sq -> shifts [i]	= (uint8_t *)malloc (shiftSize);
+	      if ((sq -> buffers [i] == NULL) || (sq -> shifts [i] == NULL)) {
+	         squelchFree (sq);
+	         return NULL;
+	      }
+	   }
+	}
+	return sq;
+}
+
+void	squelchFree	(squelch *sq) {
+int	i;
+	if (sq == NULL)
+	   return;
+	for (i = 0; i < sq -> slots; i ++) {
+	   if (sq -> buffers != NULL)
+	      free (sq -> buffers [i]);
+	   if (sq -> shifts != NULL)
+	      free (sq -> shifts [i]);
+	}
+	free (sq -> buffers);
+	free (sq -> shifts);
+	free (sq -> lengths);
+	free (sq -> counts);
+	free (sq -> indices);
+	free (sq);
+}
+//
+//	power and level per component, n samples, attack and hang
+//	in samples
+void	squelchUpdate	(squelch *sq, float power, float level,
+	                 int n, int attack, int hang) {
+	if (power >= level) {
+	   sq -> below	= 0;
+	   sq -> above	+= n;
+	   if (!sq -> open && (sq -> above >= attack))
+	      sq -> open = true;
+	}
+	else {
+	   sq -> above	= 0;
+	   sq -> below	+= n;
+	   if (sq -> open && (sq -> below >= hang))
+	      sq -> open = false;
+	}
+	if (sq -> open)
+	   sq -> openSeen = true;
+}
+//
+//	at the end of a buffer: is it passed on? The next buffer
+//	starts in the state this one ends in
+bool	squelchPassing	(squelch *sq) {
+bool	passing	= sq -> openSeen;
+	sq	-> openSeen	= sq -> open;
+	return passing;
+}
+
+static
+void	drop		(squelch *sq, int samples, uint64_t index) {
+	if (sq -> silent == 0)
+	   sq -> silenceStart = index;
+	sq	-> silent	+= samples;
+}
+//
+//	the buffer is kept - swapped with a free one - the oldest
+//	kept buffer makes room if there is no free one
+void	squelchHold	(squelch *sq, uint8_t **buffer, uint8_t **shifts,
+	                 int length, int samples, uint64_t index) {
+int	slot;
+uint8_t	*t;
+
+	if (sq -> slots == 0) {
+	   drop (sq, samples, index);
+	   return;
+	}
+	if (sq -> held == sq -> slots) {
+	   drop (sq, sq -> counts [sq -> first], sq -> indices [sq -> first]);
+	   sq -> first	= (sq -> first + 1) % sq -> slots;
+	   sq -> held --;
+	}
+	slot	= (sq -> first + sq -> held) % sq -> slots;
+	t	= sq -> buffers [slot];
+	sq	-> buffers [slot]	= *buffer;
+	*buffer	= t;
+	t	= sq -> shifts [slot];
+	sq	-> shifts [slot]	= *shifts;
+	*shifts	= t;
+	sq	-> lengths [slot]	= length;
+	sq	-> counts [slot]	= samples;
+	sq	-> indices [slot]	= index;
+	sq	-> held ++;
+}
+//
+//	the kept buffers, oldest first
+void	squelchRelease	(squelch *sq, squelchPass_t pass, void *ctx) {
+	while (sq -> held > 0) {
+	   int slot	= sq -> first;
+	   pass (ctx, sq -> buffers [slot], sq -> lengths [slot],
+	              sq -> shifts [slot], sq -> indices [slot]);
+	   sq -> first	= (sq -> first + 1) % sq -> slots;
+	   sq -> held --;
+	}
+}
+//
+//	the kept buffers, oldest first, are dropped after all, as
+//	when the stream ends before the squelch opens
+void	squelchDrop	(squelch *sq) {
+	while (sq -> held > 0) {
+	   drop (sq, sq -> counts [sq -> first], sq -> indices [sq -> first]);
+	   sq -> first	= (sq -> first + 1) % sq -> slots;
+	   sq -> held --;
+	}
+}
+//
+//	the samples dropped since the last marker, if there are at
+//	least limit of them
+bool	squelchSilence	(squelch *sq, uint64_t *start,
+	                 uint64_t *count, uint64_t limit) {
+	if ((sq -> silent == 0) || (sq -> silent < limit))
+	   return false;
+	*start	= sq -> silenceStart;
+	*count	= sq -> silent;
+	sq	-> silent	= 0;
+	return true;
+}
+
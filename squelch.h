@@ -0,0 +1,68 @@
+#
+/*
+ *    Copyright (C) 2018
+ *    Jan van Katwijk (J.vanKatwijk@gmail.com)
+ *    Lazy Chair Computing
+ *
+ *    This file is part of the sdrplayBridge.
+ *
+ *    rtlsdrBridge is available under GPL-V2
+ */
+#ifndef	__SQUELCH__
+#define	__SQUELCH__
+
+#include	<stdint.h>
+#include	<stdbool.h>
+
+//	A power squelch on the output of the bridge. The power is
+//	measured per run of samples the conversion handles (a packet
+//	of the SDRplay, or the part of it that fits in the buffer).
+//	The squelch opens when the power is above the level for the
+//	attack time, it closes when it has been below for the hang
+//	time. A buffer in which the squelch is open at some moment is
+//	passed to the client, the others are kept - as many as the
+//	pre-roll needs - and passed before the buffer that opens it,
+//	or dropped. Dropped samples are counted, the client is told
+//	with a silence marker before the next buffer it gets, or each
+//	SQUELCH_MARKER_SECONDS while it stays closed. When the stream
+//	ends with the squelch closed, the kept buffers are dropped and
+//	the last marker is given before read_async returns.
+//	The buffers are swapped, not copied: a kept buffer is replaced
+//	by a free one of the squelch, all have the same size.
+#define	SQUELCH_MARKER_SECONDS	1
+
+typedef	void	(*squelchPass_t) (void *ctx, uint8_t *buffer, int length,
+	                          uint8_t *shifts, uint64_t index);
+
+typedef struct {
+	int		slots;
+	int		held;
+	int		first;
+	uint8_t		**buffers;
+	uint8_t		**shifts;
+	int		*lengths;
+	int		*counts;
+	uint64_t	*indices;
+//	the state, samples above and below the level
+	bool		open;
+	bool		openSeen;
+	int64_t		above;
+	int64_t		below;
+//	the samples dropped since the last marker
+	uint64_t	silenceStart;
+	uint64_t	silent;
+} squelch;
+
+squelch	*squelchCreate	(int slots, int bufferSize, int shiftSize);
+void	squelchFree	(squelch *sq);
+void	squelchUpdate	(squelch *sq, float power, float level,
+	                 int n, int attack, int hang);
+bool	squelchPassing	(squelch *sq);
+void	squelchHold	(squelch *sq, uint8_t **buffer, uint8_t **shifts,
+	                 int length, int samples, uint64_t index);
+void	squelchRelease	(squelch *sq, squelchPass_t pass, void *ctx);
+void	squelchDrop	(squelch *sq);
+bool	squelchSilence	(squelch *sq, uint64_t *start,
+	                 uint64_t *count, uint64_t limit);
+#endif
+
@@ -0,0 +1,328 @@
+#
+/*
+ *    Copyright (C) 2018
+ *    Jan van Katwijk (J.vanKatwijk@gmail.com)
+ *    Lazy Chair Computing
+ *
+ *    This file is part of the sdrplayBridge.
+ *
+ *    rtlsdrBridge is available under GPL-V2
+ */
+#include	"sweep.h"
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<math.h>
+#include	<time.h>
+#ifdef	__MINGW32__
+#include	<windows.h>
+#else
+#include	<unistd.h>
+#endif
+
+static
+void	*sweepWorker	(void *arg);
+//
+//	the steps of a band: the part of the range within the band,
+//	divided in equal parts, each part is at most "usable" wide
+static
+int	planBand	(sweepState *s, int low, int high, int usable) {
+int	n	= (int)(((int64_t)high - low + usable - 1) / usable);
+int	i;
+	if (s -> nSteps + n > SWEEP_MAX_STEPS)
+	   return -1;
+	for (i = 0; i < n; i ++) {
+	   sweepStep *st = &s -> steps [s -> nSteps ++];
+	   st -> low	= low + (int)(((int64_t)high - low) * i / n);
+	   st -> high	= low + (int)(((int64_t)high - low) * (i + 1) / n);
+	   st -> center	= st -> low + (st -> high - st -> low) / 2;
+	}
+	return 0;
+}
+//
+//	the bands are consecutive ranges, the end of the band
+//	containing low is found by bisection
+static
+int	plan	(sweepState *s, int start, int stop,
+	                        int usable, sweepBand_t bandOf) {
+int	f	= start;
+	while (f < stop) {
+	   int	band	= bandOf (f);
+	   int	end	= stop;
+	   if (band < 0)
+	      return -1;
+	   if (bandOf (stop - 1) != band) {
+	      int lo	= f;
+	      int hi	= stop - 1;
+	      while (hi - lo > 1) {
+	         int mid = lo + (hi - lo) / 2;
+	         if (bandOf (mid) == band)
+	            lo = mid;
+	         else
+	            hi = mid;
+	      }
+	      end	= hi;
+	   }
+	   if (planBand (s, f, end, usable) < 0)
+	      return -1;
+	   f	= end;
+	}
+	return 0;
+}
+
+sweepState	*sweepCreate	(int rate, int start, int stop,
+	                         int binWidth, int averages,
+	                         sweepBand_t bandOf,
+	                         rtlsdr_sweep_cb_t cb, void *ctx) {
+sweepState	*s;
+int	N	= 16;
+int	i;
+double	sum	= 0;
+
+	if ((start >= stop) || (binWidth <= 0) ||
+	                       (averages <= 0) || (cb == NULL))
+	   return NULL;
+	while ((N < FFT_MAX_SIZE) && ((double)rate / N > binWidth))
+	   N *= 2;
+	s	= (sweepState *)calloc (1, sizeof (sweepState));
+	if (s == NULL)
+	   return NULL;
+	s	-> rate		= rate;
+	s	-> fftSize	= N;
+	s	-> averages	= averages;
+	s	-> callback	= cb;
+	s	-> ctx		= ctx;
+	s	-> need		= N * averages;
+	s	-> steps	= (sweepStep *)malloc (SWEEP_MAX_STEPS *
+	                                               sizeof (sweepStep));
+	s	-> window	= (float *)malloc (N * sizeof (float));
+	s	-> re		= (float *)malloc (N * sizeof (float));
+	s	-> im		= (float *)malloc (N * sizeof (float));
+	s	-> power	= (float *)malloc (N * sizeof (float));
+	s	-> row		= (float *)malloc (N * sizeof (float));
+	for (i = 0; i < 2; i ++) {
+	   s -> capI [i] = (int16_t *)malloc (s -> need * sizeof (int16_t));
+	   s -> capQ [i] = (int16_t *)malloc (s -> need * sizeof (int16_t));
+	}
+	if ((fftInit (&s -> fft, N) < 0) ||
+	    (s -> steps == NULL) || (s -> window == NULL) ||
+	    (s -> re == NULL) || (s -> im == NULL) ||
+	    (s -> power == NULL) || (s -> row == NULL) ||
+	    (s -> capI [0] == NULL) || (s -> capQ [0] == NULL) ||
+	    (s -> capI [1] == NULL) || (s -> capQ [1] == NULL) ||
+	    (plan (s, start, stop, (int)(SWEEP_USABLE * rate), bandOf) < 0)) {
+	   sweepFree (s);
+	   return NULL;
+	}
+//
+//	Hann window, scaled such that a full scale tone in the
+//	middle of a bin shows as 0 dB
+	for (i = 0; i < N; i ++) {
+	   s -> window [i] = 0.5 - 0.5 * cos (2 * M_PI * i / N);
+	   sum	+= s -> window [i];
+	}
+	s	-> windowGain	= sum * sum * 32768.0 * 32768.0;
+	pthread_mutex_init (&s -> lock, NULL);
+	pthread_cond_init  (&s -> cond, NULL);
+	if (pthread_create (&s -> worker, NULL, sweepWorker, s) != 0) {
+	   pthread_mutex_destroy (&s -> lock);
+	   pthread_cond_destroy (&s -> cond);
+	   sweepFree (s);
+	   return NULL;
+	}
+	s	-> workerUp	= true;
+	return s;
+}
+//
+//	the steps that were captured are handled before the worker stops
+void	sweepFree	(sweepState *s) {
+int	i;
+	if (s == NULL)
+	   return;
+	if (s -> workerUp) {
+	   pthread_mutex_lock (&s -> lock);
+	   s -> stopping	= true;
+	   pthread_cond_broadcast (&s -> cond);
+	   pthread_mutex_unlock (&s -> lock);
+	   pthread_join (s -> worker, NULL);
+	   pthread_mutex_destroy (&s -> lock);
+	   pthread_cond_destroy (&s -> cond);
+	}
+	fftFree (&s -> fft);
+	free (s -> steps);
+	free (s -> window);
+	free (s -> re);
+	free (s -> im);
+	free (s -> power);
+	free (s -> row);
+	for (i = 0; i < 2; i ++) {
+	   free (s -> capI [i]);
+	   free (s -> capQ [i]);
+	}
+	free (s);
+}
+//
+//	prepare the capture of the next step in one of the buffers,
+//	the worker should be done with it. Without a retune the
+//	samples are taken right away
+void	sweepArm	(sweepState *s, int buffer, bool retuned) {
+	pthread_mutex_lock (&s -> lock);
+	while (s -> jobBusy [buffer])
+	   pthread_cond_wait (&s -> cond, &s -> lock);
+	pthread_mutex_unlock (&s -> lock);
+	s	-> current	= buffer;
+	s	-> fill		= 0;
+	s	-> settle	= (int)((int64_t)s -> rate *
+	                                  SWEEP_SETTLE_USEC / 1000000);
+	__atomic_store_n (&s -> state,
+	                  retuned ? SWEEP_TUNING : SWEEP_CAPTURE,
+	                  __ATOMIC_RELEASE);
+}
+//
+//	returns false on a cancel or when the step takes too long.
+//	If the frequency change is not flagged in the stream in time,
+//	the settling starts anyway
+bool	sweepWait	(sweepState *s, volatile bool *running) {
+int	waited	= 0;
+	while (__atomic_load_n (&s -> state, __ATOMIC_ACQUIRE) != SWEEP_DONE) {
+	   if (!*running || (waited >= SWEEP_STEP_TIMEOUT))
+	      return false;
+	   if (waited == SWEEP_RF_TIMEOUT) {
+	      int expected	= SWEEP_TUNING;
+	      if (__atomic_compare_exchange_n (&s -> state, &expected,
+	                                       SWEEP_SETTLING, false,
+	                                       __ATOMIC_ACQ_REL,
+	                                       __ATOMIC_ACQUIRE))
+	         fprintf (stderr, "sweep: no rfChanged seen, settling anyway\n");
+	   }
+#ifdef	__MINGW32__
+	   Sleep (1);
+#else
+	   usleep (1000);
+#endif
+	   waited ++;
+	}
+	return true;
+}
+
+void	sweepSubmit	(sweepState *s, int buffer, int step, uint32_t sweep) {
+	__atomic_store_n (&s -> state, SWEEP_IDLE, __ATOMIC_RELEASE);
+	pthread_mutex_lock (&s -> lock);
+	s	-> jobStep  [buffer]	= step;
+	s	-> jobSweep [buffer]	= sweep;
+	s	-> jobBusy  [buffer]	= true;
+	pthread_cond_broadcast (&s -> cond);
+	pthread_mutex_unlock (&s -> lock);
+}
+//
+//	called in the callback thread
+void	sweepSamples	(sweepState *s, const int16_t *xi, const int16_t *xq,
+	                 int n, bool rfChanged) {
+int	state	= __atomic_load_n (&s -> state, __ATOMIC_ACQUIRE);
+int	k;
+
+	if (state == SWEEP_TUNING) {
+	   if (!rfChanged)
+	      return;
+	   if (!__atomic_compare_exchange_n (&s -> state, &state,
+	                                     SWEEP_SETTLING, false,
+	                                     __ATOMIC_ACQ_REL,
+	                                     __ATOMIC_ACQUIRE) &&
+	       (state != SWEEP_SETTLING))
+	      return;
+	   state	= SWEEP_SETTLING;
+	}
+	if (state == SWEEP_SETTLING) {
+	   k	= n < s -> settle ? n : s -> settle;
+	   s -> settle	-= k;
+	   xi	+= k;
+	   xq	+= k;
+	   n	-= k;
+	   if (s -> settle > 0)
+	      return;
+	   state	= SWEEP_CAPTURE;
+	   __atomic_store_n (&s -> state, state, __ATOMIC_RELEASE);
+	}
+	if (state != SWEEP_CAPTURE)
+	   return;
+	k	= s -> need - s -> fill;
+	if (k > n)
+	   k = n;
+	memcpy (s -> capI [s -> current] + s -> fill, xi, k * sizeof (int16_t));
+	memcpy (s -> capQ [s -> current] + s -> fill, xq, k * sizeof (int16_t));
+	s	-> fill	+= k;
+	if (s -> fill >= s -> need)
+	   __atomic_store_n (&s -> state, SWEEP_DONE, __ATOMIC_RELEASE);
+}
+//
+//	averaged power of the windowed FFTs, only the bins within
+//	the part of the band belonging to the step are passed on.
+//	The DC bin is interpolated from its neighbours
+static
+void	handleStep	(sweepState *s, int buffer) {
+int	N	= s -> fftSize;
+sweepStep *st	= &s -> steps [s -> jobStep [buffer]];
+double	binWidth	= (double)s -> rate / N;
+float	scale	= 1.0 / (s -> averages * s -> windowGain);
+rtlsdr_sweep_row_t row;
+int	a, k, kLow, kHigh;
+
+	memset (s -> power, 0, N * sizeof (float));
+	for (a = 0; a < s -> averages; a ++) {
+	   const int16_t *xi	= s -> capI [buffer] + a * N;
+	   const int16_t *xq	= s -> capQ [buffer] + a * N;
+	   for (k = 0; k < N; k ++) {
+	      s -> re [k]	= xi [k] * s -> window [k];
+	      s -> im [k]	= xq [k] * s -> window [k];
+	   }
+	   fftForward (&s -> fft, s -> re, s -> im);
+	   for (k = 0; k < N; k ++)
+	      s -> power [k] += s -> re [k] * s -> re [k] +
+	                        s -> im [k] * s -> im [k];
+	}
+	s	-> power [0]	= (s -> power [1] + s -> power [N - 1]) / 2;
+
+	kLow	= (int)ceil ((st -> low  - st -> center) / binWidth) + N / 2;
+	kHigh	= (int)ceil ((st -> high - st -> center) / binWidth) + N / 2;
+	if (kLow < 0)
+	   kLow = 0;
+	if (kHigh > N)
+	   kHigh = N;
+	for (k = kLow; k < kHigh; k ++)
+	   s -> row [k - kLow] =
+	          10 * log10f (s -> power [(k + N / 2) % N] * scale + 1e-20);
+
+	row. frequency	= st -> center + (kLow - N / 2) * binWidth;
+	row. binWidth	= binWidth;
+	row. bins	= kHigh > kLow ? kHigh - kLow : 0;
+	row. step	= s -> jobStep [buffer];
+	row. steps	= s -> nSteps;
+	row. sweep	= s -> jobSweep [buffer];
+	row. power	= s -> row;
+	s -> callback (&row, s -> ctx);
+}
+
+static
+void	*sweepWorker	(void *arg) {
+sweepState *s	= (sweepState *)arg;
+int	buffer	= 0;
+
+	while (true) {
+	   pthread_mutex_lock (&s -> lock);
+	   while (!s -> jobBusy [buffer] && !s -> stopping)
+	      pthread_cond_wait (&s -> cond, &s -> lock);
+	   if (!s -> jobBusy [buffer]) {
+	      pthread_mutex_unlock (&s -> lock);
+	      break;
+	   }
+	   pthread_mutex_unlock (&s -> lock);
+	   handleStep (s, buffer);
+	   pthread_mutex_lock (&s -> lock);
+	   s -> jobBusy [buffer]	= false;
+	   pthread_cond_broadcast (&s -> cond);
+	   pthread_mutex_unlock (&s -> lock);
+	   buffer	^= 1;
+	}
+	return NULL;
+}
+
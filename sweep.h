@@ -0,0 +1,98 @@
+#
+/*
+ *    Copyright (C) 2018
+ *    Jan van Katwijk (J.vanKatwijk@gmail.com)
+ *    Lazy Chair Computing
+ *
+ *    This file is part of the sdrplayBridge.
+ *
+ *    rtlsdrBridge is available under GPL-V2
+ */
+#ifndef	__SWEEP__
+#define	__SWEEP__
+
+#include	<stdint.h>
+#include	<stdbool.h>
+#include	<pthread.h>
+#include	<rtl-sdr_extensions.h>
+#include	"fft.h"
+
+//	A spectrum sweep: the range is covered in steps of
+//	SWEEP_USABLE times the (wide) band the device delivers, the
+//	edges of the band - where the IF filter rolls off - are not used.
+//	The steps are planned per frontend band, a step never covers
+//	frequencies outside the band its LO is in, so within a band
+//	a retune is a fast SetRf.
+//	The callback thread captures the samples of a step, after the
+//	first SWEEP_SETTLE_USEC of samples with the new frequency have
+//	been dropped. The FFTs are done by a worker thread, while the
+//	next step is being tuned and captured.
+#define	SWEEP_USABLE		0.75
+#define	SWEEP_SETTLE_USEC	2000
+#define	SWEEP_MAX_STEPS		4096
+//	waiting for the frequency change to show up in the stream
+#define	SWEEP_RF_TIMEOUT	100
+//	waiting for a step to be captured
+#define	SWEEP_STEP_TIMEOUT	2000
+
+#define	SWEEP_IDLE		0
+#define	SWEEP_TUNING		1
+#define	SWEEP_SETTLING		2
+#define	SWEEP_CAPTURE		3
+#define	SWEEP_DONE		4
+
+typedef struct {
+	int	center;
+	int	low;		// the part of the band taken from the step
+	int	high;
+} sweepStep;
+
+typedef struct {
+	int	rate;
+	int	fftSize;
+	int	averages;
+	fftPlan	fft;
+	float	*window;
+	float	windowGain;
+	sweepStep	*steps;
+	int	nSteps;
+	rtlsdr_sweep_cb_t	callback;
+	void	*ctx;
+//	the capture, two buffers: one is filled while the worker
+//	handles the other one
+	int16_t	*capI [2];
+	int16_t	*capQ [2];
+	int	need;
+	int	current;
+	int	settle;
+	int	fill;
+	volatile int	state;
+//	the worker
+	pthread_t	worker;
+	bool	workerUp;
+	pthread_mutex_t	lock;
+	pthread_cond_t	cond;
+	int	jobStep [2];
+	uint32_t	jobSweep [2];
+	bool	jobBusy [2];
+	bool	stopping;
+	float	*re;
+	float	*im;
+	float	*power;
+	float	*row;
+} sweepState;
+
+typedef	int	(*sweepBand_t)	(int freq);
+
+sweepState	*sweepCreate	(int rate, int start, int stop,
+	                         int binWidth, int averages,
+	                         sweepBand_t bandOf,
+	                         rtlsdr_sweep_cb_t cb, void *ctx);
+void	sweepFree	(sweepState *s);
+void	sweepArm	(sweepState *s, int buffer, bool retuned);
+bool	sweepWait	(sweepState *s, volatile bool *running);
+void	sweepSubmit	(sweepState *s, int buffer, int step, uint32_t sweep);
+void	sweepSamples	(sweepState *s, const int16_t *xi, const int16_t *xq,
+	                 int n, bool rfChanged);
+#endif
+
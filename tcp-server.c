@@ -0,0 +1,451 @@
+#
+/*
+ *    Copyright (C) 2018
+ *    Jan van Katwijk (J.vanKatwijk@gmail.com)
+ *    Lazy Chair Computing
+ *
+ *    This file is part of the sdrplayBridge.
+ *
+ *    rtlsdrBridge is available under GPL-V2
+ */
+#include	"tcp-server.h"
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<errno.h>
+#include	<unistd.h>
+#include	<pthread.h>
+#include	<poll.h>
+#include	<sys/socket.h>
+#include	<sys/uio.h>
+#include	<sys/un.h>
+#include	<netinet/in.h>
+#include	<arpa/inet.h>
+#include	<linux/errqueue.h>
+
+//	the number of MSG_ZEROCOPY sends that may be outstanding
+#define	ZC_PENDING	256
+//	the most buffers in one send
+#define	TCP_IOV		8
+
+typedef struct {
+	uint8_t		*data;
+	uint32_t	length;
+	int		slot;
+} tcpBuffer;
+
+typedef struct {
+	rtlsdr_dev_t	*dev;
+	signalQueue	*commands;
+	volatile bool	*serving;
+	int		fd;
+	volatile bool	clientGone;
+//	the queue of kept buffers, written by the read_async callback.
+//	sentIdx (and sentOffset in it) is where the sender is, the
+//	buffers before freeIdx are given back
+	tcpBuffer	queue [TCP_BUFFERS];
+	volatile uint32_t	writeIdx;
+	volatile uint32_t	freeIdx;
+	uint32_t	sentIdx;
+	uint32_t	sentOffset;
+	uint64_t	sentBytes;
+	uint64_t	drops;
+//	with MSG_ZEROCOPY, the buffers completely sent with each send
+	bool		zeroCopy;
+	bool		copied;
+	uint32_t	zcNext;
+	uint32_t	zcDone;
+	uint32_t	zcEnd [ZC_PENDING];
+} tcpSession;
+
+//	The gains as an R820T would report them. Clients interpret
+//	the gain index (command 0x0d) with the table for the tuner
+//	type in the header, the gain mapping of the bridge covers
+//	this range
+static
+const int	r820tGains [] = {
+	0, 9, 14, 27, 37, 77, 87, 125, 144, 157, 166, 197, 207, 229, 254,
+	280, 297, 328, 338, 364, 372, 386, 402, 421, 434, 439, 445, 480, 496
+};
+#define	R820T_GAINS	(sizeof (r820tGains) / sizeof (r820tGains [0]))
+
+static
+void	put32		(uint8_t *p, uint32_t v) {
+	p [0]	= v >> 24;
+	p [1]	= v >> 16;
+	p [2]	= v >> 8;
+	p [3]	= v;
+}
+//
+//	the read_async callback, the buffer is kept and queued. When
+//	all buffers are kept - the client did not keep up - the data
+//	is dropped
+static
+void	toQueue		(unsigned char *buf, uint32_t len, void *ctx) {
+tcpSession	*s	= (tcpSession *)ctx;
+uint32_t	w	= s -> writeIdx;
+tcpBuffer	*b	= &s -> queue [w % TCP_BUFFERS];
+int	slot;
+
+	if ((w - __atomic_load_n (&s -> freeIdx, __ATOMIC_ACQUIRE) >=
+	                                                  TCP_BUFFERS) ||
+	    ((slot = tcpHold (s -> dev, &buf, len)) < 0)) {
+	   s -> drops += len;
+	   return;
+	}
+	b	-> data		= buf;
+	b	-> length	= len;
+	b	-> slot		= slot;
+	__atomic_store_n (&s -> writeIdx, w + 1, __ATOMIC_RELEASE);
+}
+//
+//	the buffers up to "end" are done with
+static
+void	release		(tcpSession *s, uint32_t end) {
+uint32_t f	= s -> freeIdx;
+	while (f != end) {
+	   tcpRelease (s -> dev, s -> queue [f % TCP_BUFFERS]. slot);
+	   f ++;
+	   __atomic_store_n (&s -> freeIdx, f, __ATOMIC_RELEASE);
+	}
+}
+//
+//	the commands are not executed here, they are put on the
+//	queue of the device and handled in the read_async thread
+static
+void	command		(tcpSession *s, int cmd, uint32_t param) {
+	switch (cmd) {
+	   case 0x01:
+	      putSignalonQueue (s -> commands, SET_FREQUENCY, param);
+	      break;
+	   case 0x02:
+	      putSignalonQueue (s -> commands, SET_RATE, param);
+	      break;
+	   case 0x03:
+	      putSignalonQueue (s -> commands, SET_GAIN_MODE, param);
+	      break;
+	   case 0x04:
+	      putSignalonQueue (s -> commands, SET_GAIN, param);
+	      break;
+	   case 0x05:
+	      putSignalonQueue (s -> commands, SET_PPM, param);
+	      break;
+	   case 0x07:
+	      putSignalonQueue (s -> commands, SET_TESTMODE, param);
+	      break;
+	   case 0x08:
+	      putSignalonQueue (s -> commands, SET_AGC, param);
+	      break;
+	   case 0x0a:
+	      putSignalonQueue (s -> commands, SET_OFFSET, param);
+	      break;
+	   case 0x0d:
+	      if (param < R820T_GAINS)
+	         putSignalonQueue (s -> commands, SET_GAIN,
+	                                          r820tGains [param]);
+	      break;
+	   default:	// if gain, direct sampling, xtal, bias tee
+	      break;
+	}
+}
+
+static
+void	*receiver	(void *arg) {
+tcpSession	*s	= (tcpSession *)arg;
+uint8_t	cmd [5];
+
+	while (!s -> clientGone) {
+	   int	got	= 0;
+	   while (got < 5) {
+	      ssize_t n = recv (s -> fd, cmd + got, 5 - got, 0);
+	      if ((n < 0) && ((errno == EINTR) || (errno == EAGAIN)))
+	         continue;
+	      if (n <= 0) {
+	         s -> clientGone = true;
+	         return NULL;
+	      }
+	      got += n;
+	   }
+	   command (s, cmd [0], ((uint32_t)cmd [1] << 24) |
+	                        ((uint32_t)cmd [2] << 16) |
+	                        ((uint32_t)cmd [3] << 8)  | cmd [4]);
+	}
+	return NULL;
+}
+
+static
+void	*streamer	(void *arg) {
+tcpSession	*s	= (tcpSession *)arg;
+	rtlsdr_read_async (s -> dev, toQueue, s, TCP_BUFFERS, TCP_BUF_LEN);
+	s	-> clientGone	= true;
+	return NULL;
+}
+//
+//	the completions of MSG_ZEROCOPY sends, once the kernel is
+//	done with the buffers of a send, they are given back
+static
+void	reap		(tcpSession *s) {
+char	control [128];
+struct msghdr	msg;
+struct cmsghdr	*cm;
+
+	for (;;) {
+	   memset (&msg, 0, sizeof (msg));
+	   msg. msg_control	= control;
+	   msg. msg_controllen	= sizeof (control);
+	   if (recvmsg (s -> fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+	      return;
+	   for (cm = CMSG_FIRSTHDR (&msg); cm != NULL;
+	                               cm = CMSG_NXTHDR (&msg, cm)) {
+	      struct sock_extended_err *e =
+	                        (struct sock_extended_err *)CMSG_DATA (cm);
+	      if (!(((cm -> cmsg_level == SOL_IP) &&
+	             (cm -> cmsg_type == IP_RECVERR)) ||
+	            ((cm -> cmsg_level == SOL_IPV6) &&
+	             (cm -> cmsg_type == IPV6_RECVERR))))
+	         continue;
+	      if ((e -> ee_errno != 0) ||
+	          (e -> ee_origin != SO_EE_ORIGIN_ZEROCOPY))
+	         continue;
+	      if (e -> ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+	         s -> copied = true;
+//	for TCP, completions come in order, ee_data is the last one
+	      s -> zcDone	= e -> ee_data + 1;
+	      release (s, s -> zcEnd [e -> ee_data % ZC_PENDING]);
+	   }
+	}
+}
+//
+//	the sender passes the queued buffers on in batches, the
+//	buffers of a batch are the iovecs of a single call
+static
+void	sendLoop	(tcpSession *s) {
+	while (*s -> serving && !s -> clientGone) {
+	   uint32_t	w	= __atomic_load_n (&s -> writeIdx,
+	                                           __ATOMIC_ACQUIRE);
+	   uint32_t	len	= 0;
+	   uint32_t	i;
+	   struct iovec	iov [TCP_IOV];
+	   struct msghdr	msg;
+	   ssize_t	n;
+
+	   if (s -> zeroCopy) {
+	      reap (s);
+//	e.g. on loopback the kernel copies anyway, then zero copy
+//	only costs, switch to plain sends once all is completed
+	      if (s -> copied && (s -> zcDone == s -> zcNext)) {
+	         s -> zeroCopy	= false;
+	         release (s, s -> sentIdx);
+	      }
+	   }
+	   if ((w == s -> sentIdx) ||
+	       (s -> zeroCopy && (s -> zcNext - s -> zcDone >= ZC_PENDING))) {
+	      struct pollfd p;
+	      p. fd	= s -> fd;
+	      p. events	= 0;		// POLLERR signals completions
+	      poll (&p, 1, 1);
+	      continue;
+	   }
+	   memset (&msg, 0, sizeof (msg));
+	   for (i = s -> sentIdx; (i != w) && (msg. msg_iovlen < TCP_IOV) &&
+	                                     (len < TCP_BATCH); i ++) {
+	      tcpBuffer *b	= &s -> queue [i % TCP_BUFFERS];
+	      uint32_t	from	= i == s -> sentIdx ? s -> sentOffset : 0;
+	      uint32_t	part	= b -> length - from;
+	      if (part > TCP_BATCH - len)
+	         part = TCP_BATCH - len;
+	      iov [msg. msg_iovlen]. iov_base	= b -> data + from;
+	      iov [msg. msg_iovlen]. iov_len	= part;
+	      msg. msg_iovlen ++;
+	      len	+= part;
+	   }
+//	sendmsg rather than writev, to get MSG_NOSIGNAL
+	   msg. msg_iov		= iov;
+	   n	= sendmsg (s -> fd, &msg, MSG_NOSIGNAL |
+	                               (s -> zeroCopy ? MSG_ZEROCOPY : 0));
+	   if (n < 0) {
+	      if ((errno == EINTR) || (errno == EAGAIN))
+	         continue;
+	      if ((errno == ENOBUFS) && s -> zeroCopy) {
+	         struct pollfd p;
+	         p. fd		= s -> fd;
+	         p. events	= 0;
+	         poll (&p, 1, 1);
+	         continue;
+	      }
+	      break;
+	   }
+	   s -> sentBytes	+= n;
+	   while (n > 0) {
+	      uint32_t rest = s -> queue [s -> sentIdx % TCP_BUFFERS]. length -
+	                                                  s -> sentOffset;
+	      if (n < rest) {
+	         s -> sentOffset += n;
+	         break;
+	      }
+	      n	-= rest;
+	      s -> sentIdx ++;
+	      s -> sentOffset	= 0;
+	   }
+	   if (s -> zeroCopy) {
+	      s -> zcEnd [s -> zcNext % ZC_PENDING] = s -> sentIdx;
+	      s -> zcNext ++;
+	   }
+	   else
+	      release (s, s -> sentIdx);
+	}
+}
+
+static
+void	session		(tcpSession *s, bool tcp) {
+uint8_t	header [12];
+int	one	= 1;
+struct timeval	tv;
+pthread_t	streamThread, receiveThread;
+int	i;
+
+//	the dongle info
+	memcpy (header, "RTL0", 4);
+	put32 (header + 4, RTLSDR_TUNER_R820T);
+	put32 (header + 8, R820T_GAINS);
+	if (send (s -> fd, header, sizeof (header), MSG_NOSIGNAL) !=
+	                                              sizeof (header)) {
+	   close (s -> fd);
+	   return;
+	}
+//	a blocking send returns now and then to check for a stop
+	tv. tv_sec	= 0;
+	tv. tv_usec	= 100000;
+	setsockopt (s -> fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof (tv));
+	s -> writeIdx	= 0;
+	s -> freeIdx	= 0;
+	s -> sentIdx	= 0;
+	s -> sentOffset	= 0;
+	s -> sentBytes	= 0;
+	s -> drops	= 0;
+	s -> zcNext	= 0;
+	s -> zcDone	= 0;
+	s -> copied	= false;
+	s -> clientGone	= false;
+	s -> zeroCopy	= tcp && (setsockopt (s -> fd, SOL_SOCKET, SO_ZEROCOPY,
+	                                      &one, sizeof (one)) == 0);
+	signalReset (s -> commands);
+	pthread_create (&receiveThread, NULL, receiver, s);
+	pthread_create (&streamThread, NULL, streamer, s);
+	sendLoop (s);
+//	the kernel may still read from buffers of the bridge. They stay
+//	in the pool until rtlsdr_ext_serve_tcp returns, whatever stops
+//	the stream, here we wait for the completions for a while
+	for (i = 0; s -> zeroCopy && (s -> zcDone != s -> zcNext) &&
+	                                              (i < 100); i ++) {
+	   struct pollfd p;
+	   p. fd	= s -> fd;
+	   p. events	= 0;
+	   poll (&p, 1, 10);
+	   reap (s);
+	}
+	putSignalonQueue (s -> commands, CANCEL_ASYNC, 0);
+	pthread_join (streamThread, NULL);
+	shutdown (s -> fd, SHUT_RDWR);
+	pthread_join (receiveThread, NULL);
+	close (s -> fd);
+//	read_async has returned, what is still kept is given back
+	release (s, s -> writeIdx);
+	fprintf (stderr, "client disconnected, %llu bytes sent, %llu dropped\n",
+	                  (unsigned long long)s -> sentBytes,
+	                  (unsigned long long)s -> drops);
+}
+//
+//	an address starting with a '/' is the path of a unix socket,
+//	otherwise it is an IPv4 address, by default the loopback
+static
+int	listenOn	(const char *address, int port) {
+int	fd;
+int	one	= 1;
+
+	if ((address != NULL) && (address [0] == '/')) {
+	   struct sockaddr_un a;
+	   memset (&a, 0, sizeof (a));
+	   a. sun_family	= AF_UNIX;
+	   strncpy (a. sun_path, address, sizeof (a. sun_path) - 1);
+	   unlink (address);
+	   fd	= socket (AF_UNIX, SOCK_STREAM, 0);
+	   if ((fd < 0) ||
+	       (bind (fd, (struct sockaddr *)&a, sizeof (a)) < 0) ||
+	       (listen (fd, 1) < 0))
+	      goto fail;
+	   return fd;
+	}
+	else {
+	   struct sockaddr_in a;
+	   memset (&a, 0, sizeof (a));
+	   a. sin_family	= AF_INET;
+	   a. sin_port		= htons (port);
+	   if (inet_pton (AF_INET, address != NULL ? address : "127.0.0.1",
+	                                            &a. sin_addr) != 1) {
+	      fprintf (stderr, "invalid address %s\n", address);
+	      return -1;
+	   }
+	   fd	= socket (AF_INET, SOCK_STREAM, 0);
+	   if (fd >= 0)
+	      setsockopt (fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof (one));
+	   if ((fd < 0) ||
+	       (bind (fd, (struct sockaddr *)&a, sizeof (a)) < 0) ||
+	       (listen (fd, 1) < 0))
+	      goto fail;
+	   return fd;
+	}
+fail:
+	fprintf (stderr, "cannot listen on %s:%d (%s)\n",
+	                  address != NULL ? address : "127.0.0.1", port,
+	                  strerror (errno));
+	if (fd >= 0)
+	   close (fd);
+	return -1;
+}
+//
+//	clients are served one at the time, as rtl_tcp does, until
+//	"serving" becomes false
+int	tcpServe	(rtlsdr_dev_t *dev,
+	                 signalQueue *commands,
+	                 const char *address, int port,
+	                 volatile bool *serving) {
+tcpSession	*s;
+bool	unixSocket	= (address != NULL) && (address [0] == '/');
+int	lfd;
+
+	s	= (tcpSession *)calloc (1, sizeof (tcpSession));
+	if (s == NULL)
+	   return -1;
+	s	-> dev		= dev;
+	s	-> commands	= commands;
+	s	-> serving	= serving;
+	lfd	= listenOn (address, port);
+	if (lfd < 0) {
+	   free (s);
+	   return -1;
+	}
+	if (unixSocket)
+	   fprintf (stderr, "serving rtl_tcp on %s\n", address);
+	else
+	   fprintf (stderr, "serving rtl_tcp on %s:%d\n",
+	                  address != NULL ? address : "127.0.0.1", port);
+	while (*serving) {
+	   struct pollfd p;
+	   p. fd	= lfd;
+	   p. events	= POLLIN;
+	   if (poll (&p, 1, 100) <= 0)
+	      continue;
+	   s -> fd	= accept (lfd, NULL, NULL);
+	   if (s -> fd < 0)
+	      continue;
+	   fprintf (stderr, "client accepted\n");
+	   session (s, !unixSocket);
+	}
+	close (lfd);
+	if (unixSocket)
+	   unlink (address);
+	free (s);
+	return 0;
+}
+
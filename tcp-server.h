@@ -0,0 +1,45 @@
+#
+/*
+ *    Copyright (C) 2018
+ *    Jan van Katwijk (J.vanKatwijk@gmail.com)
+ *    Lazy Chair Computing
+ *
+ *    This file is part of the sdrplayBridge.
+ *
+ *    rtlsdrBridge is available under GPL-V2
+ */
+#ifndef	__TCP_SERVER__
+#define	__TCP_SERVER__
+
+#include	<stdbool.h>
+#include	<stdint.h>
+#include	<rtl-sdr.h>
+#include	"signal-queue.h"
+
+//	An rtl_tcp compatible server, built into the library.
+//	The buffers of read_async are not copied: the callback keeps
+//	them (tcpHold, the bridge continues in a free buffer of its
+//	pool) and queues them for a sender, that passes them on to the
+//	socket in batches of up to TCP_BATCH bytes, with writev or - on
+//	TCP sockets that support it - with MSG_ZEROCOPY. A buffer is
+//	given back (tcpRelease) when it is sent, with MSG_ZEROCOPY when
+//	the kernel reports it is done with it. A client that cannot
+//	keep up loses data - all TCP_BUFFERS are kept -, the stream
+//	itself is never blocked.
+//	Commands from the client are put on the command queue of the
+//	device, and executed by the thread running read_async.
+#define	TCP_BUFFERS	32
+#define	TCP_BATCH	(256 * 1024)
+#define	TCP_BUF_LEN	(16 * 16384)
+
+int	tcpServe	(rtlsdr_dev_t *dev,
+	                 signalQueue *commands,
+	                 const char *address, int port,
+	                 volatile bool *serving);
+//
+//	in the bridge: keep the buffer passed to the callback (or a
+//	copy, *buffer is then the copy), the slot in the pool or -1
+//	when none is free, and give it back
+int	tcpHold		(rtlsdr_dev_t *dev, uint8_t **buffer, uint32_t length);
+void	tcpRelease	(rtlsdr_dev_t *dev, int slot);
+#endif